@@ -35,6 +35,7 @@
 #define MBEDTLS_SSL_DTLS_ANTI_REPLAY
 #define MBEDTLS_SSL_DTLS_HELLO_VERIFY
 #define MBEDTLS_SSL_EXPORT_KEYS
+#define MBEDTLS_SSL_SESSION_TICKETS
 
 /* mbed TLS modules */
 #define MBEDTLS_AES_C
@@ -23,10 +23,17 @@
 #include "log.h"
 
 #include "ioc_cloud_client_dm.h"
+#include "ioc_config.h"
 #include "ioc_diagnostics.h"
 #include "ioc_network.h"
 #include "ioc_audio.h"
+#include "ioc_audio_link.h"
 #include "ioc_dynamics.h"
+#include "ioc_logging.h"
+#include "ioc_log_ring.h"
+#include "ioc_tls.h"
+#include "ioc_schedule.h"
+#include "ioc_trace.h"
 #include "ioc_utils.h"
 
 /* This file contains the LWM2M audio object plus all the
@@ -38,8 +45,16 @@
  * -------------------------------------------------------------- */
 
 // The possible communications modes (for audio streaming).
-#define COMMS_TCP 1
-#define COMMS_UDP 0
+#define COMMS_TCP  1
+#define COMMS_UDP  0
+#define COMMS_TLS  2 // TLS over TCP
+#define COMMS_DTLS 3 // DTLS over UDP
+
+// True if a communications mode runs over TCP.
+#define COMMS_IS_TCP(mode) (((mode) == COMMS_TCP) || ((mode) == COMMS_TLS))
+
+// True if a communications mode is secured.
+#define COMMS_IS_SECURE(mode) (((mode) == COMMS_TLS) || ((mode) == COMMS_DTLS))
 
 // A signal to indicate that an audio datagram is ready to send.
 #define SIG_DATAGRAM_READY 0x01
@@ -67,6 +82,16 @@
 #define AUDIO_DEFAULT_COMMUNICATION_MODE COMMS_TCP
 #define AUDIO_DEFAULT_SERVER_URL         "ciot.it-sgn.u-blox.com:5065"
 
+// The longest interval between checks of the streaming
+// schedule; checks are otherwise only made at window
+// boundaries, so this bounds the effect of the RTC being
+// adjusted (e.g. from GNSS) in between.
+#define AUDIO_SCHEDULE_CHECK_MAX_INTERVAL_SECONDS 3600
+
+// The interval between checks of the streaming schedule
+// while the RTC has not yet been set.
+#define AUDIO_SCHEDULE_CHECK_NO_TIME_INTERVAL_SECONDS 60
+
 /* ----------------------------------------------------------------
  * CALLBACK FUNCTION PROTOTYPES
  * -------------------------------------------------------------- */
@@ -93,6 +118,20 @@ static const Callback<void()> gI2STaskCallback(&I2S::i2s_bh_queue, &events::Even
 // For monitoring progress.
 static Ticker gSecondTicker;
 
+// The audio data path is:
+//
+// I2S DMA -> gRawAudio (SRAM) -> codeAudioBlock() -> datagram slot
+// in gDatagramStorage (CCMRAM) -> socket
+//
+// i.e. codeAudioBlock() is handed the half of gRawAudio that DMA
+// has just filled, in place, and the send task hands each
+// datagram slot to the socket, again in place, before freeing
+// it.  How the samples are staged and coded into the slot is up
+// to URTP (urtp.lib), so any change to that belongs there; the
+// time spent coding each block is monitored below
+// (EVENT_AUDIO_BLOCK_CODE_DURATION_MAX) so that the per-block
+// cost, and any change to it, is visible.
+
 // Audio buffer, enough for two blocks of stereo audio,
 // where each sample takes up 64 bits (32 bits for L channel
 // and 32 bits for R channel).
@@ -103,6 +142,27 @@ static uint32_t gRawAudio[(SAMPLES_PER_BLOCK * 2) * 2];
 __attribute__ ((section ("CCMRAM")))
 static char gDatagramStorage[URTP_DATAGRAM_STORE_SIZE];
 
+// For monitoring the time taken to code a block of audio.
+static volatile unsigned int gCodeDurationMaxUs = 0;
+
+// The number of datagrams that may be queued, set from
+// configuration when streaming starts.  This may be less than
+// the MAX_NUM_DATAGRAMS that gDatagramStorage is sized for, in
+// which case the oldest datagrams are discarded as each new one
+// is queued, as URTP itself does when gDatagramStorage
+// overflows.
+static int gDatagramStoreSize = MAX_NUM_DATAGRAMS;
+
+// The datagram the send task is sending, NULL if none, which
+// must not be discarded from under it.
+static const char * volatile gpDatagramSending = NULL;
+
+// Flag to indicate that datagrams are being discarded
+// because the queue has exceeded gDatagramStoreSize, and
+// the number discarded so far in this episode.
+static bool gDatagramsDiscarding = false;
+static int gNumDatagramsDiscarded = 0;
+
 // Task to send data off to the audio streaming server.
 static Thread *gpSendTask = NULL;
 
@@ -118,13 +178,67 @@ static I2S *gpI2s = NULL;
 // The LWM2M object
 static IocM2mAudio *gpM2mObject = NULL;
 
+// The event queue ID of the next streaming schedule check,
+// 0 if there is none.
+static int gScheduleCheckEventId = 0;
+
+// Flag to indicate that streaming was started by the
+// schedule, rather than by the server, and the end of the
+// window it was started for; streaming is only started once
+// per window so that the server can switch it off again
+// part way through.
+static bool gStreamingStartedBySchedule = false;
+static time_t gScheduleWindowEnd = 0;
+
 /* ----------------------------------------------------------------
  * STATIC FUNCTIONS: URTP CODEC AND ITS CALLBACK FUNCTIONS
  * -------------------------------------------------------------- */
 
+// Keep the number of queued datagrams within gDatagramStoreSize
+// by discarding the oldest, treating this as an overflow; called
+// as each datagram is queued so that the limit holds while the
+// send task is blocked.  The oldest datagram is not discarded if
+// the send task is sending it.
+static void limitDatagramQueue()
+{
+    const char *pUrtpDatagram;
+    int numDiscarded = 0;
+    bool stop = false;
+
+    while (!stop && (gUrtp.getUrtpDatagramsAvailable() > gDatagramStoreSize)) {
+        core_util_critical_section_enter();
+        pUrtpDatagram = gUrtp.getUrtpDatagram();
+        if ((pUrtpDatagram != NULL) && (pUrtpDatagram != gpDatagramSending)) {
+            gUrtp.setUrtpDatagramAsRead(pUrtpDatagram);
+            numDiscarded++;
+        } else {
+            stop = true;
+        }
+        core_util_critical_section_exit();
+    }
+
+    if (numDiscarded > 0) {
+        if (!gDatagramsDiscarding) {
+            gDatagramsDiscarding = true;
+            gNumDatagramsDiscarded = 0;
+            datagramOverflowStartCb();
+        }
+        gNumDatagramsDiscarded += numDiscarded;
+        LOG_RING(EVENT_AUDIO_DATAGRAMS_DISCARDED, numDiscarded);
+    } else if (gDatagramsDiscarding) {
+        gDatagramsDiscarding = false;
+        datagramOverflowStopCb(gNumDatagramsDiscarded);
+    }
+}
+
 // Callback for when an audio datagram is ready for sending.
 static void datagramReadyCb(const char *pDatagram)
 {
+    // This is called once per block so sampling the
+    // queue depth here gives time at depth
+    addAudioDatagramQueueSample(gUrtp.getUrtpDatagramsAvailable(), gDatagramStoreSize);
+
+    limitDatagramQueue();
     if (gpSendTask != NULL) {
         // Send the signal to the sending task
         gpSendTask->signal_set(SIG_DATAGRAM_READY);
@@ -135,12 +249,14 @@ static void datagramReadyCb(const char *pDatagram)
 static void datagramOverflowStartCb()
 {
     event();
+    startAudioDatagramOverflow();
 }
 
 // Callback for when the audio datagram list stops overflowing.
 static void datagramOverflowStopCb(int numOverflows)
 {
     notEvent();
+    stopAudioDatagramOverflow(numOverflows);
 }
 
 /* ----------------------------------------------------------------
@@ -151,54 +267,25 @@ static void datagramOverflowStopCb(int numOverflows)
 // This is a ticker call-back, so nothing heavy please.
 static void audioMonitor()
 {
-    // Monitor throughput
-    if (getNumAudioBytesSent() > 0) {
-        LOG(EVENT_THROUGHPUT_BITS_S, getNumAudioBytesSent() << 3);
-        setNumAudioBytesSent(0);
+    static unsigned int numAudioBytesSentLast = 0;
+    unsigned int numAudioBytesSent = getNumAudioBytesSent();
+    unsigned int bitsPerSecond = (numAudioBytesSent - numAudioBytesSentLast) << 3;
+
+    // Monitor throughput; the count of bytes sent is only
+    // ever read here, never reset, so that it can't tear
+    // against the send task
+    addAudioLinkGoodputSample(bitsPerSecond);
+    if (numAudioBytesSent != numAudioBytesSentLast) {
+        LOG(EVENT_THROUGHPUT_BITS_S, bitsPerSecond);
+        numAudioBytesSentLast = numAudioBytesSent;
         LOG(EVENT_NUM_DATAGRAMS_QUEUED, gUrtp.getUrtpDatagramsAvailable());
     }
-}
 
-// Get the address portion of a URL, leaving off the port number etc.
-static void getAddressFromUrl(const char * pUrl, char * pAddressBuf, int lenBuf)
-{
-    const char * pPortPos;
-    int lenUrl;
-
-    if (lenBuf > 0) {
-        // Check for the presence of a port number
-        pPortPos = strchr(pUrl, ':');
-        if (pPortPos != NULL) {
-            // Length wanted is up to and including the ':'
-            // (which will be overwritten with the terminator)
-            if (lenBuf > pPortPos - pUrl + 1) {
-                lenBuf = pPortPos - pUrl + 1;
-            }
-        } else {
-            // No port number, take the whole thing
-            // including the terminator
-            lenUrl = strlen (pUrl);
-            if (lenBuf > lenUrl + 1) {
-                lenBuf = lenUrl + 1;
-            }
-        }
-        memcpy (pAddressBuf, pUrl, lenBuf);
-        *(pAddressBuf + lenBuf - 1) = 0;
-    }
-}
-
-// Get the port number from the end of a URL.
-static bool getPortFromUrl(const char * pUrl, int *port)
-{
-    bool success = false;
-    const char * pPortPos = strchr(pUrl, ':');
-
-    if (pPortPos != NULL) {
-        *port = atoi(pPortPos + 1);
-        success = true;
+    // Monitor the worst case time to code a block
+    if (gCodeDurationMaxUs > 0) {
+        LOG(EVENT_AUDIO_BLOCK_CODE_DURATION_MAX, gCodeDurationMaxUs);
+        gCodeDurationMaxUs = 0;
     }
-
-    return success;
 }
 
 // Start the audio streaming connection.
@@ -245,6 +332,7 @@ static bool startAudioStreamingConnection(AudioLocal *pAudio)
     printf("Opening socket to server for audio comms...\n");
     switch (pAudio->socketMode) {
         case COMMS_TCP:
+        case COMMS_TLS:
             pAudio->sock.pTcpSock = new TCPSocket();
             LOG(EVENT_SOCKET_OPENING, 0);
             nsapiError = pAudio->sock.pTcpSock->open(pGetNetworkInterface());
@@ -280,6 +368,7 @@ static bool startAudioStreamingConnection(AudioLocal *pAudio)
             }
             break;
         case COMMS_UDP:
+        case COMMS_DTLS:
             pAudio->sock.pUdpSock = new UDPSocket();
             nsapiError = pAudio->sock.pUdpSock->open(pGetNetworkInterface());
             LOG(EVENT_SOCKET_OPENING, 0);
@@ -299,6 +388,21 @@ static bool startAudioStreamingConnection(AudioLocal *pAudio)
             break;
     }
 
+    if (COMMS_IS_SECURE(pAudio->socketMode)) {
+        flash();
+        // A resumed session is used if one is cached for this
+        // server, which saves a full handshake on reconnect
+        if (pAudio->socketMode == COMMS_TLS) {
+            pAudio->handshakeType = tlsConnect(pAudio->sock.pTcpSock, &pAudio->server, false);
+        } else {
+            pAudio->handshakeType = tlsConnect(pAudio->sock.pUdpSock, &pAudio->server, true);
+        }
+        if (pAudio->handshakeType == TLS_HANDSHAKE_NONE) {
+            printf("Could not secure connection to audio streaming server.\n");
+            return false;
+        }
+    }
+
     gAudioCommsConnected = true;
 
     return true;
@@ -310,8 +414,12 @@ static void stopAudioStreamingConnection(AudioLocal *pAudio)
     flash();
     LOG(EVENT_AUDIO_STREAMING_CONNECTION_STOP, 0);
     printf("Closing audio server socket...\n");
+    if (COMMS_IS_SECURE(pAudio->socketMode)) {
+        tlsDisconnect();
+    }
     switch (pAudio->socketMode) {
         case COMMS_TCP:
+        case COMMS_TLS:
             // No need to close() the socket,
             // the destructor does that.
             if (pAudio->sock.pTcpSock != NULL) {
@@ -320,6 +428,7 @@ static void stopAudioStreamingConnection(AudioLocal *pAudio)
             }
             break;
         case COMMS_UDP:
+        case COMMS_DTLS:
             // No need to close() the socket,
             // the destructor does that.
             if (pAudio->sock.pUdpSock != NULL) {
@@ -342,7 +451,9 @@ static int tcpSend(TCPSocket * pSock, const char * pData, int size)
     int x = 0;
     int count = 0;
     Timer timer;
+    TraceSpan span;
 
+    traceSpanStart(&span);
     timer.start();
     while ((count < size) && (timer.read_ms() < AUDIO_TCP_SEND_TIMEOUT_MS)) {
         x = pSock->send(pData + count, size - count);
@@ -360,16 +471,32 @@ static int tcpSend(TCPSocket * pSock, const char * pData, int size)
         count = x;
     }
 
+    traceSpanEnd(&span, TRACE_SPAN_TCP_SEND);
+
     return count;
 }
 
+// Get the oldest queued datagram, marking it as being sent so
+// that limitDatagramQueue() leaves it alone.
+static const char *pTakeDatagramToSend()
+{
+    const char *pUrtpDatagram;
+
+    core_util_critical_section_enter();
+    pUrtpDatagram = gUrtp.getUrtpDatagram();
+    gpDatagramSending = pUrtpDatagram;
+    core_util_critical_section_exit();
+
+    return pUrtpDatagram;
+}
+
 // The send function that forms the body of the send task.
 // This task runs whenever there is an audio datagram ready
 // to send.
 static void sendAudioData(const AudioLocal * pAudioLocal)
 {
     const char * pUrtpDatagram = NULL;
-    Timer sendDurationTimer;
+    TraceSpan sendSpan;
     Timer badSendDurationTimer;
     unsigned int duration;
     int retValue;
@@ -379,14 +506,15 @@ static void sendAudioData(const AudioLocal * pAudioLocal)
         // Wait for at least one datagram to be ready to send
         Thread::signal_wait(SIG_DATAGRAM_READY, AUDIO_SEND_DATA_RUN_ANYWAY_TIME_MS);
 
-        while ((pUrtpDatagram = gUrtp.getUrtpDatagram()) != NULL) {
+        while ((pUrtpDatagram = pTakeDatagramToSend()) != NULL) {
             okToDelete = false;
-            sendDurationTimer.reset();
-            sendDurationTimer.start();
+            traceSpanStart(&sendSpan);
             // Send the datagram
             if (gAudioCommsConnected) {
-                //LOG(EVENT_SEND_START, (int) pUrtpDatagram);
-                if (pAudioLocal->socketMode == COMMS_TCP) {
+                LOG_FILTERED(EVENT_SEND_START, (int) pUrtpDatagram);
+                if (COMMS_IS_SECURE(pAudioLocal->socketMode)) {
+                    retValue = tlsSend(pUrtpDatagram, URTP_DATAGRAM_SIZE, AUDIO_TCP_SEND_TIMEOUT_MS);
+                } else if (pAudioLocal->socketMode == COMMS_TCP) {
                     retValue = tcpSend(pAudioLocal->sock.pTcpSock, pUrtpDatagram, URTP_DATAGRAM_SIZE);
                 } else {
                     retValue = pAudioLocal->sock.pUdpSock->sendto(pAudioLocal->server, pUrtpDatagram, URTP_DATAGRAM_SIZE);
@@ -404,7 +532,7 @@ static void sendAudioData(const AudioLocal * pAudioLocal)
                     badSendDurationTimer.reset();
                     toggleGreen();
                 }
-                //LOG(EVENT_SEND_STOP, (int) pUrtpDatagram);
+                LOG_FILTERED(EVENT_SEND_STOP, (int) pUrtpDatagram);
 
                 if (retValue < 0) {
                     // If the connection has gone, set a flag that will be picked up outside this function and
@@ -426,29 +554,30 @@ static void sendAudioData(const AudioLocal * pAudioLocal)
                 }
             }
 
-            sendDurationTimer.stop();
-            duration = sendDurationTimer.read_us();
-            incAverageAudioDatagramSendDuration(duration);
+            duration = traceSpanEnd(&sendSpan, TRACE_SPAN_SEND_AUDIO_DATA);
+            addAudioDatagramSendDuration(duration);
             incNumAudioDatagrams();
 
             if (duration > BLOCK_DURATION_MS * 1000) {
                 // If this is UDP then it's serious, if it's TCP then
                 // we can catch up.
-                if (pAudioLocal->socketMode == COMMS_UDP) {
+                if (!COMMS_IS_TCP(pAudioLocal->socketMode)) {
                     LOG(EVENT_SEND_DURATION_GREATER_THAN_BLOCK_DURATION, duration);
                 }
                 incNumAudioDatagramsSendTookTooLong();
             } else {
-                //LOG(EVENT_SEND_DURATION, duration);
+                LOG_FILTERED(EVENT_SEND_DURATION, duration);
             }
-            if (duration > getWorstCaseAudioDatagramSendDuration()) {
-                setWorstCaseAudioDatagramSendDuration(duration);
+            if (updateWorstCaseAudioDatagramSendDuration(duration)) {
                 LOG(EVENT_NEW_PEAK_SEND_DURATION, duration);
             }
 
+            core_util_critical_section_enter();
             if (okToDelete) {
                 gUrtp.setUrtpDatagramAsRead(pUrtpDatagram);
             }
+            gpDatagramSending = NULL;
+            core_util_critical_section_exit();
         }
     }
 }
@@ -465,17 +594,31 @@ static void sendAudioData(const AudioLocal * pAudioLocal)
 // double buffer.
 static void i2sEventCallback (int arg)
 {
+    const uint32_t *pRawAudio = NULL;
+    unsigned int duration;
+    TraceSpan span;
+
+    traceSpanStart(&span);
     if (arg & I2S_EVENT_RX_HALF_COMPLETE) {
-        //LOG(EVENT_I2S_DMA_RX_HALF_FULL, 0);
-        gUrtp.codeAudioBlock(gRawAudio);
+        LOG_FILTERED(EVENT_I2S_DMA_RX_HALF_FULL, 0);
+        pRawAudio = gRawAudio;
     } else if (arg & I2S_EVENT_RX_COMPLETE) {
-        //LOG(EVENT_I2S_DMA_RX_FULL, 0);
-        gUrtp.codeAudioBlock(gRawAudio + (sizeof (gRawAudio) / sizeof (gRawAudio[0])) / 2);
+        LOG_FILTERED(EVENT_I2S_DMA_RX_FULL, 0);
+        pRawAudio = gRawAudio + (sizeof (gRawAudio) / sizeof (gRawAudio[0])) / 2;
     } else {
-        LOG(EVENT_I2S_DMA_UNKNOWN, arg);
+        LOG_RING(EVENT_I2S_DMA_UNKNOWN, arg);
         bad();
         printf("Unexpected event mask 0x%08x.\n", arg);
     }
+
+    if (pRawAudio != NULL) {
+        // Code the block straight from the DMA buffer, timing it
+        gUrtp.codeAudioBlock(pRawAudio);
+        duration = traceSpanEnd(&span, TRACE_SPAN_I2S_EVENT_CALLBACK);
+        if (duration > gCodeDurationMaxUs) {
+            gCodeDurationMaxUs = duration;
+        }
+    }
 }
 
 // Initialise the I2S interface and begin reading from it.
@@ -514,7 +657,7 @@ static bool startI2s()
         (gpI2s->format(24, 32, 0) == 0) &&
         (gpI2s->audio_frequency(SAMPLING_FREQUENCY) == 0)) {
         if (gpI2sTask == NULL) {
-            gpI2sTask = new Thread();
+            gpI2sTask = new Thread(osPriorityNormal, OS_STACK_SIZE, NULL, "i2s");
         }
         if (gpI2sTask->start(gI2STaskCallback) == osOK) {
             if (gpI2s->transfer((void *) NULL, 0,
@@ -571,6 +714,8 @@ static void stopI2s()
 // Stop audio streaming.
 static void stopStreaming(AudioLocal *pAudioLocal)
 {
+    HeapTag heapTag = heapTagStart(HEAP_TAG_AUDIO);
+
     stopI2s();
 
     if (gpSendTask != NULL) {
@@ -590,17 +735,20 @@ static void stopStreaming(AudioLocal *pAudioLocal)
         printf ("Audio send task stopped.\n");
     }
 
+    stopAudioLinkEstimator();
     stopAudioStreamingConnection(pAudioLocal);
 
     gSecondTicker.detach();
 
     printf("Audio streaming stopped.\n");
     pAudioLocal->streamingEnabled = false;
+
+    heapTagStop(heapTag);
 }
 
-// Start audio streaming.
+// Start audio streaming, the work of startStreaming().
 // Note: here be multiple return statements.
-static bool startStreaming(AudioLocal *pAudioLocal)
+static bool doStartStreaming(AudioLocal *pAudioLocal)
 {
     int retValue;
 
@@ -615,8 +763,13 @@ static bool startStreaming(AudioLocal *pAudioLocal)
         return false;
     }
 
+    // Start estimating the round trip time and goodput
+    startAudioLinkEstimator(&pAudioLocal->server);
+
     flash();
-    printf ("Setting up URTP...\n");
+    gDatagramStoreSize = getAudioDatagramStoreSize();
+    gDatagramsDiscarding = false;
+    printf ("Setting up URTP with a store of %d datagram(s)...\n", gDatagramStoreSize);
     if (!gUrtp.init((void *) &gDatagramStorage, pAudioLocal->fixedGain)) {
         pAudioLocal->streamingEnabled = false;
         bad();
@@ -628,7 +781,7 @@ static bool startStreaming(AudioLocal *pAudioLocal)
     flash();
     printf ("Starting task to send audio data...\n");
     if (gpSendTask == NULL) {
-        gpSendTask = new Thread();
+        gpSendTask = new Thread(osPriorityNormal, OS_STACK_SIZE, NULL, "audio send");
     }
     retValue = gpSendTask->start(callback(sendAudioData, pAudioLocal));
     if (retValue != osOK) {
@@ -650,12 +803,83 @@ static bool startStreaming(AudioLocal *pAudioLocal)
     pAudioLocal->streamingEnabled = true;
     if (pAudioLocal->duration >= 0) {
         printf("Audio streaming will stop in %d second(s).\n", pAudioLocal->duration);
-        pGetEventQueue()->call_in(pAudioLocal->duration * 1000, &stopStreaming, pAudioLocal);
+        eventQueueCallIn("stop streaming", pAudioLocal->duration * 1000, callback(&stopStreaming, pAudioLocal));
     }
 
     return pAudioLocal->streamingEnabled;
 }
 
+// Start audio streaming, attributing the heap used to audio.
+static bool startStreaming(AudioLocal *pAudioLocal)
+{
+    HeapTag heapTag = heapTagStart(HEAP_TAG_AUDIO);
+    bool success = doStartStreaming(pAudioLocal);
+
+    heapTagStop(heapTag);
+
+    return success;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: STREAMING SCHEDULE
+ * -------------------------------------------------------------- */
+
+// Check the streaming schedule, starting streaming at the
+// beginning of a window and stopping it at the end, then
+// arrange to be called again at the next window boundary.
+// This is called from the event queue.
+static void scheduleCheck()
+{
+    time_t now = time(NULL);
+    time_t windowEnd;
+    time_t nextCheck;
+    int checkIntervalSeconds = AUDIO_SCHEDULE_CHECK_MAX_INTERVAL_SECONDS;
+
+    gScheduleCheckEventId = 0;
+
+    if (now < SCHEDULE_MIN_VALID_TIME) {
+        // Can't evaluate the schedule until the RTC is set
+        checkIntervalSeconds = AUDIO_SCHEDULE_CHECK_NO_TIME_INTERVAL_SECONDS;
+    } else if (isInScheduleWindow(now, &windowEnd)) {
+        if (!gAudioLocalActive.streamingEnabled && (windowEnd != gScheduleWindowEnd)) {
+            LOG(EVENT_AUDIO_SCHEDULE_WINDOW_START, windowEnd - now);
+            printf("Streaming schedule window open until %s", ctime(&windowEnd));
+            // Stream with the server's current settings but without
+            // a duration limit: the end of the window stops it
+            gAudioLocalActive = gAudioLocalPending;
+            gAudioLocalActive.duration = -1;
+            gAudioLocalPending.streamingEnabled = startStreaming(&gAudioLocalActive);
+            gStreamingStartedBySchedule = gAudioLocalActive.streamingEnabled;
+            cloudClientObjectUpdate();
+        }
+        gScheduleWindowEnd = windowEnd;
+        nextCheck = windowEnd;
+        if (nextCheck - now < checkIntervalSeconds) {
+            checkIntervalSeconds = nextCheck - now;
+        }
+    } else {
+        if (gStreamingStartedBySchedule) {
+            gStreamingStartedBySchedule = false;
+            if (gAudioLocalActive.streamingEnabled) {
+                LOG(EVENT_AUDIO_SCHEDULE_WINDOW_END, 0);
+                printf("Streaming schedule window closed.\n");
+                stopStreaming(&gAudioLocalActive);
+                gAudioLocalPending.streamingEnabled = gAudioLocalActive.streamingEnabled;
+                cloudClientObjectUpdate();
+            }
+        }
+        nextCheck = getScheduleNextStart(now);
+        if ((nextCheck != 0) && (nextCheck - now < checkIntervalSeconds)) {
+            checkIntervalSeconds = nextCheck - now;
+        }
+    }
+
+    if (checkIntervalSeconds < 1) {
+        checkIntervalSeconds = 1;
+    }
+    gScheduleCheckEventId = eventQueueCallIn("schedule", checkIntervalSeconds * 1000, callback(&scheduleCheck));
+}
+
 /* ----------------------------------------------------------------
  * STATIC FUNCTIONS: HOOKS FOR AUDIO M2M C++ OBJECT
  * -------------------------------------------------------------- */
@@ -675,6 +899,22 @@ static void setAudioData(const IocM2mAudio::Audio *pM2mAudio)
     printf("  fixedGain %f.\n", pM2mAudio->fixedGain);
     printf("  audioCommunicationsMode %lld.\n", pM2mAudio->audioCommunicationsMode);
     printf("  audioServerUrl \"%s\".\n", pM2mAudio->audioServerUrl.c_str());
+    printf("  schedule \"%s\".\n", pM2mAudio->schedule.c_str());
+
+    if (strcmp(pM2mAudio->schedule.c_str(), pGetScheduleString()) != 0) {
+        if (setSchedule(pM2mAudio->schedule.c_str())) {
+            LOG(EVENT_SET_AUDIO_SCHEDULE, pM2mAudio->schedule.length());
+            // Re-evaluate the schedule against the new windows
+            if (gScheduleCheckEventId != 0) {
+                pGetEventQueue()->cancel(gScheduleCheckEventId);
+                gScheduleCheckEventId = eventQueueCall("schedule", callback(&scheduleCheck));
+            }
+        } else {
+            LOG(EVENT_AUDIO_SCHEDULE_INVALID, pM2mAudio->schedule.length());
+            printf("WARNING: schedule \"%s\" is not valid, keeping \"%s\".\n",
+                   pM2mAudio->schedule.c_str(), pGetScheduleString());
+        }
+    }
 
     gAudioLocalPending.streamingEnabled = pM2mAudio->streamingEnabled;
     gAudioLocalPending.fixedGain = (int) pM2mAudio->fixedGain;
@@ -691,10 +931,12 @@ static void setAudioData(const IocM2mAudio::Audio *pM2mAudio)
         // unless it is switched off and on again
         gAudioLocalActive = gAudioLocalPending;
         gAudioLocalPending.streamingEnabled = startStreaming(&gAudioLocalActive);
+        gStreamingStartedBySchedule = false;
     } else if (!pM2mAudio->streamingEnabled && streamingWasEnabled) {
         LOG(EVENT_SET_AUDIO_CONFIG_STREAMING_DISABLED, 0);
         stopStreaming(&gAudioLocalActive);
         gAudioLocalPending.streamingEnabled = gAudioLocalActive.streamingEnabled;
+        gStreamingStartedBySchedule = false;
     }
     // Call this to line up the Audio object, and potentially
     // any diagnostics from the streaming having been run,
@@ -718,6 +960,7 @@ static IocM2mAudio::Audio *pConvertAudioLocalToM2m (IocM2mAudio::Audio *pM2m, co
     pM2m->fixedGain = (float) pLocal->fixedGain;
     pM2m->audioCommunicationsMode = pLocal->socketMode;
     pM2m->audioServerUrl = pLocal->audioServerUrl;
+    pM2m->schedule = pGetScheduleString();
 
     return pM2m;
 }
@@ -738,6 +981,7 @@ IocM2mAudio *pInitAudio()
     gAudioLocalPending.socketMode = AUDIO_DEFAULT_COMMUNICATION_MODE;
     gAudioLocalPending.audioServerUrl = AUDIO_DEFAULT_SERVER_URL;
     gAudioLocalPending.sock.pTcpSock = NULL;
+    gAudioLocalPending.handshakeType = TLS_HANDSHAKE_NONE;
 
     // Add the object to the global collection
     gpM2mObject = new IocM2mAudio(setAudioData,
@@ -752,6 +996,12 @@ IocM2mAudio *pInitAudio()
 // Shut down audio.
 void deinitAudio()
 {
+    if (gScheduleCheckEventId != 0) {
+        pGetEventQueue()->cancel(gScheduleCheckEventId);
+        gScheduleCheckEventId = 0;
+    }
+    gStreamingStartedBySchedule = false;
+
     if (gAudioLocalActive.streamingEnabled) {
         flash();
         printf("Stopping streaming...\n");
@@ -763,6 +1013,14 @@ void deinitAudio()
     gpM2mObject = NULL;
 }
 
+// Start following the streaming schedule.
+void startAudioSchedule()
+{
+    if (gScheduleCheckEventId == 0) {
+        gScheduleCheckEventId = eventQueueCall("schedule", callback(&scheduleCheck));
+    }
+}
+
 // Determine if audio streaming is enabled.
 bool isAudioStreamingEnabled()
 {
@@ -770,10 +1028,22 @@ bool isAudioStreamingEnabled()
 }
 
 // Get the minimum number of URTP datagrams that are
-// free.
+// free, relative to the configured store size.
 int getUrtpDatagramsFreeMin()
 {
-    return gUrtp.getUrtpDatagramsFreeMin();
+    int freeMin = gUrtp.getUrtpDatagramsFreeMin() - (MAX_NUM_DATAGRAMS - gDatagramStoreSize);
+
+    if (freeMin < 0) {
+        freeMin = 0;
+    }
+
+    return freeMin;
+}
+
+// Get the number of URTP datagrams waiting to be sent.
+int getUrtpDatagramsQueued()
+{
+    return gUrtp.getUrtpDatagramsAvailable();
 }
 
 /* ----------------------------------------------------------------
@@ -782,12 +1052,13 @@ int getUrtpDatagramsFreeMin()
 
 // The consts of the definition of the object.
 const M2MObjectHelper::DefObject IocM2mAudio::_defObject =
-    {0, "32770", 5,
+    {0, "32770", 6,
         -1, RESOURCE_NUMBER_STREAMING_ENABLED, "boolean", M2MResourceBase::BOOLEAN, true, M2MBase::GET_PUT_ALLOWED, NULL,
         -1, RESOURCE_NUMBER_DURATION, "duration", M2MResourceBase::FLOAT, false, M2MBase::GET_PUT_ALLOWED, NULL,
         -1, RESOURCE_NUMBER_FIXED_GAIN, "level", M2MResourceBase::FLOAT, false, M2MBase::GET_PUT_ALLOWED, NULL,
         -1, RESOURCE_NUMBER_AUDIO_COMMUNICATIONS_MODE, "mode", M2MResourceBase::INTEGER, false, M2MBase::GET_PUT_ALLOWED, NULL,
-        -1, RESOURCE_NUMBER_AUDIO_SERVER_URL, "string", M2MResourceBase::STRING, false, M2MBase::GET_PUT_ALLOWED, NULL
+        -1, RESOURCE_NUMBER_AUDIO_SERVER_URL, "string", M2MResourceBase::STRING, false, M2MBase::GET_PUT_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_SCHEDULE, "string", M2MResourceBase::STRING, false, M2MBase::GET_PUT_ALLOWED, NULL
     };
 
 // Constructor.
@@ -812,6 +1083,7 @@ IocM2mAudio::IocM2mAudio(Callback<void(const Audio *)> pSetCallback,
     MBED_ASSERT(setResourceValue(pInitialValues->fixedGain,  RESOURCE_NUMBER_FIXED_GAIN));
     MBED_ASSERT(setResourceValue(pInitialValues->audioCommunicationsMode, RESOURCE_NUMBER_AUDIO_COMMUNICATIONS_MODE));
     MBED_ASSERT(setResourceValue(pInitialValues->audioServerUrl, RESOURCE_NUMBER_AUDIO_SERVER_URL));
+    MBED_ASSERT(setResourceValue(pInitialValues->schedule, RESOURCE_NUMBER_SCHEDULE));
 
     // Update the observable resources
     updateObservableResources();
@@ -836,13 +1108,15 @@ void IocM2mAudio::objectUpdated(const char *pResourceName)
     MBED_ASSERT(getResourceValue(&audio.fixedGain, RESOURCE_NUMBER_FIXED_GAIN));
     MBED_ASSERT(getResourceValue(&audio.audioCommunicationsMode, RESOURCE_NUMBER_AUDIO_COMMUNICATIONS_MODE));
     MBED_ASSERT(getResourceValue(&audio.audioServerUrl, RESOURCE_NUMBER_AUDIO_SERVER_URL));
+    MBED_ASSERT(getResourceValue(&audio.schedule, RESOURCE_NUMBER_SCHEDULE));
 
     printf("IocM2mAudio: new audio parameters are:\n");
     printf("  streamingEnabled %d.\n", audio.streamingEnabled);
     printf("  duration %f (-1 == no limit).\n", audio.duration);
     printf("  fixedGain %f (-1 == use automatic gain).\n", audio.fixedGain);
-    printf("  audioCommunicationsMode %lld (0 for UDP, 1 for TCP).\n", audio.audioCommunicationsMode);
+    printf("  audioCommunicationsMode %lld (0 for UDP, 1 for TCP, 2 for TLS, 3 for DTLS).\n", audio.audioCommunicationsMode);
     printf("  audioServerUrl \"%s\".\n", audio.audioServerUrl.c_str());
+    printf("  schedule \"%s\" (UTC).\n", audio.schedule.c_str());
 
     if (_pSetCallback) {
         _pSetCallback(&audio);
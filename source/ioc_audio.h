@@ -16,6 +16,7 @@
 #include "mbed.h"
 #include "MbedCloudClient.h"
 #include "m2m_object_helper.h"
+#include "ioc_tls.h"
 
 #ifndef _IOC_AUDIO_
 #define _IOC_AUDIO_
@@ -35,10 +36,11 @@ typedef struct {
     bool streamingEnabled;
     int duration;  ///< -1 = no limit.
     int fixedGain; ///< -1 = use automatic gain.
-    int socketMode; // Either COMMS_TCP or COMMS_UDP
+    int socketMode; // One of COMMS_TCP, COMMS_UDP, COMMS_TLS or COMMS_DTLS
     String audioServerUrl;
     SocketPointerUnion sock;
     SocketAddress server;
+    TlsHandshakeType handshakeType; ///< For COMMS_TLS/COMMS_DTLS only.
 } AudioLocal;
 
 /* ----------------------------------------------------------------
@@ -57,6 +59,8 @@ public:
     typedef enum {
         AUDIO_COMMUNICATIONS_MODE_UDP,
         AUDIO_COMMUNICATIONS_MODE_TCP,
+        AUDIO_COMMUNICATIONS_MODE_TLS,
+        AUDIO_COMMUNICATIONS_MODE_DTLS,
         MAX_NUM_AUDIO_COMMUNICATIONS_MODES
     } AudioCommunicationsMode;
 
@@ -74,6 +78,7 @@ public:
                                          /// an int64_t as it is an
                                          /// integer type).
         String audioServerUrl;
+        String schedule; ///< see setSchedule() in ioc_schedule.h.
     } Audio;
 
     /** Constructor.
@@ -136,6 +141,11 @@ protected:
      */
 #   define RESOURCE_NUMBER_AUDIO_SERVER_URL "5527"
 
+    /** The resource number for the streaming schedule,
+     * a Text resource.
+     */
+#   define RESOURCE_NUMBER_SCHEDULE "5750"
+
     /** Definition of this object.
      */
     static const DefObject _defObject;
@@ -165,6 +175,13 @@ IocM2mAudio *pInitAudio();
  */
 void deinitAudio();
 
+/** Start following the streaming schedule: streaming is
+ * started at the beginning of each window and stopped at
+ * the end of it.  The schedule is checked on the event queue,
+ * which must be running.
+ */
+void startAudioSchedule();
+
 /** Determing if audio streaming is enabled.
  * @return true if audio streaming is enabled else false.
  */
@@ -176,6 +193,11 @@ bool isAudioStreamingEnabled();
  */
 int getUrtpDatagramsFreeMin();
 
+/** Get the number of URTP datagrams waiting to be sent.
+ * @return the number of datagrams queued.
+ */
+int getUrtpDatagramsQueued();
+
 #endif // _IOC_AUDIO_
 
 // End of file
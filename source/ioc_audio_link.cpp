@@ -0,0 +1,254 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "us_ticker_api.h"
+#include "log.h"
+
+#include "ioc_network.h"
+#include "ioc_utils.h"
+#include "ioc_audio_link.h"
+
+/* This file implements estimation of the round trip time and
+ * goodput of the audio link, which are reported through the
+ * diagnostics object; nothing adapts the audio stream to them
+ * as yet.
+ *
+ * The mbed socket API gives no view of TCP acknowledgements,
+ * so the round trip time is measured with explicit probes: a
+ * small UDP datagram (an AudioLinkProbe) is sent once a second
+ * to AUDIO_LINK_PROBE_PORT on the audio server's host, where
+ * tools/audio_link_echo.py echoes it back.  This works whatever
+ * the audio transport.  Since each probe costs cellular data,
+ * none are sent, and the RTT remains unknown, unless the port
+ * is set in mbed_app.json.
+ * The echo is read on the event queue, so the RTT includes the
+ * event queue latency, which is normally small by comparison.
+ * RTT samples are smoothed as TCP does (RFC 6298).
+ *
+ * Goodput is the audio data actually sent each second, as
+ * counted by the send task, smoothed with the same gain as
+ * the RTT.  While the link has capacity to spare this will
+ * be the audio bit rate; when it does not it will be less.
+ */
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The probe socket and the address of the server.
+static UDPSocket *gpProbeSocket = NULL;
+static SocketAddress gProbeServer;
+
+// The event queue ID of the probe event.
+static int gProbeEventId = 0;
+
+// The sequence number of the last probe sent.
+static uint32_t gProbeSequence = 0;
+
+// Set while a read of the probe socket is queued.
+static volatile uint32_t gProbeReadPending = 0;
+
+// The smoothed RTT and RTT variation in microseconds,
+// -1 if not known.
+static volatile int gSmoothedRttUs = -1;
+static volatile int gRttVarUs = -1;
+
+// The smoothed goodput in bits/s, -1 if not known.
+static volatile int gSmoothedGoodputBitsS = -1;
+
+// Mutex to protect the probe socket.
+static Mutex gProbeMutex;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Add a sample of RTT.
+static void addRttSample(int rttUs)
+{
+    int smoothedRttUs = gSmoothedRttUs;
+    int rttVarUs = gRttVarUs;
+    int difference;
+
+    if (smoothedRttUs < 0) {
+        smoothedRttUs = rttUs;
+        rttVarUs = rttUs / 2;
+    } else {
+        difference = smoothedRttUs - rttUs;
+        if (difference < 0) {
+            difference = -difference;
+        }
+        rttVarUs = (rttVarUs * 3 + difference) / 4;
+        smoothedRttUs = (smoothedRttUs * 7 + rttUs) / 8;
+    }
+    gRttVarUs = rttVarUs;
+    gSmoothedRttUs = smoothedRttUs;
+
+    LOG(EVENT_AUDIO_LINK_RTT_MS, rttUs / 1000);
+}
+
+// Read any echoed probes from the probe socket; called on
+// the event queue.
+static void readProbes()
+{
+    AudioLinkProbe probe;
+    nsapi_size_or_error_t size;
+
+    gProbeReadPending = 0;
+    gProbeMutex.lock();
+    if (gpProbeSocket != NULL) {
+        while ((size = gpProbeSocket->recvfrom(NULL, &probe, sizeof (probe))) > 0) {
+            if ((size == sizeof (probe)) && (probe.magic == AUDIO_LINK_PROBE_MAGIC) &&
+                (gProbeSequence - probe.sequence < AUDIO_LINK_PROBE_MAX_AGE)) {
+                addRttSample(us_ticker_read() - probe.sentUs);
+            }
+        }
+    }
+    gProbeMutex.unlock();
+}
+
+// Called by the IP stack when something happens on the
+// probe socket: queue a read, if one is not already queued.
+static void probeSignal()
+{
+    uint32_t notPending = 0;
+
+    if (core_util_atomic_cas_u32(&gProbeReadPending, &notPending, 1)) {
+        if (eventQueueCall("link probe read", callback(&readProbes)) == 0) {
+            gProbeReadPending = 0;
+        }
+    }
+}
+
+// Send a probe; called on the event queue.
+static void sendProbe()
+{
+    AudioLinkProbe probe;
+    nsapi_size_or_error_t size;
+
+    gProbeMutex.lock();
+    if (gpProbeSocket != NULL) {
+        gProbeSequence++;
+        probe.magic = AUDIO_LINK_PROBE_MAGIC;
+        probe.sequence = gProbeSequence;
+        probe.sentUs = us_ticker_read();
+        size = gpProbeSocket->sendto(gProbeServer, &probe, sizeof (probe));
+        if (size != sizeof (probe)) {
+            LOG(EVENT_AUDIO_LINK_PROBE_SEND_FAILURE, size);
+        }
+    }
+    gProbeMutex.unlock();
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Start estimating.
+// Note: here be multiple return statements.
+bool startAudioLinkEstimator(const SocketAddress *pServer)
+{
+    nsapi_error_t nsapiError;
+
+    stopAudioLinkEstimator();
+    gSmoothedRttUs = -1;
+    gRttVarUs = -1;
+    gSmoothedGoodputBitsS = -1;
+
+    if ((AUDIO_LINK_PROBE_PORT == 0) || !isNetworkConnected()) {
+        return false;
+    }
+
+    gProbeMutex.lock();
+    gProbeServer = *pServer;
+    gProbeServer.set_port(AUDIO_LINK_PROBE_PORT);
+    gpProbeSocket = new UDPSocket();
+    nsapiError = gpProbeSocket->open(pGetNetworkInterface());
+    if (nsapiError != NSAPI_ERROR_OK) {
+        delete gpProbeSocket;
+        gpProbeSocket = NULL;
+        gProbeMutex.unlock();
+        LOG(EVENT_AUDIO_LINK_PROBE_START_FAILURE, nsapiError);
+        printf("Could not open UDP socket for audio link probes (error %d).\n", nsapiError);
+        return false;
+    }
+    gpProbeSocket->set_blocking(false);
+    gpProbeSocket->sigio(callback(&probeSignal));
+    gProbeMutex.unlock();
+
+    gProbeEventId = eventQueueCallEvery("link probe", AUDIO_LINK_PROBE_INTERVAL_MS,
+                                        callback(&sendProbe));
+    LOG(EVENT_AUDIO_LINK_PROBE_START, 0);
+
+    return true;
+}
+
+// Stop probing.
+void stopAudioLinkEstimator()
+{
+    if (gProbeEventId != 0) {
+        pGetEventQueue()->cancel(gProbeEventId);
+        gProbeEventId = 0;
+    }
+
+    gProbeMutex.lock();
+    if (gpProbeSocket != NULL) {
+        // No need to close() the socket,
+        // the destructor does that.
+        delete gpProbeSocket;
+        gpProbeSocket = NULL;
+        LOG(EVENT_AUDIO_LINK_PROBE_STOP, 0);
+    }
+    gProbeMutex.unlock();
+}
+
+// Add a sample of goodput.
+void addAudioLinkGoodputSample(unsigned int bitsPerSecond)
+{
+    int smoothedGoodputBitsS = gSmoothedGoodputBitsS;
+
+    if (smoothedGoodputBitsS < 0) {
+        smoothedGoodputBitsS = bitsPerSecond;
+    } else {
+        smoothedGoodputBitsS = (smoothedGoodputBitsS * 7 + (int) bitsPerSecond) / 8;
+    }
+    gSmoothedGoodputBitsS = smoothedGoodputBitsS;
+}
+
+// Get the smoothed RTT.
+int getAudioLinkRttMs()
+{
+    int smoothedRttUs = gSmoothedRttUs;
+
+    return smoothedRttUs < 0 ? -1 : smoothedRttUs / 1000;
+}
+
+// Get the RTT variation.
+int getAudioLinkRttVarMs()
+{
+    int rttVarUs = gRttVarUs;
+
+    return rttVarUs < 0 ? -1 : rttVarUs / 1000;
+}
+
+// Get the smoothed goodput.
+int getAudioLinkGoodputBitsS()
+{
+    return gSmoothedGoodputBitsS;
+}
+
+// End of file
@@ -0,0 +1,108 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+
+#ifndef _IOC_AUDIO_LINK_
+#define _IOC_AUDIO_LINK_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The UDP port, on the audio server's host, to which round
+// trip time probes are sent, 0 for none; probes cost data, so
+// they are only sent if an echo responder has been set up.
+#ifdef MBED_CONF_APP_AUDIO_LINK_PROBE_PORT
+# define AUDIO_LINK_PROBE_PORT MBED_CONF_APP_AUDIO_LINK_PROBE_PORT
+#else
+# define AUDIO_LINK_PROBE_PORT 0
+#endif
+
+// The interval between round trip time probes.
+#define AUDIO_LINK_PROBE_INTERVAL_MS 1000
+
+// The first word of a probe datagram, "IOCP".
+#define AUDIO_LINK_PROBE_MAGIC 0x494f4350
+
+// An echo is only accepted for one of this many most
+// recent probes.
+#define AUDIO_LINK_PROBE_MAX_AGE 16
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+/** A round trip time probe: sent as a UDP datagram to
+ * AUDIO_LINK_PROBE_PORT on the audio server's host, where an
+ * echo responder (tools/audio_link_echo.py) sends it back
+ * unchanged.  The contents are only interpreted here.
+ */
+typedef struct {
+    uint32_t magic;    ///< AUDIO_LINK_PROBE_MAGIC.
+    uint32_t sequence; ///< Incremented with each probe.
+    uint32_t sentUs;   ///< Microsecond ticker when sent.
+} AudioLinkProbe;
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Start estimating the round trip time and goodput of the
+ * audio link: the estimates are reset and, if
+ * AUDIO_LINK_PROBE_PORT is set, probes are sent to the audio
+ * server's host on the event queue, which must be running.
+ *
+ * @param pServer the address of the audio server.
+ * @return        true if probing was started, otherwise false;
+ *                the goodput is estimated regardless.
+ */
+bool startAudioLinkEstimator(const SocketAddress *pServer);
+
+/** Stop probing the audio link; the last estimates remain
+ * readable.
+ */
+void stopAudioLinkEstimator();
+
+/** Add a sample of goodput, i.e. the audio data sent
+ * successfully in the last second; may be called from
+ * interrupt context.
+ *
+ * @param bitsPerSecond the goodput over the last second.
+ */
+void addAudioLinkGoodputSample(unsigned int bitsPerSecond);
+
+/** Get the smoothed round trip time of the audio link.
+ *
+ * @return the smoothed RTT in milliseconds, -1 if not known.
+ */
+int getAudioLinkRttMs();
+
+/** Get the variation in the round trip time of the audio
+ * link.
+ *
+ * @return the RTT variation in milliseconds, -1 if not known.
+ */
+int getAudioLinkRttVarMs();
+
+/** Get the smoothed goodput of the audio link.
+ *
+ * @return the goodput in bits/s, -1 if not known.
+ */
+int getAudioLinkGoodputBitsS();
+
+#endif // _IOC_AUDIO_LINK_
+
+// End of file
@@ -26,6 +26,11 @@
 #include "ioc_config.h"
 #include "ioc_audio.h"
 #include "ioc_diagnostics.h"
+#include "ioc_history.h"
+#include "ioc_system_monitor.h"
+#include "ioc_energy.h"
+#include "ioc_network_stats.h"
+#include "ioc_trace.h"
 
 /* This file implements the Cloud Client functionality, bringing
  * together all of the application specific LWM2M objects and
@@ -53,6 +58,10 @@ typedef enum {
     IOC_M2M_CONFIG,
     IOC_M2M_AUDIO,
     IOC_M2M_DIAGNOSTICS,
+    IOC_M2M_HISTORY,
+    IOC_M2M_SYSTEM_MONITOR,
+    IOC_M2M_ENERGY,
+    IOC_M2M_NETWORK_STATS,
     MAX_NUM_IOC_M2M_OBJECTS
 } IocM2mObjectId;
 
@@ -64,6 +73,10 @@ typedef union {
     IocM2mConfig *pConfig;
     IocM2mAudio *pAudio;
     IocM2mDiagnostics *pDiagnostics;
+    IocM2mHistory *pHistory;
+    IocM2mSystemMonitor *pSystemMonitor;
+    IocM2mEnergy *pEnergy;
+    IocM2mNetworkStats *pNetworkStats;
     void* raw;
 } IocM2mObjectPointerUnion;
 
@@ -154,6 +167,30 @@ static void addObject(IocM2mObjectId id, void *pObject)
             gObjectList[id].updateObservableResources = Callback<void(void)>(gObjectList[id].object.pDiagnostics,
                                                                              &IocM2mDiagnostics::updateObservableResources);
             break;
+        case IOC_M2M_HISTORY:
+            gObjectList[id].object.pHistory = (IocM2mHistory *) pObject;
+            gpCloudClientDm->addObject(gObjectList[id].object.pHistory->getObject());
+            gObjectList[id].updateObservableResources = Callback<void(void)>(gObjectList[id].object.pHistory,
+                                                                             &IocM2mHistory::updateObservableResources);
+            break;
+        case IOC_M2M_SYSTEM_MONITOR:
+            gObjectList[id].object.pSystemMonitor = (IocM2mSystemMonitor *) pObject;
+            gpCloudClientDm->addObject(gObjectList[id].object.pSystemMonitor->getObject());
+            gObjectList[id].updateObservableResources = Callback<void(void)>(gObjectList[id].object.pSystemMonitor,
+                                                                             &IocM2mSystemMonitor::updateObservableResources);
+            break;
+        case IOC_M2M_ENERGY:
+            gObjectList[id].object.pEnergy = (IocM2mEnergy *) pObject;
+            gpCloudClientDm->addObject(gObjectList[id].object.pEnergy->getObject());
+            gObjectList[id].updateObservableResources = Callback<void(void)>(gObjectList[id].object.pEnergy,
+                                                                             &IocM2mEnergy::updateObservableResources);
+            break;
+        case IOC_M2M_NETWORK_STATS:
+            gObjectList[id].object.pNetworkStats = (IocM2mNetworkStats *) pObject;
+            gpCloudClientDm->addObject(gObjectList[id].object.pNetworkStats->getObject());
+            gObjectList[id].updateObservableResources = Callback<void(void)>(gObjectList[id].object.pNetworkStats,
+                                                                             &IocM2mNetworkStats::updateObservableResources);
+            break;
         default:
             printf("Unknown object ID (%d).\n", id);
             break;
@@ -185,6 +222,18 @@ static void removeObject(IocM2mObjectId id)
             case IOC_M2M_DIAGNOSTICS:
                 gObjectList[id].object.pDiagnostics = NULL;
                 break;
+            case IOC_M2M_HISTORY:
+                gObjectList[id].object.pHistory = NULL;
+                break;
+            case IOC_M2M_SYSTEM_MONITOR:
+                gObjectList[id].object.pSystemMonitor = NULL;
+                break;
+            case IOC_M2M_ENERGY:
+                gObjectList[id].object.pEnergy = NULL;
+                break;
+            case IOC_M2M_NETWORK_STATS:
+                gObjectList[id].object.pNetworkStats = NULL;
+                break;
             default:
                 printf("Unknown object ID (%d).\n", id);
                 break;
@@ -394,6 +443,10 @@ CloudClientDm *pInitCloudClientDm()
     addObject(IOC_M2M_CONFIG, (void *) pInitConfig());
     addObject(IOC_M2M_AUDIO, (void *) pInitAudio());
     addObject(IOC_M2M_DIAGNOSTICS, (void *) pInitDiagnostics());
+    addObject(IOC_M2M_HISTORY, (void *) pInitHistory());
+    addObject(IOC_M2M_SYSTEM_MONITOR, (void *) pInitSystemMonitor());
+    addObject(IOC_M2M_ENERGY, (void *) pInitEnergy());
+    addObject(IOC_M2M_NETWORK_STATS, (void *) pInitNetworkStats());
     
     if (configIsGnssEnabled()) {
         startGnss();
@@ -464,6 +517,10 @@ void deinitCloudClientDm()
     deinitTemperature();
     deinitConfig();
     deinitDiagnostics();
+    deinitHistory();
+    deinitSystemMonitor();
+    deinitEnergy();
+    deinitNetworkStats();
 
     for (unsigned int x = 0; x < sizeof (gObjectList) / sizeof(gObjectList[0]); x++) {
         removeObject((IocM2mObjectId) x);
@@ -502,7 +559,9 @@ void cloudClientObjectUpdate()
     int32_t batteryLevelPercent;
     CloudClientDm::BatteryStatus batteryStatus = CloudClientDm::BATTERY_STATUS_UNKNOWN;
     char fault;
+    TraceSpan span;
 
+    traceSpanStart(&span);
     // First do the observable resources for the Device object
     LOG(EVENT_LWM2M_OBJECT_UPDATE, 0);
     flash();
@@ -594,6 +653,8 @@ void cloudClientObjectUpdate()
             gObjectList[x].updateObservableResources();
         }
     }
+
+    traceSpanEnd(&span, TRACE_SPAN_CLOUD_CLIENT_OBJECT_UPDATE);
 }
 
 // End of file
@@ -18,6 +18,7 @@
 #include "MbedCloudClient.h"
 #include "m2m_object_helper.h"
 #include "low_power.h"
+#include "urtp.h" // for MAX_NUM_DATAGRAMS
 #include "log.h"
 
 #include "ioc_cloud_client_dm.h"
@@ -25,6 +26,7 @@
 #include "ioc_utils.h"
 #include "ioc_dynamics.h"
 #include "ioc_location.h"
+#include "ioc_logging.h"
 
 /* This file implements the LWM2M configuration object.
  */
@@ -40,6 +42,8 @@
 #define CONFIG_DEFAULT_READY_WAKE_UP_TICK_COUNTER_PERIOD_2  600
 #define CONFIG_DEFAULT_READY_WAKE_UP_TICK_COUNTER_MODULO    60
 #define CONFIG_DEFAULT_GNSS_ENABLE                          true
+#define CONFIG_DEFAULT_AUDIO_DATAGRAM_STORE_SIZE            MAX_NUM_DATAGRAMS
+#define CONFIG_DEFAULT_LOG_UPLOAD_BUDGET_BYTES              0
 
 /* ----------------------------------------------------------------
  * VARIABLES
@@ -68,6 +72,9 @@ static void setConfigData(const IocM2mConfig::Config *pData)
     printf("  readyWakeUpTickCounterPeriod2 %f.\n", pData->readyWakeUpTickCounterPeriod2);
     printf("  readyWakeUpTickCounterModulo %lld.\n", pData->readyWakeUpTickCounterModulo);
     printf("  GNSS enable %d.\n", pData->gnssEnable);
+    printf("  audioDatagramStoreSize %lld.\n", pData->audioDatagramStoreSize);
+    printf("  logUploadBudgetBytes %lld.\n", pData->logUploadBudgetBytes);
+    printf("  logFilter \"%s\".\n", pData->logFilter.c_str());
 
     /// Handle GNSS configuration changes
     if (!isGnssOn() && pData->gnssEnable) {
@@ -76,6 +83,16 @@ static void setConfigData(const IocM2mConfig::Config *pData)
         setPendingGnssStop(true);
     }
 
+    if (strcmp(pData->logFilter.c_str(), pGetLogFilterString()) != 0) {
+        if (setLogFilter(pData->logFilter.c_str())) {
+            LOG(EVENT_SET_LOG_FILTER, pData->logFilter.length());
+        } else {
+            LOG(EVENT_LOG_FILTER_INVALID, pData->logFilter.length());
+            printf("WARNING: log filter \"%s\" is not valid, keeping \"%s\".\n",
+                   pData->logFilter.c_str(), pGetLogFilterString());
+        }
+    }
+
     // TODO act on the rest of it
 
     gConfigLocal.initWakeUpTickCounterPeriod = (time_t) pData->initWakeUpTickCounterPeriod;
@@ -84,11 +101,24 @@ static void setConfigData(const IocM2mConfig::Config *pData)
     gConfigLocal.readyWakeUpTickCounterPeriod2 = (time_t) pData->readyWakeUpTickCounterPeriod2;
     gConfigLocal.readyWakeUpTickCounterModulo = pData->readyWakeUpTickCounterModulo;
     gConfigLocal.gnssEnable = pData->gnssEnable;
+    // The datagram store can't be bigger than the memory reserved for it
+    gConfigLocal.audioDatagramStoreSize = pData->audioDatagramStoreSize;
+    if (gConfigLocal.audioDatagramStoreSize > MAX_NUM_DATAGRAMS) {
+        gConfigLocal.audioDatagramStoreSize = MAX_NUM_DATAGRAMS;
+    } else if (gConfigLocal.audioDatagramStoreSize < 1) {
+        gConfigLocal.audioDatagramStoreSize = 1;
+    }
+    gConfigLocal.logUploadBudgetBytes = pData->logUploadBudgetBytes;
+    if (gConfigLocal.logUploadBudgetBytes < 0) {
+        gConfigLocal.logUploadBudgetBytes = 0;
+    }
     LOG(EVENT_SET_INIT_WAKE_UP_TICK_COUNTER_PERIOD, gConfigLocal.initWakeUpTickCounterPeriod);
     LOG(EVENT_SET_INIT_WAKE_UP_TICK_COUNTER_MODULO, gConfigLocal.initWakeUpTickCounterModulo);
     LOG(EVENT_SET_READY_WAKE_UP_TICK_COUNTER_PERIOD1, gConfigLocal.readyWakeUpTickCounterPeriod1);
     LOG(EVENT_SET_READY_WAKE_UP_TICK_COUNTER_PERIOD2, gConfigLocal.readyWakeUpTickCounterPeriod2);
     LOG(EVENT_SET_READY_WAKE_UP_TICK_COUNTER_MODULO, gConfigLocal.readyWakeUpTickCounterModulo);
+    LOG(EVENT_SET_AUDIO_DATAGRAM_STORE_SIZE, gConfigLocal.audioDatagramStoreSize);
+    LOG(EVENT_SET_LOG_UPLOAD_BUDGET_BYTES, gConfigLocal.logUploadBudgetBytes);
 }
 
 // Convert a local config data structure to the IocM2mConfig one.
@@ -100,6 +130,9 @@ static IocM2mConfig::Config *convertConfigLocalToM2m (IocM2mConfig::Config *pM2m
     pM2m->readyWakeUpTickCounterPeriod2 = (float) pLocal->readyWakeUpTickCounterPeriod2;
     pM2m->readyWakeUpTickCounterModulo = pLocal->readyWakeUpTickCounterModulo;
     pM2m->gnssEnable = pLocal->gnssEnable;
+    pM2m->audioDatagramStoreSize = pLocal->audioDatagramStoreSize;
+    pM2m->logUploadBudgetBytes = pLocal->logUploadBudgetBytes;
+    pM2m->logFilter = pGetLogFilterString();
 
     return pM2m;
 }
@@ -117,6 +150,8 @@ void resetConfig()
     gConfigLocal.readyWakeUpTickCounterPeriod2 = CONFIG_DEFAULT_READY_WAKE_UP_TICK_COUNTER_PERIOD_2;
     gConfigLocal.readyWakeUpTickCounterModulo = CONFIG_DEFAULT_READY_WAKE_UP_TICK_COUNTER_MODULO;
     gConfigLocal.gnssEnable = CONFIG_DEFAULT_GNSS_ENABLE;
+    gConfigLocal.audioDatagramStoreSize = CONFIG_DEFAULT_AUDIO_DATAGRAM_STORE_SIZE;
+    gConfigLocal.logUploadBudgetBytes = CONFIG_DEFAULT_LOG_UPLOAD_BUDGET_BYTES;
 }
 
 // Initialise the configuration object.
@@ -175,6 +210,32 @@ bool configIsGnssEnabled()
     return gConfigLocal.gnssEnable;
 }
 
+// Get the number of URTP datagrams that audio streaming may queue.
+int getAudioDatagramStoreSize()
+{
+    int storeSize = (int) gConfigLocal.audioDatagramStoreSize;
+
+    // Back-up SRAM may hold a value from a previous build
+    if ((storeSize < 1) || (storeSize > MAX_NUM_DATAGRAMS)) {
+        storeSize = MAX_NUM_DATAGRAMS;
+    }
+
+    return storeSize;
+}
+
+// Get the number of bytes of log file that may be uploaded per budget period.
+int getLogUploadBudgetBytes()
+{
+    int budgetBytes = (int) gConfigLocal.logUploadBudgetBytes;
+
+    // Back-up SRAM may hold a value from a previous build
+    if (budgetBytes < 0) {
+        budgetBytes = CONFIG_DEFAULT_LOG_UPLOAD_BUDGET_BYTES;
+    }
+
+    return budgetBytes;
+}
+
 /* ----------------------------------------------------------------
  * PUBLIC: CONFIG M2M C++ OBJECT
  * -------------------------------------------------------------- */
@@ -183,13 +244,16 @@ bool configIsGnssEnabled()
  * initialisation be done in the class definition).
  */
 const M2MObjectHelper::DefObject IocM2mConfig::_defObject =
-    {0, "32769", 6,
+    {0, "32769", 9,
         RESOURCE_INSTANCE_INIT_WAKE_UP, RESOURCE_NUMBER_INIT_WAKE_UP_TICK_COUNTER_PERIOD, "seconds", M2MResourceBase::FLOAT, false, M2MBase::GET_PUT_ALLOWED, NULL,
         RESOURCE_INSTANCE_INIT_WAKE_UP, RESOURCE_NUMBER_INIT_WAKE_UP_TICK_COUNTER_MODULO, "modulo", M2MResourceBase::INTEGER, false, M2MBase::GET_PUT_ALLOWED, NULL,
         RESOURCE_INSTANCE_READY_WAKE_UP_TICK_COUNTER_PERIOD_1, RESOURCE_NUMBER_READY_WAKE_UP_TICK_COUNTER_PERIOD_1, "seconds", M2MResourceBase::FLOAT, false, M2MBase::GET_PUT_ALLOWED, NULL,
         RESOURCE_INSTANCE_READY_WAKE_UP_TICK_COUNTER_PERIOD_2, RESOURCE_NUMBER_READY_WAKE_UP_TICK_COUNTER_PERIOD_2, "seconds", M2MResourceBase::FLOAT, false, M2MBase::GET_PUT_ALLOWED, NULL,
         RESOURCE_INSTANCE_READY_WAKE_UP_TICK_COUNTER_MODULO, RESOURCE_NUMBER_READY_WAKE_UP_TICK_COUNTER_MODULO, "modulo", M2MResourceBase::INTEGER, false, M2MBase::GET_PUT_ALLOWED, NULL,
-        -1, RESOURCE_NUMBER_GNSS_ENABLE, "boolean", M2MResourceBase::BOOLEAN, false, M2MBase::GET_PUT_ALLOWED, NULL
+        -1, RESOURCE_NUMBER_GNSS_ENABLE, "boolean", M2MResourceBase::BOOLEAN, false, M2MBase::GET_PUT_ALLOWED, NULL,
+        RESOURCE_INSTANCE_AUDIO_DATAGRAM_STORE_SIZE, RESOURCE_NUMBER_AUDIO_DATAGRAM_STORE_SIZE, "counter", M2MResourceBase::INTEGER, false, M2MBase::GET_PUT_ALLOWED, NULL,
+        RESOURCE_INSTANCE_LOG_UPLOAD_BUDGET_BYTES, RESOURCE_NUMBER_LOG_UPLOAD_BUDGET_BYTES, "bytes", M2MResourceBase::INTEGER, false, M2MBase::GET_PUT_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_LOG_FILTER, "string", M2MResourceBase::STRING, false, M2MBase::GET_PUT_ALLOWED, NULL
     };
 
 // Constructor.
@@ -218,6 +282,11 @@ IocM2mConfig::IocM2mConfig(Callback<void(const Config *)> setCallback,
     MBED_ASSERT(setResourceValue(initialValues->readyWakeUpTickCounterModulo,
                                  RESOURCE_NUMBER_READY_WAKE_UP_TICK_COUNTER_MODULO, RESOURCE_INSTANCE_READY_WAKE_UP_TICK_COUNTER_MODULO));
     MBED_ASSERT(setResourceValue(initialValues->gnssEnable, RESOURCE_NUMBER_GNSS_ENABLE));
+    MBED_ASSERT(setResourceValue(initialValues->audioDatagramStoreSize,
+                                 RESOURCE_NUMBER_AUDIO_DATAGRAM_STORE_SIZE, RESOURCE_INSTANCE_AUDIO_DATAGRAM_STORE_SIZE));
+    MBED_ASSERT(setResourceValue(initialValues->logUploadBudgetBytes,
+                                 RESOURCE_NUMBER_LOG_UPLOAD_BUDGET_BYTES, RESOURCE_INSTANCE_LOG_UPLOAD_BUDGET_BYTES));
+    MBED_ASSERT(setResourceValue(initialValues->logFilter, RESOURCE_NUMBER_LOG_FILTER));
 
     printf("IocM2mConfig: object initialised.\n");
 }
@@ -246,6 +315,11 @@ void IocM2mConfig::objectUpdated(const char *resourceName)
                                  RESOURCE_NUMBER_READY_WAKE_UP_TICK_COUNTER_MODULO, RESOURCE_INSTANCE_READY_WAKE_UP_TICK_COUNTER_MODULO));
     MBED_ASSERT(getResourceValue(&config.gnssEnable,
                                  RESOURCE_NUMBER_GNSS_ENABLE));
+    MBED_ASSERT(getResourceValue(&config.audioDatagramStoreSize,
+                                 RESOURCE_NUMBER_AUDIO_DATAGRAM_STORE_SIZE, RESOURCE_INSTANCE_AUDIO_DATAGRAM_STORE_SIZE));
+    MBED_ASSERT(getResourceValue(&config.logUploadBudgetBytes,
+                                 RESOURCE_NUMBER_LOG_UPLOAD_BUDGET_BYTES, RESOURCE_INSTANCE_LOG_UPLOAD_BUDGET_BYTES));
+    MBED_ASSERT(getResourceValue(&config.logFilter, RESOURCE_NUMBER_LOG_FILTER));
 
     printf("IocM2mConfig: new config is:\n");
     printf("  initWakeUpTickCounterPeriod %f.\n", config.initWakeUpTickCounterPeriod);
@@ -254,6 +328,9 @@ void IocM2mConfig::objectUpdated(const char *resourceName)
     printf("  readyWakeUpTickCounterPeriod2 %f.\n", config.readyWakeUpTickCounterPeriod2);
     printf("  readyWakeUpTickCounterModulo %lld.\n", config.readyWakeUpTickCounterModulo);
     printf("  GNSS enable %d.\n", config.gnssEnable);
+    printf("  audioDatagramStoreSize %lld.\n", config.audioDatagramStoreSize);
+    printf("  logUploadBudgetBytes %lld.\n", config.logUploadBudgetBytes);
+    printf("  logFilter \"%s\".\n", config.logFilter.c_str());
 
     if (_setCallback) {
         _setCallback(&config);
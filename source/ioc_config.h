@@ -32,6 +32,8 @@ typedef struct {
     time_t readyWakeUpTickCounterPeriod2;
     int64_t readyWakeUpTickCounterModulo;
     bool gnssEnable;
+    int64_t audioDatagramStoreSize;
+    int64_t logUploadBudgetBytes;
 } ConfigLocal;
 
 /* ----------------------------------------------------------------
@@ -58,6 +60,9 @@ public:
         float readyWakeUpTickCounterPeriod2;
         int64_t readyWakeUpTickCounterModulo;
         bool gnssEnable;
+        int64_t audioDatagramStoreSize;
+        int64_t logUploadBudgetBytes;
+        String logFilter; ///< see setLogFilter() in ioc_logging.h.
     } Config;
 
     /** Constructor.
@@ -129,6 +134,29 @@ protected:
      */
 #   define RESOURCE_NUMBER_GNSS_ENABLE "5850"
 
+    /** The resource instance for audioDatagramStoreSize.
+     */
+#   define RESOURCE_INSTANCE_AUDIO_DATAGRAM_STORE_SIZE 2
+
+    /** The resource number for audioDatagramStoreSize,
+     * a Counter resource.
+     */
+#   define RESOURCE_NUMBER_AUDIO_DATAGRAM_STORE_SIZE "5534"
+
+    /** The resource instance for logUploadBudgetBytes.
+     */
+#   define RESOURCE_INSTANCE_LOG_UPLOAD_BUDGET_BYTES 3
+
+    /** The resource number for logUploadBudgetBytes,
+     * a Counter resource.
+     */
+#   define RESOURCE_NUMBER_LOG_UPLOAD_BUDGET_BYTES "5534"
+
+    /** The resource number for logFilter, a Text
+     * resource.
+     */
+#   define RESOURCE_NUMBER_LOG_FILTER "5750"
+
     /** Definition of this object.
      */
     static const DefObject _defObject;
@@ -185,6 +213,19 @@ int64_t getReadyWakeUpTickCounterModulo();
  */
 bool configIsGnssEnabled();
 
+/** Get the number of URTP datagrams that audio streaming
+ * may queue, which is applied each time streaming starts.
+ * @return the datagram store size, between 1 and
+ *         MAX_NUM_DATAGRAMS.
+ */
+int getAudioDatagramStoreSize();
+
+/** Get the number of bytes of log file that may be uploaded
+ * in each log upload budget period (see ioc_log_upload.h).
+ * @return the byte budget, 0 (the default) if there is no limit.
+ */
+int getLogUploadBudgetBytes();
+
 #endif // _IOC_CONFIG_
 
 // End of file
@@ -15,17 +15,27 @@
  */
 
 #include "mbed.h"
+#include "us_ticker_api.h"
 #include "MbedCloudClient.h"
 #include "m2m_object_helper.h"
 #include "urtp.h" // for BLOCK_DURATION_MS
+#include "low_power.h"
 #include "log.h"
 
 #include "ioc_cloud_client_dm.h"
 #include "ioc_audio.h"
+#include "ioc_audio_link.h"
+#include "ioc_log_ring.h"
 #include "ioc_utils.h"
 #include "ioc_diagnostics.h"
 
 /* This file implements the LWM2M diagnostics object.
+ *
+ * The diagnostics are reset each time audio streaming starts and
+ * are lost in standby, so they are also added, periodically and
+ * before sleeping, to lifetime diagnostics which are kept in backup
+ * SRAM, protected by a CRC, and reported to the server when next
+ * registered.
  */
 
 /* ----------------------------------------------------------------
@@ -44,11 +54,244 @@
  * VARIABLES
  * -------------------------------------------------------------- */
 
+// The diagnostics data, which must only be modified
+// using the core_util_atomic_*() functions.
 static DiagnosticsLocal gDiagnostics = {0};
+
+// The worst audio datagram queue depth since it was last
+// taken, which is not part of gDiagnostics as it is not
+// reset with it.
+static volatile uint32_t gAudioDatagramQueueMaxInterval = 0;
+
+// Incremented at the start and at the end of resetDiagnostics()
+// so that a snapshot can tell that it has overlapped a reset.
+static volatile uint32_t gDiagnosticsResetCount = 0;
+
+// The percentiles of audio datagram send duration that
+// are reported, in parts per thousand.
+static const unsigned int gSendDurationPercentilePerMille[] = {500, 900, 990, 999};
+static Timer gAudioDatagramOverflowTimer;
 static Ticker gSecondTicker;
 static int gStartTime = 0;
 static IocM2mDiagnostics *gpM2mObject = NULL;
 
+// The number of sources (URTP itself and the datagram store
+// limit) currently reporting an overflow: an episode runs from
+// the first starting to the last stopping, so that overlapping
+// reports are counted and timed once.
+static int gAudioDatagramOverflowNesting = 0;
+
+// The lifetime diagnostics.
+BACKUP_SRAM
+static DiagnosticsLifetime gDiagnosticsLifetime;
+
+// The diagnostics values when they were last added to
+// gDiagnosticsLifetime, the microsecond ticker at that
+// time and the part-seconds and part-kbytes left over.
+static DiagnosticsLocal gDiagnosticsSaved = {0};
+static uint32_t gDiagnosticsSavedTickerUs = 0;
+static uint32_t gDiagnosticsSavedRemainderUs = 0;
+static uint32_t gDiagnosticsSavedRemainderBytes = 0;
+
+// The event queue ID of the lifetime diagnostics save event.
+static int gDiagnosticsSaveEventId = 0;
+
+// Mutex to protect the above.
+static Mutex gDiagnosticsLifetimeMutex;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: MISC
+ * -------------------------------------------------------------- */
+
+// Atomically increase a diagnostics value to a new maximum,
+// returning true if it was increased.
+static bool atomicMax(volatile uint32_t *pValue, uint32_t num)
+{
+    uint32_t current = *pValue;
+
+    while (num > current) {
+        if (core_util_atomic_cas_u32(pValue, &current, num)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Take a snapshot of the diagnostics data: each word is read
+// once, which is atomic, and the copy is repeated if a reset
+// happened part way through, so the send path never waits.
+static DiagnosticsLocal *pGetDiagnosticsSnapshot(DiagnosticsLocal *pSnapshot)
+{
+    const volatile uint32_t *pSrc = (const volatile uint32_t *) &gDiagnostics;
+    uint32_t *pDst = (uint32_t *) pSnapshot;
+    uint32_t resetCount;
+
+    MBED_STATIC_ASSERT(sizeof (DiagnosticsLocal) % sizeof (uint32_t) == 0,
+                       "DiagnosticsLocal must be made of 32 bit words");
+    do {
+        resetCount = gDiagnosticsResetCount;
+        for (unsigned int x = 0; x < sizeof (DiagnosticsLocal) / sizeof (uint32_t); x++) {
+            pDst[x] = pSrc[x];
+        }
+    } while ((resetCount & 1) || (resetCount != gDiagnosticsResetCount));
+
+    return pSnapshot;
+}
+
+// Write the audio datagram queue histogram, as seconds spent
+// in each bucket, comma separated, into a buffer.
+static char *pAudioDatagramQueueHistogramString(const DiagnosticsLocal *pDiagnostics,
+                                                char *pBuf, int lenBuf)
+{
+    int x = 0;
+
+    *pBuf = 0;
+    for (unsigned int y = 0; (y < sizeof (pDiagnostics->audioDatagramQueueHistogram) /
+                                  sizeof (pDiagnostics->audioDatagramQueueHistogram[0])) &&
+                             (x < lenBuf); y++) {
+        x += snprintf(pBuf + x, lenBuf - x, "%s%u", y > 0 ? "," : "",
+                      (unsigned int) (((uint64_t) pDiagnostics->audioDatagramQueueHistogram[y] *
+                                       BLOCK_DURATION_MS) / 1000));
+    }
+
+    return pBuf;
+}
+
+// Get the audio datagram send duration histogram bucket
+// for a duration.
+static int sendDurationBucket(unsigned int durationUs)
+{
+    int msb;
+    int bucket = durationUs;
+
+    if (durationUs >= AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS) {
+        msb = 31 - __CLZ(durationUs);
+        if (msb > AUDIO_SEND_DURATION_HISTOGRAM_MAX_LOG2) {
+            bucket = AUDIO_SEND_DURATION_HISTOGRAM_NUM_BUCKETS - 1;
+        } else {
+            bucket = (msb - AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS_LOG2 + 1) *
+                     AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS +
+                     ((durationUs >> (msb - AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS_LOG2)) &
+                      (AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS - 1));
+        }
+    }
+
+    return bucket;
+}
+
+// Get the largest duration that falls into an audio datagram
+// send duration histogram bucket.
+static unsigned int sendDurationBucketMax(int bucket)
+{
+    int group = bucket / AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS;
+    int shift;
+    unsigned int durationUs = bucket;
+
+    if (group > 0) {
+        shift = group - 1;
+        durationUs = (((AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS +
+                        (bucket % AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS)) + 1) << shift) - 1;
+    }
+
+    return durationUs;
+}
+
+// Work out the audio datagram send duration percentiles, in
+// microseconds, in a single pass of the histogram; this is
+// done on the event thread, when the diagnostics object is
+// updated, so that the send task need only increment a bucket.
+static void getSendDurationPercentiles(const DiagnosticsLocal *pDiagnostics,
+                                       unsigned int *pPercentileUs)
+{
+    uint64_t total = 0;
+    uint64_t rank[AUDIO_SEND_DURATION_NUM_PERCENTILES];
+    uint64_t count = 0;
+    int y = 0;
+
+    for (int x = 0; x < AUDIO_SEND_DURATION_HISTOGRAM_NUM_BUCKETS; x++) {
+        total += pDiagnostics->audioDatagramSendDurationHistogram[x];
+    }
+    for (y = 0; y < AUDIO_SEND_DURATION_NUM_PERCENTILES; y++) {
+        // The rank, counting from 1, of the sample at this percentile
+        rank[y] = (total * gSendDurationPercentilePerMille[y] + 999) / 1000;
+        if (rank[y] == 0) {
+            rank[y] = 1;
+        }
+        pPercentileUs[y] = 0;
+    }
+
+    y = 0;
+    if (total > 0) {
+        for (int x = 0; (x < AUDIO_SEND_DURATION_HISTOGRAM_NUM_BUCKETS) &&
+                        (y < AUDIO_SEND_DURATION_NUM_PERCENTILES); x++) {
+            count += pDiagnostics->audioDatagramSendDurationHistogram[x];
+            while ((y < AUDIO_SEND_DURATION_NUM_PERCENTILES) && (count >= rank[y])) {
+                pPercentileUs[y] = sendDurationBucketMax(x);
+                y++;
+            }
+        }
+    }
+}
+
+// Return the CRC that the lifetime diagnostics should have.
+static uint32_t diagnosticsLifetimeCrc()
+{
+    return crc32(&gDiagnosticsLifetime, sizeof (gDiagnosticsLifetime) -
+                                        sizeof (gDiagnosticsLifetime.crc));
+}
+
+// Add the diagnostics since they were last saved to the
+// lifetime diagnostics; gDiagnosticsLifetimeMutex must be
+// locked.
+static void saveDiagnosticsLifetimeLocked()
+{
+    DiagnosticsLocal *pDiagnostics = pGetDiagnosticsSnapshot(new DiagnosticsLocal);
+    uint32_t tickerUs = us_ticker_read();
+
+    gDiagnosticsSavedRemainderUs += tickerUs - gDiagnosticsSavedTickerUs;
+    gDiagnosticsLifetime.awakeSeconds += gDiagnosticsSavedRemainderUs / 1000000;
+    gDiagnosticsSavedRemainderUs %= 1000000;
+    gDiagnosticsSavedTickerUs = tickerUs;
+
+    gDiagnosticsLifetime.numAudioDatagrams += pDiagnostics->numAudioDatagrams -
+                                              gDiagnosticsSaved.numAudioDatagrams;
+    gDiagnosticsLifetime.numAudioSendFailures += pDiagnostics->numAudioSendFailures -
+                                                 gDiagnosticsSaved.numAudioSendFailures;
+    gDiagnosticsLifetime.numAudioDatagramsSendTookTooLong += pDiagnostics->numAudioDatagramsSendTookTooLong -
+                                                             gDiagnosticsSaved.numAudioDatagramsSendTookTooLong;
+    gDiagnosticsSavedRemainderBytes += pDiagnostics->numAudioBytesSent - gDiagnosticsSaved.numAudioBytesSent;
+    gDiagnosticsLifetime.numAudioKBytesSent += gDiagnosticsSavedRemainderBytes / 1024;
+    gDiagnosticsSavedRemainderBytes %= 1024;
+    gDiagnosticsLifetime.numAudioDatagramOverflowEpisodes += pDiagnostics->numAudioDatagramOverflowEpisodes -
+                                                             gDiagnosticsSaved.numAudioDatagramOverflowEpisodes;
+    gDiagnosticsLifetime.numAudioDatagramsOverflowed += pDiagnostics->numAudioDatagramsOverflowed -
+                                                        gDiagnosticsSaved.numAudioDatagramsOverflowed;
+    if (pDiagnostics->worstCaseAudioDatagramSendDuration > gDiagnosticsLifetime.worstCaseAudioDatagramSendDuration) {
+        gDiagnosticsLifetime.worstCaseAudioDatagramSendDuration = pDiagnostics->worstCaseAudioDatagramSendDuration;
+    }
+    gDiagnosticsLifetime.crc = diagnosticsLifetimeCrc();
+
+    memcpy(&gDiagnosticsSaved, pDiagnostics, sizeof (gDiagnosticsSaved));
+    delete pDiagnostics;
+}
+
+// Write the lifetime diagnostics into a buffer, comma separated,
+// in the order of the fields of DiagnosticsLifetime.
+static char *pDiagnosticsLifetimeString(char *pBuf, int lenBuf)
+{
+    const uint32_t *pValue = (const uint32_t *) &gDiagnosticsLifetime;
+    int x = 0;
+
+    *pBuf = 0;
+    for (unsigned int y = 0; (y < (sizeof (gDiagnosticsLifetime) - sizeof (gDiagnosticsLifetime.crc)) /
+                                  sizeof (uint32_t)) && (x < lenBuf); y++) {
+        x += snprintf(pBuf + x, lenBuf - x, "%s%u", y > 0 ? "," : "", (unsigned int) *(pValue + y));
+    }
+
+    return pBuf;
+}
+
 /* ----------------------------------------------------------------
  * STATIC FUNCTIONS: HOOK FOR DIAGNOSTICS M2M C++ OBJECT
  * -------------------------------------------------------------- */
@@ -56,19 +299,45 @@ static IocM2mDiagnostics *gpM2mObject = NULL;
 // Callback that gets diagnostic data for the IocM2mDiagnostics object.
 static bool getDiagnosticsData(IocM2mDiagnostics::Diagnostics *pData)
 {
+    char buf[AUDIO_DATAGRAM_QUEUE_HISTOGRAM_MAX_LEN_STRING];
+    unsigned int percentileUs[AUDIO_SEND_DURATION_NUM_PERCENTILES];
+    DiagnosticsLocal *pDiagnostics = pGetDiagnosticsSnapshot(new DiagnosticsLocal);
+    char *pBuf;
+
     if (gStartTime > 0) {
         pData->upTime = time(NULL) - gStartTime;
     } else {
         pData->upTime = 0;
     }
     pData->resetReason = getResetReason();
-    pData->worstCaseSendDuration = (float) gDiagnostics.worstCaseAudioDatagramSendDuration / 1000000;
-    pData->averageSendDuration = (float) (gDiagnostics.averageAudioDatagramSendDuration /
-                                          gDiagnostics.numAudioDatagrams) / 1000000;
+    getSendDurationPercentiles(pDiagnostics, percentileUs);
+    for (int x = 0; x < AUDIO_SEND_DURATION_NUM_PERCENTILES; x++) {
+        pData->sendDurationPercentile[x] = (float) percentileUs[x] / 1000000;
+    }
     pData->minNumDatagramsFree = getUrtpDatagramsFreeMin();
-    pData->numSendFailures = gDiagnostics.numAudioSendFailures;
-    pData->percentageSendsTooLong = (int64_t) gDiagnostics.numAudioDatagramsSendTookTooLong * 100 /
-                                              gDiagnostics.numAudioDatagrams;
+    pData->numSendFailures = pDiagnostics->numAudioSendFailures;
+    pData->percentageSendsTooLong = 0;
+    if (pDiagnostics->numAudioDatagrams > 0) {
+        pData->percentageSendsTooLong = (int64_t) pDiagnostics->numAudioDatagramsSendTookTooLong * 100 /
+                                                  pDiagnostics->numAudioDatagrams;
+    }
+    pData->datagramQueueHistogram = pAudioDatagramQueueHistogramString(pDiagnostics, buf, sizeof (buf));
+    pData->numDatagramOverflowEpisodes = pDiagnostics->numAudioDatagramOverflowEpisodes;
+    pData->datagramOverflowDuration = (float) pDiagnostics->audioDatagramOverflowDurationMs / 1000;
+    pBuf = new char[HEAP_TAG_MAX_LEN_STRING];
+    pData->heapUse = pHeapTagString(pBuf, HEAP_TAG_MAX_LEN_STRING);
+    delete[] pBuf;
+    pBuf = new char[DIAGNOSTICS_LIFETIME_MAX_LEN_STRING];
+    gDiagnosticsLifetimeMutex.lock();
+    saveDiagnosticsLifetimeLocked();
+    pData->lifetime = pDiagnosticsLifetimeString(pBuf, DIAGNOSTICS_LIFETIME_MAX_LEN_STRING);
+    gDiagnosticsLifetimeMutex.unlock();
+    delete[] pBuf;
+    pData->audioLinkRtt = getAudioLinkRttMs();
+    pData->audioLinkRttVar = getAudioLinkRttVarMs();
+    pData->audioLinkGoodput = getAudioLinkGoodputBitsS();
+
+    delete pDiagnostics;
 
     return true;
 }
@@ -80,6 +349,12 @@ static bool getDiagnosticsData(IocM2mDiagnostics::Diagnostics *pData)
 // Initialise the diagnostics object.
 IocM2mDiagnostics *pInitDiagnostics()
 {
+    if (gDiagnosticsSaveEventId == 0) {
+        gDiagnosticsSaveEventId = eventQueueCallEvery("diag lifetime",
+                                                      DIAGNOSTICS_LIFETIME_SAVE_INTERVAL_SECONDS * 1000,
+                                                      callback(&saveDiagnosticsLifetime));
+    }
+
     gpM2mObject = new IocM2mDiagnostics(getDiagnosticsData, MBED_CONF_APP_OBJECT_DEBUG_ON);
     return gpM2mObject;
 }
@@ -87,27 +362,101 @@ IocM2mDiagnostics *pInitDiagnostics()
 // Shut down diagnostics object.
 void deinitDiagnostics()
 {
+    char buf[AUDIO_DATAGRAM_QUEUE_HISTOGRAM_MAX_LEN_STRING];
+    unsigned int percentileUs[AUDIO_SEND_DURATION_NUM_PERCENTILES];
+    DiagnosticsLocal *pDiagnostics = new DiagnosticsLocal;
+
+    if (gDiagnosticsSaveEventId != 0) {
+        pGetEventQueue()->cancel(gDiagnosticsSaveEventId);
+        gDiagnosticsSaveEventId = 0;
+    }
+    saveDiagnosticsLifetime();
+
     delete gpM2mObject;
     gpM2mObject = NULL;
 
-    if (gDiagnostics.numAudioDatagrams > 0) {
+    pGetDiagnosticsSnapshot(pDiagnostics);
+    if (pDiagnostics->numAudioDatagrams > 0) {
         printf("Stats:\n");
-        printf("Worst case time to perform a send: %u us.\n", gDiagnostics.worstCaseAudioDatagramSendDuration);
-        printf("Average time to perform a send: %llu us.\n", gDiagnostics.averageAudioDatagramSendDuration /
-                                                             gDiagnostics.numAudioDatagrams);
+        printf("Worst case time to perform a send: %u us.\n",
+               (unsigned int) pDiagnostics->worstCaseAudioDatagramSendDuration);
+        getSendDurationPercentiles(pDiagnostics, percentileUs);
+        printf("Time to perform a send: p50 %u us, p90 %u us, p99 %u us, p99.9 %u us.\n",
+               percentileUs[0], percentileUs[1], percentileUs[2], percentileUs[3]);
         printf("Minimum number of datagram(s) free %d.\n", getUrtpDatagramsFreeMin());
-        printf("Number of send failure(s) %d.\n", gDiagnostics.numAudioSendFailures);
-        printf("%d send(s) took longer than %d ms (%llu%% of the total).\n",
-               gDiagnostics.numAudioDatagramsSendTookTooLong,
-               BLOCK_DURATION_MS, (uint64_t) gDiagnostics.numAudioDatagramsSendTookTooLong * 100 /
-                                             gDiagnostics.numAudioDatagrams);
+        printf("Number of send failure(s) %u.\n", (unsigned int) pDiagnostics->numAudioSendFailures);
+        printf("%u send(s) took longer than %d ms (%llu%% of the total).\n",
+               (unsigned int) pDiagnostics->numAudioDatagramsSendTookTooLong,
+               BLOCK_DURATION_MS, (uint64_t) pDiagnostics->numAudioDatagramsSendTookTooLong * 100 /
+                                             pDiagnostics->numAudioDatagrams);
+        printf("Maximum number of datagram(s) queued %u.\n", (unsigned int) pDiagnostics->audioDatagramQueueMax);
+        printf("Seconds spent at each tenth of the datagram store: %s.\n",
+               pAudioDatagramQueueHistogramString(pDiagnostics, buf, sizeof (buf)));
+        printf("%u datagram overflow episode(s), %u datagram(s) lost, %u ms in total, worst case %u ms.\n",
+               (unsigned int) pDiagnostics->numAudioDatagramOverflowEpisodes,
+               (unsigned int) pDiagnostics->numAudioDatagramsOverflowed,
+               (unsigned int) pDiagnostics->audioDatagramOverflowDurationMs,
+               (unsigned int) pDiagnostics->worstCaseAudioDatagramOverflowDurationMs);
     }
+    printf("Lifetime: %u wake-up(s), %u watchdog reset(s), awake %u second(s), %u datagram(s), "
+           "%u send failure(s), %u took too long, %u kbyte(s) sent, %u overflow episode(s), "
+           "%u datagram(s) lost, worst case send %u us.\n",
+           (unsigned int) gDiagnosticsLifetime.numWakeUps,
+           (unsigned int) gDiagnosticsLifetime.numWatchdogResets,
+           (unsigned int) gDiagnosticsLifetime.awakeSeconds,
+           (unsigned int) gDiagnosticsLifetime.numAudioDatagrams,
+           (unsigned int) gDiagnosticsLifetime.numAudioSendFailures,
+           (unsigned int) gDiagnosticsLifetime.numAudioDatagramsSendTookTooLong,
+           (unsigned int) gDiagnosticsLifetime.numAudioKBytesSent,
+           (unsigned int) gDiagnosticsLifetime.numAudioDatagramOverflowEpisodes,
+           (unsigned int) gDiagnosticsLifetime.numAudioDatagramsOverflowed,
+           (unsigned int) gDiagnosticsLifetime.worstCaseAudioDatagramSendDuration);
+
+    delete pDiagnostics;
 }
 
 // Reset all diagnostics values.
+// This is called before the audio tasks are started, so
+// there are no writers, only readers to keep out.
 void resetDiagnostics()
 {
+    uint32_t numAudioBytesSent = gDiagnostics.numAudioBytesSent;
+
+    gDiagnosticsLifetimeMutex.lock();
+    saveDiagnosticsLifetimeLocked();
+    core_util_atomic_incr_u32(&gDiagnosticsResetCount, 1);
     memset(&gDiagnostics, 0, sizeof (gDiagnostics));
+    gDiagnostics.numAudioBytesSent = numAudioBytesSent;
+    core_util_atomic_incr_u32(&gDiagnosticsResetCount, 1);
+    memset(&gDiagnosticsSaved, 0, sizeof (gDiagnosticsSaved));
+    gDiagnosticsSaved.numAudioBytesSent = numAudioBytesSent;
+    gDiagnosticsLifetimeMutex.unlock();
+}
+
+// Initialise the lifetime diagnostics on wake-up.
+void initDiagnosticsLifetime()
+{
+    gDiagnosticsLifetimeMutex.lock();
+    if (gDiagnosticsLifetime.crc != diagnosticsLifetimeCrc()) {
+        LOG(EVENT_DIAGNOSTICS_LIFETIME_RESET, gDiagnosticsLifetime.crc);
+        memset(&gDiagnosticsLifetime, 0, sizeof (gDiagnosticsLifetime));
+    }
+    gDiagnosticsLifetime.numWakeUps++;
+    if (getResetReason() == RESET_REASON_WATCHDOG) {
+        gDiagnosticsLifetime.numWatchdogResets++;
+    }
+    gDiagnosticsLifetime.crc = diagnosticsLifetimeCrc();
+    gDiagnosticsSavedTickerUs = us_ticker_read();
+    LOG(EVENT_DIAGNOSTICS_LIFETIME_WAKE_UPS, gDiagnosticsLifetime.numWakeUps);
+    gDiagnosticsLifetimeMutex.unlock();
+}
+
+// Add the diagnostics since the last call to the lifetime diagnostics.
+void saveDiagnosticsLifetime()
+{
+    gDiagnosticsLifetimeMutex.lock();
+    saveDiagnosticsLifetimeLocked();
+    gDiagnosticsLifetimeMutex.unlock();
 }
 
 // Set the start time.
@@ -122,12 +471,6 @@ int getStartTime()
     return gStartTime;
 }
 
-// Set the number of audio bytes sent.
-void setNumAudioBytesSent(unsigned int num)
-{
-    gDiagnostics.numAudioBytesSent = num;
-}
-
 // Get the number of audio bytes sent.
 unsigned int getNumAudioBytesSent()
 {
@@ -137,44 +480,113 @@ unsigned int getNumAudioBytesSent()
 // Increment the number of audio send failures.
 void incNumAudioSendFailures()
 {
-    gDiagnostics.numAudioSendFailures++;
+    core_util_atomic_incr_u32(&gDiagnostics.numAudioSendFailures, 1);
+}
+
+// Get the number of audio send failures.
+unsigned int getNumAudioSendFailures()
+{
+    return gDiagnostics.numAudioSendFailures;
 }
 
 // Increment the number of audio bytes sent.
 void incNumAudioBytesSent(unsigned int num)
 {
-    gDiagnostics.numAudioBytesSent += num;
+    core_util_atomic_incr_u32(&gDiagnostics.numAudioBytesSent, num);
 }
 
-// Increment the audio send duration.
-void incAverageAudioDatagramSendDuration(int64_t num)
+// Add an audio datagram send duration to the histogram.
+void addAudioDatagramSendDuration(unsigned int durationUs)
 {
-    gDiagnostics.averageAudioDatagramSendDuration += num;
+    core_util_atomic_incr_u32(&gDiagnostics.audioDatagramSendDurationHistogram[sendDurationBucket(durationUs)], 1);
 }
 
 // Increment the number of audio datagrams.
 void incNumAudioDatagrams()
 {
-    gDiagnostics.numAudioDatagrams++;
+    core_util_atomic_incr_u32(&gDiagnostics.numAudioDatagrams, 1);
 }
 
 // Increment the number of occasions when sending an audio
 // datagram took too long.
 void incNumAudioDatagramsSendTookTooLong()
 {
-    gDiagnostics.numAudioDatagramsSendTookTooLong++;
+    core_util_atomic_incr_u32(&gDiagnostics.numAudioDatagramsSendTookTooLong, 1);
+}
+
+// Update the worst case audio datagram send duration.
+bool updateWorstCaseAudioDatagramSendDuration(unsigned int num)
+{
+    return atomicMax(&gDiagnostics.worstCaseAudioDatagramSendDuration, num);
+}
+
+// Record the occupancy of the audio datagram queue.
+void addAudioDatagramQueueSample(int numQueued, int storeSize)
+{
+    int bucket = 0;
+
+    if (storeSize > 0) {
+        bucket = numQueued * AUDIO_DATAGRAM_QUEUE_HISTOGRAM_NUM_BUCKETS / storeSize;
+        if (bucket >= AUDIO_DATAGRAM_QUEUE_HISTOGRAM_NUM_BUCKETS) {
+            bucket = AUDIO_DATAGRAM_QUEUE_HISTOGRAM_NUM_BUCKETS - 1;
+        } else if (bucket < 0) {
+            bucket = 0;
+        }
+    }
+    core_util_atomic_incr_u32(&gDiagnostics.audioDatagramQueueHistogram[bucket], 1);
+    if (numQueued > 0) {
+        atomicMax(&gDiagnostics.audioDatagramQueueMax, numQueued);
+        atomicMax(&gAudioDatagramQueueMaxInterval, numQueued);
+    }
+}
+
+// Get the worst audio datagram queue depth since this
+// function was last called, resetting it.
+unsigned int takeAudioDatagramQueueMaxInterval()
+{
+    uint32_t queueMax = gAudioDatagramQueueMaxInterval;
+
+    while (!core_util_atomic_cas_u32(&gAudioDatagramQueueMaxInterval, &queueMax, 0)) {
+    }
+
+    return queueMax;
 }
 
-// Get the worst case audio datagram send duration.
-unsigned int getWorstCaseAudioDatagramSendDuration()
+// Record the start of an audio datagram overflow episode.
+void startAudioDatagramOverflow()
 {
-    return gDiagnostics.worstCaseAudioDatagramSendDuration;
+    core_util_critical_section_enter();
+    if (gAudioDatagramOverflowNesting == 0) {
+        core_util_atomic_incr_u32(&gDiagnostics.numAudioDatagramOverflowEpisodes, 1);
+        gAudioDatagramOverflowTimer.reset();
+        gAudioDatagramOverflowTimer.start();
+    }
+    gAudioDatagramOverflowNesting++;
+    core_util_critical_section_exit();
 }
 
-// Set the worst case audio datagram send duration.
-void setWorstCaseAudioDatagramSendDuration(unsigned int num)
+// Record the end of an audio datagram overflow episode.
+void stopAudioDatagramOverflow(int numOverflows)
 {
-    gDiagnostics.worstCaseAudioDatagramSendDuration = num;
+    int duration = -1;
+
+    core_util_critical_section_enter();
+    core_util_atomic_incr_u32(&gDiagnostics.numAudioDatagramsOverflowed, numOverflows);
+    if (gAudioDatagramOverflowNesting > 0) {
+        gAudioDatagramOverflowNesting--;
+        if (gAudioDatagramOverflowNesting == 0) {
+            gAudioDatagramOverflowTimer.stop();
+            duration = gAudioDatagramOverflowTimer.read_ms();
+            core_util_atomic_incr_u32(&gDiagnostics.audioDatagramOverflowDurationMs, duration);
+            atomicMax(&gDiagnostics.worstCaseAudioDatagramOverflowDurationMs, duration);
+        }
+    }
+    core_util_critical_section_exit();
+
+    // May be called from the I2S path, hence LOG_RING()
+    if (duration >= 0) {
+        LOG_RING(EVENT_DATAGRAM_OVERFLOW_ENDS, duration);
+    }
 }
 
 /* ----------------------------------------------------------------
@@ -185,14 +597,24 @@ void setWorstCaseAudioDatagramSendDuration(unsigned int num)
  * initialisation be done in the class definition).
  */
 const M2MObjectHelper::DefObject IocM2mDiagnostics::_defObject =
-    {0, "32771", 7,
+    {0, "32771", 17,
         -1, RESOURCE_NUMBER_UP_TIME, "on time", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
         -1, RESOURCE_NUMBER_RESET_REASON, "reset reason", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
-        RESOURCE_INSTANCE_WORST_CASE_SEND_DURATION, RESOURCE_NUMBER_WORST_CASE_SEND_DURATION, "duration", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
-        RESOURCE_INSTANCE_AVERAGE_SEND_DURATION, RESOURCE_NUMBER_AVERAGE_SEND_DURATION, "duration", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        0, RESOURCE_NUMBER_SEND_DURATION_PERCENTILE, "duration", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        1, RESOURCE_NUMBER_SEND_DURATION_PERCENTILE, "duration", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        2, RESOURCE_NUMBER_SEND_DURATION_PERCENTILE, "duration", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        3, RESOURCE_NUMBER_SEND_DURATION_PERCENTILE, "duration", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
         -1, RESOURCE_NUMBER_MIN_NUM_DATAGRAMS_FREE, "down counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
         -1, RESOURCE_NUMBER_NUM_SEND_FAILURES, "up counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
-        -1, RESOURCE_NUMBER_PERCENT_SENDS_TOO_LONG, "percent", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL
+        -1, RESOURCE_NUMBER_PERCENT_SENDS_TOO_LONG, "percent", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_DATAGRAM_QUEUE_HISTOGRAM, "string", M2MResourceBase::STRING, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_NUM_DATAGRAM_OVERFLOW_EPISODES, "counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_DATAGRAM_OVERFLOW_DURATION, "cumulative time", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_HEAP_USE, "string", M2MResourceBase::STRING, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_LIFETIME, "string", M2MResourceBase::STRING, true, M2MBase::GET_ALLOWED, NULL,
+        RESOURCE_INSTANCE_AUDIO_LINK_RTT, RESOURCE_NUMBER_AUDIO_LINK, "ms", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        RESOURCE_INSTANCE_AUDIO_LINK_RTT_VAR, RESOURCE_NUMBER_AUDIO_LINK, "ms", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        RESOURCE_INSTANCE_AUDIO_LINK_GOODPUT, RESOURCE_NUMBER_AUDIO_LINK, "bits/s", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL
     };
 
 // Constructor.
@@ -227,15 +649,24 @@ void IocM2mDiagnostics::updateObservableResources()
             // Set the values in the resources based on the new data
             MBED_ASSERT(setResourceValue(data.upTime, RESOURCE_NUMBER_UP_TIME));
             MBED_ASSERT(setResourceValue(data.resetReason, RESOURCE_NUMBER_RESET_REASON));
-            MBED_ASSERT(setResourceValue(data.worstCaseSendDuration,
-                                         RESOURCE_NUMBER_WORST_CASE_SEND_DURATION,
-                                         RESOURCE_INSTANCE_WORST_CASE_SEND_DURATION));
-            MBED_ASSERT(setResourceValue(data.averageSendDuration,
-                                         RESOURCE_NUMBER_AVERAGE_SEND_DURATION,
-                                         RESOURCE_INSTANCE_AVERAGE_SEND_DURATION));
+            for (int x = 0; x < AUDIO_SEND_DURATION_NUM_PERCENTILES; x++) {
+                MBED_ASSERT(setResourceValue(data.sendDurationPercentile[x],
+                                             RESOURCE_NUMBER_SEND_DURATION_PERCENTILE, x));
+            }
             MBED_ASSERT(setResourceValue(data.minNumDatagramsFree, RESOURCE_NUMBER_MIN_NUM_DATAGRAMS_FREE));
             MBED_ASSERT(setResourceValue(data.numSendFailures, RESOURCE_NUMBER_NUM_SEND_FAILURES));
             MBED_ASSERT(setResourceValue(data.percentageSendsTooLong, RESOURCE_NUMBER_PERCENT_SENDS_TOO_LONG));
+            MBED_ASSERT(setResourceValue(data.datagramQueueHistogram, RESOURCE_NUMBER_DATAGRAM_QUEUE_HISTOGRAM));
+            MBED_ASSERT(setResourceValue(data.numDatagramOverflowEpisodes, RESOURCE_NUMBER_NUM_DATAGRAM_OVERFLOW_EPISODES));
+            MBED_ASSERT(setResourceValue(data.datagramOverflowDuration, RESOURCE_NUMBER_DATAGRAM_OVERFLOW_DURATION));
+            MBED_ASSERT(setResourceValue(data.heapUse, RESOURCE_NUMBER_HEAP_USE));
+            MBED_ASSERT(setResourceValue(data.lifetime, RESOURCE_NUMBER_LIFETIME));
+            MBED_ASSERT(setResourceValue(data.audioLinkRtt, RESOURCE_NUMBER_AUDIO_LINK,
+                                         RESOURCE_INSTANCE_AUDIO_LINK_RTT));
+            MBED_ASSERT(setResourceValue(data.audioLinkRttVar, RESOURCE_NUMBER_AUDIO_LINK,
+                                         RESOURCE_INSTANCE_AUDIO_LINK_RTT_VAR));
+            MBED_ASSERT(setResourceValue(data.audioLinkGoodput, RESOURCE_NUMBER_AUDIO_LINK,
+                                         RESOURCE_INSTANCE_AUDIO_LINK_GOODPUT));
         }
     }
 }
@@ -20,20 +20,94 @@
 #ifndef _IOC_DIAGNOSTICS_
 #define _IOC_DIAGNOSTICS__
 
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of buckets in the histogram of audio datagram
+// queue occupancy, each covering an equal share of the
+// datagram store.
+#define AUDIO_DATAGRAM_QUEUE_HISTOGRAM_NUM_BUCKETS 10
+
+// The maximum length of the string form of the audio
+// datagram queue histogram (including terminator).
+#define AUDIO_DATAGRAM_QUEUE_HISTOGRAM_MAX_LEN_STRING (AUDIO_DATAGRAM_QUEUE_HISTOGRAM_NUM_BUCKETS * 11)
+
+// The audio datagram send duration histogram is log-linear:
+// each power of two microseconds is split into this many
+// equal sub-buckets, so a bucket is never wider than
+// 1/AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS of its value
+// (i.e. 12.5%), while durations below
+// AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS us have a
+// bucket each.  Must be a power of two.
+#define AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS_LOG2 3
+#define AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS (1 << AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS_LOG2)
+
+// The largest power of two microseconds covered by the audio
+// datagram send duration histogram (2^23 us is 8.4 seconds,
+// anything longer goes into the last bucket).
+#define AUDIO_SEND_DURATION_HISTOGRAM_MAX_LOG2 23
+
+// The number of buckets in the audio datagram send
+// duration histogram.
+#define AUDIO_SEND_DURATION_HISTOGRAM_NUM_BUCKETS ((AUDIO_SEND_DURATION_HISTOGRAM_MAX_LOG2 - \
+                                                   AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS_LOG2 + 2) * \
+                                                  AUDIO_SEND_DURATION_HISTOGRAM_SUB_BUCKETS)
+
+// The number of audio datagram send duration percentiles
+// reported (p50, p90, p99 and p99.9).
+#define AUDIO_SEND_DURATION_NUM_PERCENTILES 4
+
+// The interval at which the diagnostics are added to
+// the lifetime diagnostics.
+#define DIAGNOSTICS_LIFETIME_SAVE_INTERVAL_SECONDS 60
+
+// The maximum length of the string form of the lifetime
+// diagnostics (including terminator).
+#define DIAGNOSTICS_LIFETIME_MAX_LEN_STRING (10 * 11)
+
 /* ----------------------------------------------------------------
  * GENERAL TYPES
  * -------------------------------------------------------------- */
 
-// The local version of diagnostics data.
+// The local version of diagnostics data.  This is written
+// by the audio send task and the I2S task and read by the
+// event thread and a ticker, so every field is a 32 bit word
+// (64 bit accesses tear on Cortex-M4) which is only ever
+// modified using the core_util_atomic_*() functions.
 typedef struct {
-    unsigned int worstCaseAudioDatagramSendDuration;
-    uint64_t averageAudioDatagramSendDuration;
-    uint64_t numAudioDatagrams;
-    unsigned int numAudioSendFailures;
-    unsigned int numAudioDatagramsSendTookTooLong;
-    unsigned int numAudioBytesSent;
+    uint32_t worstCaseAudioDatagramSendDuration;
+    uint32_t audioDatagramSendDurationHistogram[AUDIO_SEND_DURATION_HISTOGRAM_NUM_BUCKETS];
+    uint32_t numAudioDatagrams;
+    uint32_t numAudioSendFailures;
+    uint32_t numAudioDatagramsSendTookTooLong;
+    uint32_t numAudioBytesSent; ///< Never reset, wraps.
+    uint32_t audioDatagramQueueHistogram[AUDIO_DATAGRAM_QUEUE_HISTOGRAM_NUM_BUCKETS]; ///< In blocks.
+    uint32_t audioDatagramQueueMax;
+    uint32_t numAudioDatagramOverflowEpisodes;
+    uint32_t numAudioDatagramsOverflowed;
+    uint32_t audioDatagramOverflowDurationMs;
+    uint32_t worstCaseAudioDatagramOverflowDurationMs;
 } DiagnosticsLocal;
 
+// Diagnostics accumulated over the lifetime of the device,
+// i.e. through sleep and standby, kept in backup SRAM.  The
+// order of the fields is the order in the string form, see
+// pDiagnosticsLifetimeString() in ioc_diagnostics.cpp.
+typedef struct {
+    uint32_t numWakeUps;
+    uint32_t numWatchdogResets;
+    uint32_t awakeSeconds;
+    uint32_t numAudioDatagrams;
+    uint32_t numAudioSendFailures;
+    uint32_t numAudioDatagramsSendTookTooLong;
+    uint32_t numAudioKBytesSent;
+    uint32_t numAudioDatagramOverflowEpisodes;
+    uint32_t numAudioDatagramsOverflowed;
+    uint32_t worstCaseAudioDatagramSendDuration;
+    uint32_t crc; ///< Must be last.
+} DiagnosticsLifetime;
+
 /* ----------------------------------------------------------------
  * DIAGNOSTICS M2M C++ OBJECT DEFINITION
  * -------------------------------------------------------------- */
@@ -50,11 +124,22 @@ public:
     typedef struct {
         int64_t upTime;
         int64_t resetReason;
-        float worstCaseSendDuration;
-        float averageSendDuration;
+        float sendDurationPercentile[AUDIO_SEND_DURATION_NUM_PERCENTILES]; ///< p50, p90,
+                                                                           /// p99, p99.9.
         int64_t minNumDatagramsFree;
         int64_t numSendFailures;
         int64_t percentageSendsTooLong;
+        String datagramQueueHistogram; ///< Seconds spent at each
+                                       /// tenth of the datagram store,
+                                       /// comma separated.
+        int64_t numDatagramOverflowEpisodes;
+        float datagramOverflowDuration;
+        String heapUse;                ///< See pHeapTagString() in
+                                       /// ioc_utils.h.
+        String lifetime;               ///< See DiagnosticsLifetime.
+        int64_t audioLinkRtt;          ///< Smoothed, in ms, -1 if not known.
+        int64_t audioLinkRttVar;       ///< In ms, -1 if not known.
+        int64_t audioLinkGoodput;      ///< Smoothed, in bits/s, -1 if not known.
     } Diagnostics;
 
     /** Constructor.
@@ -85,23 +170,11 @@ protected:
      */
 #   define RESOURCE_NUMBER_RESET_REASON "5526"
 
-    /** The resource number for worstCaseSendDuration,
-     * a Duration resource.
-     */
-#   define RESOURCE_NUMBER_WORST_CASE_SEND_DURATION "5524"
-
-    /** The resource instance for worstCaseSendDuration.
-     */
-#   define RESOURCE_INSTANCE_WORST_CASE_SEND_DURATION 0
-
-    /** The resource number for averageDuration, a
-     * Duration resource.
-     */
-#   define RESOURCE_NUMBER_AVERAGE_SEND_DURATION "5524"
-
-    /** The resource instance for averageSendDuration.
+    /** The resource number for sendDurationPercentile,
+     * a multi-instance Duration resource with instances
+     * 0 to 3 being p50, p90, p99 and p99.9.
      */
-#   define RESOURCE_INSTANCE_AVERAGE_SEND_DURATION  1
+#   define RESOURCE_NUMBER_SEND_DURATION_PERCENTILE "5524"
 
     /** The resource number for minDatagramsFree, a
      * Down Counter resource.
@@ -118,6 +191,49 @@ protected:
      */
 #   define RESOURCE_NUMBER_PERCENT_SENDS_TOO_LONG "3320"
 
+    /** The resource number for datagramQueueHistogram,
+     * a Text resource.
+     */
+#   define RESOURCE_NUMBER_DATAGRAM_QUEUE_HISTOGRAM "5527"
+
+    /** The resource number for numDatagramOverflowEpisodes,
+     * a Counter resource.
+     */
+#   define RESOURCE_NUMBER_NUM_DATAGRAM_OVERFLOW_EPISODES "5534"
+
+    /** The resource number for datagramOverflowDuration,
+     * a Cumulative Time resource.
+     */
+#   define RESOURCE_NUMBER_DATAGRAM_OVERFLOW_DURATION "5544"
+
+    /** The resource number for heapUse, an Application
+     * Type resource.
+     */
+#   define RESOURCE_NUMBER_HEAP_USE "5750"
+
+    /** The resource number for lifetime, a Sensor Units
+     * resource for the sake of anything better.
+     */
+#   define RESOURCE_NUMBER_LIFETIME "5701"
+
+    /** The resource number for audioLinkRtt, audioLinkRttVar
+     * and audioLinkGoodput, a multi-instance Sensor Value
+     * resource.
+     */
+#   define RESOURCE_NUMBER_AUDIO_LINK "5700"
+
+    /** The resource instance for audioLinkRtt.
+     */
+#   define RESOURCE_INSTANCE_AUDIO_LINK_RTT 0
+
+    /** The resource instance for audioLinkRttVar.
+     */
+#   define RESOURCE_INSTANCE_AUDIO_LINK_RTT_VAR 1
+
+    /** The resource instance for audioLinkGoodput.
+     */
+#   define RESOURCE_INSTANCE_AUDIO_LINK_GOODPUT 2
+
     /** Definition of this object.
      */
     static const DefObject _defObject;
@@ -142,10 +258,23 @@ IocM2mDiagnostics *pInitDiagnostics();
 void deinitDiagnostics();
 
 
-/* Reset all diagnostics values.
+/* Reset all diagnostics values; the values are first added
+ * to the lifetime diagnostics.
  */
 void resetDiagnostics();
 
+/** Initialise the lifetime diagnostics on wake-up: if they
+ * are not valid, e.g. after power-on, they are zeroed, then
+ * the wake-up is counted.  Call this once the reset reason
+ * is known.
+ */
+void initDiagnosticsLifetime();
+
+/** Add the diagnostics since the last call to the lifetime
+ * diagnostics; call this before going to sleep.
+ */
+void saveDiagnosticsLifetime();
+
 /** Set the start time.
  * @param num the start time (Unix format).
  */
@@ -156,12 +285,10 @@ void setStartTime(int num);
  */
 int getStartTime();
 
-/** Set the number of audio bytes sent.
- * @param num the number of audio bytes sent.
- */
-void setNumAudioBytesSent(unsigned int num);
-
-/** Get the number of audio bytes sent.
+/** Get the number of audio bytes sent.  This is a running
+ * total which is not reset by resetDiagnostics() and wraps,
+ * so take the difference between two readings using
+ * unsigned arithmetic.
  * @return the number of audio bytes sent.
  */
 unsigned int getNumAudioBytesSent();
@@ -170,15 +297,22 @@ unsigned int getNumAudioBytesSent();
  */
 void incNumAudioSendFailures();
 
+/** Get the number of audio send failures.
+ * @return the number of audio send failures since
+ *         diagnostics were last reset.
+ */
+unsigned int getNumAudioSendFailures();
+
 /* Increment the number of audio bytes sent.
  * @param num the amount to increment by.
  */
 void incNumAudioBytesSent(unsigned int num);
 
-/* Increment the average audio send duration.
- * @param the amount to increment by.
+/* Add an audio datagram send duration to the histogram
+ * from which the send duration percentiles are derived.
+ * @param durationUs the send duration in microseconds.
  */
-void incAverageAudioDatagramSendDuration(int64_t num);
+void addAudioDatagramSendDuration(unsigned int durationUs);
 
 /* Increment the number of audio datagrams (sent or not).
  */
@@ -189,15 +323,36 @@ void incNumAudioDatagrams();
  */
 void incNumAudioDatagramsSendTookTooLong();
 
-/* Get the worst case audio datagram send duration.
- * @return the worst case send duration.
+/* Update the worst case audio datagram send duration.
+ * @param num the send duration.
+ * @return    true if this is a new worst case.
+ */
+bool updateWorstCaseAudioDatagramSendDuration(unsigned int num);
+
+/* Record the occupancy of the audio datagram queue; call this
+ * once per block so that the histogram is of time at depth.
+ * @param numQueued the number of datagrams queued.
+ * @param storeSize the number of datagrams the queue can hold.
+ */
+void addAudioDatagramQueueSample(int numQueued, int storeSize);
+
+/* Get the worst audio datagram queue depth since this
+ * function was last called, resetting it.
+ * @return the worst number of datagrams queued.
+ */
+unsigned int takeAudioDatagramQueueMaxInterval();
+
+/* Record the start of an audio datagram overflow episode;
+ * may be called from more than one source, an episode lasting
+ * until each has called stopAudioDatagramOverflow().
  */
-unsigned int getWorstCaseAudioDatagramSendDuration();
+void startAudioDatagramOverflow();
 
-/* Set the worst case audio datagram send duration.
- * @param the worst case send duration.
+/* Record the end of an audio datagram overflow episode; may
+ * be called from the I2S path, so it logs with LOG_RING().
+ * @param numOverflows the number of datagrams lost in the episode.
  */
-void setWorstCaseAudioDatagramSendDuration(unsigned int num);
+void stopAudioDatagramOverflow(int numOverflows);
 
 #endif // _IOC_DIAGNOSTICS_
 
@@ -25,8 +25,14 @@
 #include "ioc_config.h"
 #include "ioc_audio.h"
 #include "ioc_dynamics.h"
+#include "ioc_energy.h"
 #include "ioc_network.h"
 #include "ioc_logging.h"
+#include "ioc_log_compact.h"
+#include "ioc_log_index.h"
+#include "ioc_log_ring.h"
+#include "ioc_log_upload.h"
+#include "ioc_schedule.h"
 #include "ioc_utils.h"
 
 /* This file implements the dynamic behaviour of the IOC client.
@@ -116,7 +122,9 @@ static void buttonCallback()
 static bool init()
 {
     bool success = false;
-    NetworkInterface *pNetworkInterface;
+    CloudClientDm *pCloudClientDm;
+    NetworkInterface *pNetworkInterface = NULL;
+    HeapTag heapTag;
 
     setStartTime(time(NULL));
     initWatchdog();
@@ -126,10 +134,20 @@ static bool init()
     gpUserButton = new InterruptIn(SW0);
     gpUserButton->rise(&buttonCallback);
 
-    if ((pInitCloudClientDm() != NULL) &&
-        ((pNetworkInterface = pInitNetwork()) != NULL) &&
-        connectCloudClientDm(pNetworkInterface)) {
-        success = true;
+    heapTag = heapTagStart(HEAP_TAG_CLOUD_CLIENT);
+    pCloudClientDm = pInitCloudClientDm();
+    heapTagStop(heapTag);
+
+    if (pCloudClientDm != NULL) {
+        heapTag = heapTagStart(HEAP_TAG_NETWORK);
+        pNetworkInterface = pInitNetwork();
+        heapTagStop(heapTag);
+    }
+
+    if (pNetworkInterface != NULL) {
+        heapTag = heapTagStart(HEAP_TAG_CLOUD_CLIENT);
+        success = connectCloudClientDm(pNetworkInterface);
+        heapTagStop(heapTag);
     }
 
     return success;
@@ -139,6 +157,7 @@ static bool init()
 static bool initFileSystem()
 {
     int x;
+    HeapTag heapTag;
 
     flash();
     LOG(EVENT_SD_CARD_START, 0);
@@ -158,11 +177,29 @@ static bool initFileSystem()
     if (isLoggingToFileEnabled()) {
         flash();
         printf("Starting logging to file...\n");
-        if (initLogFile(LOG_FILE_PATH)) {
-            pGetEventQueue()->call_every(LOG_WRITE_INTERVAL_MS, writeLog);
+        heapTag = heapTagStart(HEAP_TAG_LOGGING);
+        // Load the log index, rather than walking the
+        // directory, then compact the log files from previous
+        // runs, which are now closed, before they are uploaded
+        // and make room for this one
+        if (!initLogIndex(LOG_FILE_PATH)) {
+            printf("WARNING: unable to save log index.\n");
+        }
+        x = compactLogFiles(LOG_FILE_PATH);
+        if (x > 0) {
+            printf("%d log file(s) compacted.\n", x);
+        }
+        x = capLogIndexTotalSize(LOG_INDEX_MAX_TOTAL_SIZE);
+        if (x > 0) {
+            printf("%d old log file(s) deleted to make room.\n", x);
+        }
+        if (initLogFile(LOG_FILE_PATH "/" LOG_INDEX_SESSION_DIR_NAME)) {
+            openLogRingFile(LOG_FILE_PATH);
+            startLogWriter();
         } else {
             printf("WARNING: unable to initialise logging to file.\n");
         }
+        heapTagStop(heapTag);
     }
 
     return true;
@@ -173,9 +210,15 @@ static bool initFileSystem()
 static void deinit()
 {
     int x;
+    HeapTag heapTag;
 
+    stopLogUpload();
+    heapTag = heapTagStart(HEAP_TAG_CLOUD_CLIENT);
     deinitCloudClientDm();
+    heapTagStop(heapTag);
+    heapTag = heapTagStart(HEAP_TAG_NETWORK);
     deinitNetwork();
+    heapTagStop(heapTag);
 
     if (gpUserButton != NULL) {
         flash();
@@ -261,7 +304,9 @@ static void deinit()
  * - if init() is completed, move immediately to Ready mode,
  * - at each tick:
  *   - if wakeUpTickCounterModulo has been reached AND
- *     there is NO external power, go to sleepLevel OFF,
+ *     there is NO external power, go to sleepLevel OFF
+ *     or, if there is a streaming schedule, to
+ *     DEREGISTERED_SLEEP until shortly before the next window,
  *   - otherwise, run init().
  *
  * In detail, Ready mode dynamic behaviour is as follows:
@@ -283,9 +328,31 @@ static void deinit()
  *     at 1 minute, otherwise:
  *     - if there is external power, set wakeUpTick to 10
  *       minutes [readyWakeUpTickCounterPeriod2],
- *     - if there is no external power, go to sleepLevel OFF.
+ *     - if there is no external power, go to sleepLevel OFF
+ *       or, if there is a streaming schedule, to
+ *       DEREGISTERED_SLEEP until shortly before the next
+ *       window (staying awake if the window is imminent),
+ * - throughout, start audio streaming at the beginning of
+ *   each streaming schedule window and stop it at the end.
  */
 
+// Go to sleep until shortly before the next streaming schedule
+// window, keeping the modem off in between, or, if there is no
+// schedule, go to sleep level OFF.  Returns only if a window
+// is about to begin, in which case it is best to stay awake.
+static void setSleepLevelForSchedule()
+{
+    time_t now = time(NULL);
+    time_t nextStart = getScheduleNextStart(now);
+
+    if (nextStart == 0) {
+        setSleepLevelOff();
+    } else if (nextStart - now > SCHEDULE_WAKE_UP_LEAD_SECONDS) {
+        LOG(EVENT_SLEEP_UNTIL_SCHEDULE_WINDOW, nextStart - now);
+        setSleepLevelDeregisteredSleep(nextStart - now - SCHEDULE_WAKE_UP_LEAD_SECONDS);
+    }
+}
+
 // The Initialisation mode wake-up tick handler.
 static void initialisationModeWakeUpTickHandler()
 {
@@ -295,13 +362,17 @@ static void initialisationModeWakeUpTickHandler()
         gWakeUpTickCounter = 0;
         if (isExternalPowerPresent()) {
             // If there is no external power and we've got here, it's been
-            // far too long so just give up
-            setSleepLevelOff();
+            // far too long so just give up, until the next
+            // streaming window if there is one
+            setSleepLevelForSchedule();
         } else {
             // Otherwise, enter standby with a short
             // timer, which will reset us to start trying
             // again
             LOG(EVENT_ENTER_STANDBY, 100);
+            saveDiagnosticsLifetime();
+            stopLogUpload();
+            stopLogWriter();  // Writes out the log
             deinitLog();  // So that we have a complete record
             gLowPower.enterStandby(100);
         }
@@ -318,16 +389,20 @@ static void readyModeWakeUpTickHandler()
         if (isAudioStreamingEnabled()) {
             // If we're streaming, make sure we stay awake
             pGetEventQueue()->cancel(gWakeUpTickHandler);
-            gWakeUpTickHandler = pGetEventQueue()->call_every(getReadyWakeUpTickCounterPeriod1() * 1000, readyModeWakeUpTickHandler);
+            gWakeUpTickHandler = eventQueueCallEvery("ready tick", getReadyWakeUpTickCounterPeriod1() * 1000, callback(readyModeWakeUpTickHandler));
         } else {
             if (isExternalPowerPresent()) {
-                // If there is no external power we've been awake for long enough
-                setSleepLevelOff();
+                // If there is no external power we've been awake for long
+                // enough: sleep until the next streaming window, if
+                // there is one, or stay awake if it is imminent
+                setSleepLevelForSchedule();
+                pGetEventQueue()->cancel(gWakeUpTickHandler);
+                gWakeUpTickHandler = eventQueueCallEvery("ready tick", getReadyWakeUpTickCounterPeriod1() * 1000, callback(readyModeWakeUpTickHandler));
             } else {
                 // Otherwise, just switch to the long repeat period as obviously
                 // nothing much is happening
                 pGetEventQueue()->cancel(gWakeUpTickHandler);
-                gWakeUpTickHandler = pGetEventQueue()->call_every(getReadyWakeUpTickCounterPeriod2() * 1000, readyModeWakeUpTickHandler);
+                gWakeUpTickHandler = eventQueueCallEvery("ready tick", getReadyWakeUpTickCounterPeriod2() * 1000, callback(readyModeWakeUpTickHandler));
             }
         }
     }
@@ -429,6 +504,9 @@ void setSleepLevelRegisteredSleep(time_t sleepDurationSeconds)
     printf("Going to REGISTERED_SLEEP for %d second(s), until %s",
            (int) (sleepDurationSeconds), ctime(&gTimeLeaveSleep));
 
+    energyEnterSleep(ENERGY_MODE_REGISTERED_SLEEP);
+    saveDiagnosticsLifetime();
+
     // Need to wake-up at the watchdog interval to feed it
     while ((sleepTimeLeft = (gTimeLeaveSleep - time(NULL))) > 0) {
         if (sleepTimeLeft > MAX_SLEEP_SECONDS) {
@@ -437,9 +515,13 @@ void setSleepLevelRegisteredSleep(time_t sleepDurationSeconds)
 
         feedWatchdog();
         LOG(EVENT_ENTER_STOP, sleepTimeLeft);
+        // RAM is kept in Stop mode so commit the log, rather
+        // than closing it, and carry on logging on waking
+        checkpointLog();
         gLowPower.enterStop(sleepTimeLeft);
-        deinitLog();  // So that we have a complete record up to this point
     }
+    energyLeaveSleep();
+    resetLogUploadBudget();
 
     printf("Awake from REGISTERED_SLEEP after %d second(s).\n", (int) (time(NULL) - gTimeEnterSleep));
 }
@@ -459,8 +541,12 @@ void setSleepLevelDeregisteredSleep(time_t sleepDurationSeconds)
         sleepDurationSeconds = MAX_SLEEP_SECONDS;
     }
     setMcuState(MCU_STATE_STANDBY);
+    energyEnterSleep(ENERGY_MODE_STANDBY);
+    saveDiagnosticsLifetime();
     feedWatchdog();
     LOG(EVENT_ENTER_STANDBY, sleepDurationSeconds * 1000);
+    stopLogUpload();
+    stopLogWriter();  // Writes out the log
     deinitLog();  // So that we have a complete record
     enterStandby(sleepDurationSeconds);
     // The wake-up process is handled on entry to main()
@@ -473,8 +559,12 @@ void setSleepLevelOff()
 {
     LOG(EVENT_SLEEP_LEVEL_OFF, 0);
     setMcuState(MCU_STATE_OFF);
+    energyEnterSleep(ENERGY_MODE_STANDBY);
+    saveDiagnosticsLifetime();
     feedWatchdog();
     LOG(EVENT_ENTER_STANDBY, MAX_SLEEP_SECONDS * 1000);
+    stopLogUpload();
+    stopLogWriter();  // Writes out the log
     deinitLog();  // So that we have a complete record
     enterStandby(MAX_SLEEP_SECONDS);
 }
@@ -486,11 +576,14 @@ void initialisationMode()
     time_t timeStarted;
 
     // Start the event queue in the event thread
+    // and begin energy accounting
     initEventQueue();
+    setEnergyMode(ENERGY_MODE_INITIALISATION);
+    startEnergySampling();
 
     // Add the Initialisation mode wake-up handler
     LOG(EVENT_INITIALISATION_MODE_START, 0);
-    gWakeUpTickHandler = pGetEventQueue()->call_every(getInitWakeUpTickCounterPeriod() * 1000, initialisationModeWakeUpTickHandler);
+    gWakeUpTickHandler = eventQueueCallEvery("init tick", getInitWakeUpTickCounterPeriod() * 1000, callback(initialisationModeWakeUpTickHandler));
 
     // Initialise everything.  There are three possible outcomes:
     //
@@ -515,11 +608,15 @@ void initialisationMode()
         wait_ms(CLOUD_CLIENT_REGISTRATION_CHECK_INTERVAL_MS);
     }
 
+    // Now registered, let the server have the lifetime
+    // diagnostics, carried over from before standby
+    cloudClientObjectUpdate();
+
     // Having done all of that, it's now safe to begin
     // uploading any log files that might be lying around
     // from previous runs to a logging server
     if (isLoggingUploadEnabled()) {
-        beginLogFileUpload(&gFs, pGetNetworkInterface(), pGetLoggingServerUrl());
+        startLogUpload(LOG_FILE_PATH, pGetLoggingServerUrl());
     }
 
     // Remove the Initialisation mode wake-up handler
@@ -545,8 +642,12 @@ void readyMode()
 {
     // Switch to the Ready mode wake-up handler and zero the tick count
     LOG(EVENT_READY_MODE_START, 0);
+    setEnergyMode(ENERGY_MODE_READY);
     gWakeUpTickCounter = 0;
-    gWakeUpTickHandler = pGetEventQueue()->call_every(getReadyWakeUpTickCounterPeriod1() * 1000, readyModeWakeUpTickHandler);
+    gWakeUpTickHandler = eventQueueCallEvery("ready tick", getReadyWakeUpTickCounterPeriod1() * 1000, callback(readyModeWakeUpTickHandler));
+
+    // Start or stop streaming according to the schedule
+    startAudioSchedule();
 
     for (int x = 0; !gUserButtonPressed; x++) {
         feedWatchdog();
@@ -558,7 +659,8 @@ void readyMode()
     // Cancel the Ready mode wake-up handler
     pGetEventQueue()->cancel(gWakeUpTickHandler);
 
-    // Stop the event queue
+    // Stop energy accounting and the event queue
+    stopEnergySampling();
     deinitEventQueue();
 
     // Shut everything down
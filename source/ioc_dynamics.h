@@ -36,9 +36,6 @@
 // path to the root of our partition.
 #define LOG_FILE_PATH "/" IOC_PARTITION
 
-// The log write interval.
-#define LOG_WRITE_INTERVAL_MS 1000
-
 /* ----------------------------------------------------------------
  * TYPES
  * -------------------------------------------------------------- */
@@ -0,0 +1,392 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h> // for offsetof()
+#include "mbed.h"
+#include "us_ticker_api.h"
+#include "MbedCloudClient.h"
+#include "m2m_object_helper.h"
+#include "low_power.h"
+#include "log.h"
+
+#include "ioc_temperature_battery.h"
+#include "ioc_audio.h"
+#include "ioc_location.h"
+#include "ioc_schedule.h"
+#include "ioc_utils.h"
+#include "ioc_energy.h"
+
+/* This file implements energy accounting: while awake the
+ * battery current is sampled periodically and integrated
+ * over time, the charge being attributed to the mode we are
+ * in; while asleep the battery current can't be sampled so
+ * the charge used is taken from the fall in the remaining
+ * capacity reported by the battery gauge across the sleep.
+ * The records are kept per UTC day in backup SRAM so that
+ * they survive standby, and even OFF, with a CRC so that they
+ * are only reset when they have been lost.
+ *
+ * Only discharge is counted: while the battery is charging
+ * the current drawn by the IOC client can't be told apart
+ * from the charge current, so nothing is attributed.
+ */
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of mA ms in a mAh.
+#define ENERGY_MA_MS_PER_MAH 3600000ULL
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// The charge used on a given day.
+typedef struct {
+    uint32_t day;                              // Days since 1970, 0 if not known.
+    uint64_t chargeMAms[MAX_NUM_ENERGY_MODES]; // Indexed by EnergyMode.
+} EnergyDay;
+
+// The energy records retained through standby.
+typedef struct {
+    EnergyDay day[ENERGY_NUM_DAYS]; // Most recent first.
+    int32_t sleepMode;              // -1 if not asleep.
+    int32_t sleepCapacityMAh;       // Remaining battery capacity
+                                    // when we went to sleep.
+    uint32_t crc;                   // Must be last.
+} EnergyRecords;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The energy records.
+BACKUP_SRAM
+static EnergyRecords gEnergy;
+
+// The mode we are in while awake.
+static EnergyMode gEnergyMode = ENERGY_MODE_INITIALISATION;
+
+// The last sample of battery current.
+static bool gEnergyLastSampleValid = false;
+static uint32_t gEnergyLastSampleUs = 0;
+static int32_t gEnergyLastCurrentMA = 0;
+
+// The event queue ID of the sampling event.
+static int gEnergySampleEventId = 0;
+
+// Mutex to protect the above.
+static Mutex gEnergyMutex;
+
+// The LWM2M object.
+static IocM2mEnergy *gpM2mObject = NULL;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: MISC
+ * -------------------------------------------------------------- */
+
+// Convert mA ms to whole uAh.
+static unsigned int uAh(uint64_t chargeMAms)
+{
+    return (unsigned int) ((chargeMAms * 1000) / ENERGY_MA_MS_PER_MAH);
+}
+
+// Return the CRC that the energy records should have.
+static uint32_t energyCrc()
+{
+    return crc32(&gEnergy, offsetof(EnergyRecords, crc));
+}
+
+// Add charge to a mode on today's record, starting
+// a new record if the day has changed.
+static void energyAdd(EnergyMode mode, uint64_t chargeMAms)
+{
+    time_t now = time(NULL);
+    uint32_t day = 0;
+
+    if (now >= SCHEDULE_MIN_VALID_TIME) {
+        day = now / (3600 * 24);
+    }
+    if (gEnergy.day[0].day != day) {
+        for (int x = 0; x < MAX_NUM_ENERGY_MODES; x++) {
+            LOG(EVENT_ENERGY_MODE, x);
+            LOG(EVENT_ENERGY_MODE_DAY_UAH, uAh(gEnergy.day[0].chargeMAms[x]));
+        }
+        memmove(&gEnergy.day[1], &gEnergy.day[0], sizeof (gEnergy.day) - sizeof (gEnergy.day[0]));
+        memset(&gEnergy.day[0], 0, sizeof (gEnergy.day[0]));
+        gEnergy.day[0].day = day;
+    }
+    gEnergy.day[0].chargeMAms[mode] += chargeMAms;
+    gEnergy.crc = energyCrc();
+}
+
+// Sample the battery current, attributing the charge used
+// since the last sample to the current mode; gEnergyMutex
+// must be locked.
+static void energySampleLocked()
+{
+    uint32_t nowUs = us_ticker_read();
+    int32_t currentMA;
+    int32_t averageMA;
+    EnergyMode mode = gEnergyMode;
+
+    if (isAudioStreamingEnabled()) {
+        mode = ENERGY_MODE_STREAMING;
+    } else if (isGnssOn()) {
+        mode = ENERGY_MODE_GNSS_ON;
+    }
+
+    if (getBatteryCurrent(&currentMA)) {
+        if (gEnergyLastSampleValid) {
+            // Negative is discharge
+            averageMA = (currentMA + gEnergyLastCurrentMA) / 2;
+            if (averageMA < 0) {
+                energyAdd(mode, (uint64_t) -averageMA * ((nowUs - gEnergyLastSampleUs) / 1000));
+            }
+        }
+        gEnergyLastCurrentMA = currentMA;
+        gEnergyLastSampleUs = nowUs;
+        gEnergyLastSampleValid = true;
+    } else {
+        gEnergyLastSampleValid = false;
+    }
+}
+
+// Sample the battery current; called on the event queue.
+static void energySample()
+{
+    gEnergyMutex.lock();
+    energySampleLocked();
+    gEnergyMutex.unlock();
+}
+
+// Write the energy used on previous days into a buffer:
+// for each day, most recent first, separated by ';',
+// the day (days since 1970, 0 if not known) then, comma
+// separated, the mAh used in each EnergyMode.
+static char *pEnergyDaysString(char *pBuf, int lenBuf)
+{
+    int x = 0;
+    unsigned int used;
+
+    *pBuf = 0;
+    for (int y = 1; (y < ENERGY_NUM_DAYS) && (x < lenBuf); y++) {
+        x += snprintf(pBuf + x, lenBuf - x, "%s%u", y > 1 ? ";" : "",
+                      (unsigned int) gEnergy.day[y].day);
+        for (int z = 0; (z < MAX_NUM_ENERGY_MODES) && (x < lenBuf); z++) {
+            used = uAh(gEnergy.day[y].chargeMAms[z]);
+            x += snprintf(pBuf + x, lenBuf - x, ",%u.%03u", used / 1000, used % 1000);
+        }
+    }
+
+    return pBuf;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: HOOK FOR ENERGY M2M C++ OBJECT
+ * -------------------------------------------------------------- */
+
+// Callback that gets data for the IocM2mEnergy object.
+static bool getEnergyData(IocM2mEnergy::Energy *pData)
+{
+    char *pBuf = new char[ENERGY_DAYS_MAX_LEN_STRING];
+
+    gEnergyMutex.lock();
+    energySampleLocked();
+    for (int x = 0; x < MAX_NUM_ENERGY_MODES; x++) {
+        pData->todayMAh[x] = (float) uAh(gEnergy.day[0].chargeMAms[x]) / 1000;
+    }
+    pData->previousDays = pEnergyDaysString(pBuf, ENERGY_DAYS_MAX_LEN_STRING);
+    gEnergyMutex.unlock();
+    delete[] pBuf;
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: ENERGY ACCOUNTING
+ * -------------------------------------------------------------- */
+
+// Initialise energy accounting on wake-up.
+void initEnergy()
+{
+    gEnergyMutex.lock();
+    // The records are only lost if backup SRAM has been,
+    // e.g. at power on
+    if (gEnergy.crc != energyCrc()) {
+        LOG(EVENT_ENERGY_RESET, gEnergy.crc);
+        memset(&gEnergy, 0, sizeof (gEnergy));
+        gEnergy.sleepMode = -1;
+        gEnergy.crc = energyCrc();
+    }
+    gEnergyMode = ENERGY_MODE_INITIALISATION;
+    gEnergyMutex.unlock();
+    energyLeaveSleep();
+}
+
+// Start sampling the battery current.
+void startEnergySampling()
+{
+    if (gEnergySampleEventId == 0) {
+        gEnergySampleEventId = eventQueueCallEvery("energy", ENERGY_SAMPLE_INTERVAL_SECONDS * 1000,
+                                                   callback(&energySample));
+    }
+}
+
+// Stop sampling the battery current.
+void stopEnergySampling()
+{
+    if (gEnergySampleEventId != 0) {
+        pGetEventQueue()->cancel(gEnergySampleEventId);
+        gEnergySampleEventId = 0;
+    }
+    energySample();
+}
+
+// Set the mode energy use is attributed to while awake.
+void setEnergyMode(EnergyMode mode)
+{
+    gEnergyMutex.lock();
+    energySampleLocked();
+    gEnergyMode = mode;
+    gEnergyMutex.unlock();
+}
+
+// Note that we are about to sleep.
+void energyEnterSleep(EnergyMode mode)
+{
+    int32_t capacityMAh;
+
+    gEnergyMutex.lock();
+    energySampleLocked();
+    gEnergy.sleepMode = -1;
+    if (getBatteryRemainingCapacity(&capacityMAh)) {
+        gEnergy.sleepMode = mode;
+        gEnergy.sleepCapacityMAh = capacityMAh;
+    }
+    gEnergy.crc = energyCrc();
+    gEnergyLastSampleValid = false;
+    gEnergyMutex.unlock();
+}
+
+// Note that we have woken up.
+void energyLeaveSleep()
+{
+    int32_t capacityMAh;
+
+    gEnergyMutex.lock();
+    if ((gEnergy.sleepMode >= 0) && (gEnergy.sleepMode < MAX_NUM_ENERGY_MODES) &&
+        getBatteryRemainingCapacity(&capacityMAh)) {
+        if (capacityMAh < gEnergy.sleepCapacityMAh) {
+            energyAdd((EnergyMode) gEnergy.sleepMode,
+                      (uint64_t) (gEnergy.sleepCapacityMAh - capacityMAh) * ENERGY_MA_MS_PER_MAH);
+        }
+    }
+    gEnergy.sleepMode = -1;
+    gEnergy.crc = energyCrc();
+    gEnergyLastSampleValid = false;
+    energySampleLocked();
+    gEnergyMutex.unlock();
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: INITIALISATION
+ * -------------------------------------------------------------- */
+
+// Initialise the energy object.
+IocM2mEnergy *pInitEnergy()
+{
+    gpM2mObject = new IocM2mEnergy(getEnergyData, MBED_CONF_APP_OBJECT_DEBUG_ON);
+
+    return gpM2mObject;
+}
+
+// Shut down the energy object.
+void deinitEnergy()
+{
+    unsigned int used;
+
+    delete gpM2mObject;
+    gpM2mObject = NULL;
+
+    gEnergyMutex.lock();
+    printf("Battery charge used today (mAh):");
+    for (int x = 0; x < MAX_NUM_ENERGY_MODES; x++) {
+        used = uAh(gEnergy.day[0].chargeMAms[x]);
+        printf(" %u.%03u", used / 1000, used % 1000);
+    }
+    printf(".\n");
+    gEnergyMutex.unlock();
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: ENERGY M2M C++ OBJECT
+ * -------------------------------------------------------------- */
+
+/** The definition of the object (C++ pre C11 won't let this const
+ * initialisation be done in the class definition).
+ */
+const M2MObjectHelper::DefObject IocM2mEnergy::_defObject =
+    {0, "32774", 7,
+        ENERGY_MODE_INITIALISATION, RESOURCE_NUMBER_ENERGY_TODAY, "cumulative power", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        ENERGY_MODE_READY, RESOURCE_NUMBER_ENERGY_TODAY, "cumulative power", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        ENERGY_MODE_STREAMING, RESOURCE_NUMBER_ENERGY_TODAY, "cumulative power", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        ENERGY_MODE_GNSS_ON, RESOURCE_NUMBER_ENERGY_TODAY, "cumulative power", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        ENERGY_MODE_REGISTERED_SLEEP, RESOURCE_NUMBER_ENERGY_TODAY, "cumulative power", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        ENERGY_MODE_STANDBY, RESOURCE_NUMBER_ENERGY_TODAY, "cumulative power", M2MResourceBase::FLOAT, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_ENERGY_PREVIOUS_DAYS, "string", M2MResourceBase::STRING, true, M2MBase::GET_ALLOWED, NULL
+    };
+
+// Constructor.
+IocM2mEnergy::IocM2mEnergy(Callback<bool(Energy *)> getCallback,
+                           bool debugOn)
+             :M2MObjectHelper(&_defObject, NULL, NULL, debugOn)
+{
+    _getCallback = getCallback;
+
+    // Make the object and its resources
+    MBED_ASSERT(makeObject());
+
+    // Update the values held in the resources
+    updateObservableResources();
+
+    printf("IocM2mEnergy: object initialised.\n");
+}
+
+// Destructor.
+IocM2mEnergy::~IocM2mEnergy()
+{
+}
+
+// Update the observable data for this object.
+void IocM2mEnergy::updateObservableResources()
+{
+    Energy data;
+
+    // Update the data
+    if (_getCallback) {
+        if (_getCallback(&data)) {
+            // Set the values in the resources based on the new data
+            for (int x = 0; x < MAX_NUM_ENERGY_MODES; x++) {
+                MBED_ASSERT(setResourceValue(data.todayMAh[x], RESOURCE_NUMBER_ENERGY_TODAY, x));
+            }
+            MBED_ASSERT(setResourceValue(data.previousDays, RESOURCE_NUMBER_ENERGY_PREVIOUS_DAYS));
+        }
+    }
+}
+
+// End of file
@@ -0,0 +1,166 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+#include "MbedCloudClient.h"
+#include "m2m_object_helper.h"
+
+#ifndef _IOC_ENERGY_
+#define _IOC_ENERGY_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The interval at which the battery current is sampled.
+#define ENERGY_SAMPLE_INTERVAL_SECONDS 10
+
+// The number of days of energy use kept, including today.
+#define ENERGY_NUM_DAYS 7
+
+// The maximum length of the string form of the energy use
+// on previous days (including terminator): a day number and
+// then up to 12 characters per mode, per day.
+#define ENERGY_DAYS_MAX_LEN_STRING ((ENERGY_NUM_DAYS - 1) * (8 + MAX_NUM_ENERGY_MODES * 12))
+
+/* ----------------------------------------------------------------
+ * GENERAL TYPES
+ * -------------------------------------------------------------- */
+
+// The modes that energy use is attributed to; streaming takes
+// precedence over GNSS on, which takes precedence over
+// initialisation or ready.
+typedef enum {
+    ENERGY_MODE_INITIALISATION,
+    ENERGY_MODE_READY,
+    ENERGY_MODE_STREAMING,
+    ENERGY_MODE_GNSS_ON,
+    ENERGY_MODE_REGISTERED_SLEEP,
+    ENERGY_MODE_STANDBY,
+    MAX_NUM_ENERGY_MODES
+} EnergyMode;
+
+/* ----------------------------------------------------------------
+ * ENERGY M2M C++ OBJECT DEFINITION
+ * -------------------------------------------------------------- */
+
+/** Battery charge used in each mode, per day.
+ * Implementation is as a custom object, I have chosen
+ * ID urn:oma:lwm2m:x:32774.
+ */
+class IocM2mEnergy : public M2MObjectHelper {
+public:
+
+    /** The energy information (with types that match
+     * the LWM2M types).
+     */
+    typedef struct {
+        float todayMAh[MAX_NUM_ENERGY_MODES]; ///< Indexed by EnergyMode.
+        String previousDays;                  ///< See pEnergyDaysString()
+                                              /// in ioc_energy.cpp.
+    } Energy;
+
+    /** Constructor.
+     *
+     * @param getCallback callback to get energy information.
+     * @param debugOn     true if you want debug prints, otherwise false.
+     */
+    IocM2mEnergy(Callback<bool(Energy *)> getCallback,
+                 bool debugOn = false);
+
+    /** Destructor.
+     */
+    ~IocM2mEnergy();
+
+    /** Update the observable resources (using getCallback()).
+     */
+    void updateObservableResources();
+
+protected:
+
+    /** The resource number for todayMAh, a multi-instance
+     * Cumulative Active Power resource for the sake of
+     * anything better, the instance being the EnergyMode
+     * and the units mAh.
+     */
+#   define RESOURCE_NUMBER_ENERGY_TODAY "5805"
+
+    /** The resource number for previousDays, a Text
+     * resource.
+     */
+#   define RESOURCE_NUMBER_ENERGY_PREVIOUS_DAYS "5527"
+
+    /** Definition of this object.
+     */
+    static const DefObject _defObject;
+
+    /** Callback to get energy values.
+     */
+    Callback<bool(Energy *)> _getCallback;
+};
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Initialise energy accounting on wake-up, attributing
+ * the charge used while in standby, if that is where we
+ * have been; the battery gauge must have been initialised.
+ * The energy records are retained through standby and OFF
+ * and are reset here only if they are not valid, e.g. after
+ * a power on.
+ */
+void initEnergy();
+
+/** Start sampling the battery current on the event queue,
+ * which must be running.
+ */
+void startEnergySampling();
+
+/** Stop sampling the battery current.
+ */
+void stopEnergySampling();
+
+/** Set the mode that energy use is attributed to while
+ * awake.
+ * @param mode ENERGY_MODE_INITIALISATION or ENERGY_MODE_READY.
+ */
+void setEnergyMode(EnergyMode mode);
+
+/** Note that we are about to sleep, or go OFF: the charge
+ * used while asleep is attributed to the given mode once
+ * energyLeaveSleep() or, after standby, initEnergy() is
+ * called.
+ * @param mode ENERGY_MODE_REGISTERED_SLEEP or ENERGY_MODE_STANDBY.
+ */
+void energyEnterSleep(EnergyMode mode);
+
+/** Note that we have woken from REGISTERED_SLEEP.
+ */
+void energyLeaveSleep();
+
+/** Initialise the energy object.
+ *
+ * @return  a pointer to the IocM2mEnergy object.
+ */
+IocM2mEnergy *pInitEnergy();
+
+/** Shut down the energy object.
+ */
+void deinitEnergy();
+
+#endif // _IOC_ENERGY_
+
+// End of file
@@ -0,0 +1,278 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "MbedCloudClient.h"
+#include "m2m_object_helper.h"
+#include "log.h"
+
+#include "ioc_diagnostics.h"
+#include "ioc_temperature_battery.h"
+#include "ioc_utils.h"
+#include "ioc_history.h"
+
+/* This file implements the LWM2M history object: a ring of
+ * per-minute aggregates of the diagnostics, which, unlike
+ * the diagnostics object, is not reset when streaming starts,
+ * so that a server can fetch the last few hours a page at a
+ * time whenever it wishes rather than polling every minute.
+ */
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The history records; gHistoryNext is where the next
+// record will be written and gHistoryNumRecords is the
+// number of valid records.
+// Note: not in CCMRAM, which the datagram storage and the
+// log buffer all but fill.
+static HistoryRecord gHistory[HISTORY_NUM_RECORDS];
+static int gHistoryNext = 0;
+static int gHistoryNumRecords = 0;
+
+// The page of history selected by the server.
+static int gHistoryPage = 0;
+
+// The event queue ID of the history recording event.
+static int gHistoryEventId = 0;
+
+// The running totals at the last record, used to
+// work out the amount in each interval.
+static unsigned int gNumAudioBytesSentLast = 0;
+static unsigned int gNumAudioSendFailuresLast = 0;
+
+// The LWM2M object.
+static IocM2mHistory *gpM2mObject = NULL;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: MISC
+ * -------------------------------------------------------------- */
+
+// Saturate a value into a uint16_t.
+static uint16_t saturateU16(unsigned int value)
+{
+    if (value > 0xFFFF) {
+        value = 0xFFFF;
+    }
+
+    return (uint16_t) value;
+}
+
+// Make a history record; called on the event queue.
+static void historyRecord()
+{
+    HistoryRecord *pRecord = &gHistory[gHistoryNext];
+    unsigned int numAudioBytesSent = getNumAudioBytesSent();
+    unsigned int numAudioSendFailures = getNumAudioSendFailures();
+    int32_t batteryCurrentMA = 0;
+
+    pRecord->time = (uint32_t) time(NULL);
+    pRecord->throughputKbits = saturateU16(((numAudioBytesSent - gNumAudioBytesSentLast) << 3) /
+                                           (HISTORY_INTERVAL_SECONDS * 1000));
+    gNumAudioBytesSentLast = numAudioBytesSent;
+    // The send failure count is zeroed when streaming starts
+    if (numAudioSendFailures < gNumAudioSendFailuresLast) {
+        gNumAudioSendFailuresLast = 0;
+    }
+    pRecord->numSendFailures = saturateU16(numAudioSendFailures - gNumAudioSendFailuresLast);
+    gNumAudioSendFailuresLast = numAudioSendFailures;
+    pRecord->datagramQueueMax = saturateU16(takeAudioDatagramQueueMaxInterval());
+    getBatteryCurrent(&batteryCurrentMA);
+    pRecord->batteryCurrentMA = (int16_t) batteryCurrentMA;
+
+    gHistoryNext++;
+    if (gHistoryNext >= HISTORY_NUM_RECORDS) {
+        gHistoryNext = 0;
+    }
+    if (gHistoryNumRecords < HISTORY_NUM_RECORDS) {
+        gHistoryNumRecords++;
+    }
+}
+
+// Write a page of history into a buffer.  The page starts
+// with the Unix time of its most recent record, followed
+// by the records, most recent first, separated by ';',
+// each being "a,k,f,q,i" where a is the age of the record
+// in seconds relative to the time at the start of the page,
+// k the throughput in kbits/s, f the number of send
+// failures, q the worst datagram queue depth and i the
+// battery current in mA.  An empty string means the page is
+// empty.
+static char *pHistoryPageString(int page, char *pBuf, int lenBuf)
+{
+    int x = 0;
+    int index;
+    uint32_t startTime = 0;
+    const HistoryRecord *pRecord;
+
+    *pBuf = 0;
+    for (int y = page * HISTORY_NUM_RECORDS_PER_PAGE;
+         (y < (page + 1) * HISTORY_NUM_RECORDS_PER_PAGE) && (y < gHistoryNumRecords) && (x < lenBuf);
+         y++) {
+        index = gHistoryNext - 1 - y;
+        if (index < 0) {
+            index += HISTORY_NUM_RECORDS;
+        }
+        pRecord = &gHistory[index];
+        if (x == 0) {
+            startTime = pRecord->time;
+            x += snprintf(pBuf + x, lenBuf - x, "%u", (unsigned int) startTime);
+        }
+        if (x < lenBuf) {
+            x += snprintf(pBuf + x, lenBuf - x, ";%d,%u,%u,%u,%d",
+                          (int) (startTime - pRecord->time), pRecord->throughputKbits,
+                          pRecord->numSendFailures, pRecord->datagramQueueMax,
+                          pRecord->batteryCurrentMA);
+        }
+    }
+
+    return pBuf;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: HOOKS FOR HISTORY M2M C++ OBJECT
+ * -------------------------------------------------------------- */
+
+// Callback that selects the page of history.
+static void setHistoryPage(int64_t page)
+{
+    if ((page < 0) || (page * HISTORY_NUM_RECORDS_PER_PAGE >= HISTORY_NUM_RECORDS)) {
+        page = 0;
+    }
+    gHistoryPage = (int) page;
+}
+
+// Callback that gets history data for the IocM2mHistory object.
+static bool getHistoryData(IocM2mHistory::History *pData)
+{
+    char *pBuf = new char[HISTORY_PAGE_MAX_LEN_STRING];
+
+    pData->page = gHistoryPage;
+    pData->pageData = pHistoryPageString(gHistoryPage, pBuf, HISTORY_PAGE_MAX_LEN_STRING);
+    pData->numRecords = gHistoryNumRecords;
+    delete[] pBuf;
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: INITIALISATION
+ * -------------------------------------------------------------- */
+
+// Initialise the history object.
+IocM2mHistory *pInitHistory()
+{
+    gNumAudioBytesSentLast = getNumAudioBytesSent();
+    gNumAudioSendFailuresLast = getNumAudioSendFailures();
+    takeAudioDatagramQueueMaxInterval();
+    if (gHistoryEventId == 0) {
+        gHistoryEventId = eventQueueCallEvery("history", HISTORY_INTERVAL_SECONDS * 1000, callback(&historyRecord));
+    }
+
+    gpM2mObject = new IocM2mHistory(setHistoryPage, getHistoryData, MBED_CONF_APP_OBJECT_DEBUG_ON);
+
+    return gpM2mObject;
+}
+
+// Shut down the history object.
+void deinitHistory()
+{
+    if (gHistoryEventId != 0) {
+        pGetEventQueue()->cancel(gHistoryEventId);
+        gHistoryEventId = 0;
+    }
+
+    delete gpM2mObject;
+    gpM2mObject = NULL;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: HISTORY M2M C++ OBJECT
+ * -------------------------------------------------------------- */
+
+/** The definition of the object (C++ pre C11 won't let this const
+ * initialisation be done in the class definition).
+ */
+const M2MObjectHelper::DefObject IocM2mHistory::_defObject =
+    {0, "32772", 3,
+        -1, RESOURCE_NUMBER_HISTORY_PAGE, "mode", M2MResourceBase::INTEGER, false, M2MBase::GET_PUT_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_HISTORY_PAGE_DATA, "string", M2MResourceBase::STRING, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_HISTORY_NUM_RECORDS, "counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL
+    };
+
+// Constructor.
+IocM2mHistory::IocM2mHistory(Callback<void(int64_t)> setPageCallback,
+                             Callback<bool(History *)> getCallback,
+                             bool debugOn)
+              :M2MObjectHelper(&_defObject,
+                               value_updated_callback(this, &IocM2mHistory::objectUpdated),
+                               NULL,
+                               debugOn)
+{
+    _setPageCallback = setPageCallback;
+    _getCallback = getCallback;
+
+    // Make the object and its resources
+    MBED_ASSERT(makeObject());
+
+    // Update the values held in the resources
+    updateObservableResources();
+
+    printf("IocM2mHistory: object initialised.\n");
+}
+
+// Destructor.
+IocM2mHistory::~IocM2mHistory()
+{
+}
+
+// Callback when the object is updated by the server.
+void IocM2mHistory::objectUpdated(const char *pResourceName)
+{
+    int64_t page;
+
+    printf("IocM2mHistory: resource \"%s\" has been updated.\n", pResourceName);
+
+    MBED_ASSERT(getResourceValue(&page, RESOURCE_NUMBER_HISTORY_PAGE));
+
+    printf("IocM2mHistory: page %lld selected.\n", page);
+
+    if (_setPageCallback) {
+        _setPageCallback(page);
+    }
+
+    // Bring the page data into line with the new page
+    updateObservableResources();
+}
+
+// Update the observable data for this object.
+void IocM2mHistory::updateObservableResources()
+{
+    History data;
+
+    // Update the data
+    if (_getCallback) {
+        if (_getCallback(&data)) {
+            // Set the values in the resources based on the new data
+            MBED_ASSERT(setResourceValue(data.page, RESOURCE_NUMBER_HISTORY_PAGE));
+            MBED_ASSERT(setResourceValue(data.pageData, RESOURCE_NUMBER_HISTORY_PAGE_DATA));
+            MBED_ASSERT(setResourceValue(data.numRecords, RESOURCE_NUMBER_HISTORY_NUM_RECORDS));
+        }
+    }
+}
+
+// End of file
@@ -0,0 +1,148 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+#include "MbedCloudClient.h"
+#include "m2m_object_helper.h"
+
+#ifndef _IOC_HISTORY_
+#define _IOC_HISTORY_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The interval at which history records are made.
+#define HISTORY_INTERVAL_SECONDS 60
+
+// The number of history records kept (four hours' worth).
+#define HISTORY_NUM_RECORDS 240
+
+// The number of history records in a page of the
+// history object.
+#define HISTORY_NUM_RECORDS_PER_PAGE 30
+
+// The maximum length of the string form of a page of
+// history (including terminator): a time stamp and then
+// up to 40 characters per record.
+#define HISTORY_PAGE_MAX_LEN_STRING (12 + HISTORY_NUM_RECORDS_PER_PAGE * 40)
+
+/* ----------------------------------------------------------------
+ * GENERAL TYPES
+ * -------------------------------------------------------------- */
+
+// One history record, aggregated over HISTORY_INTERVAL_SECONDS.
+typedef struct {
+    uint32_t time;                  ///< Unix time at the end of the interval.
+    uint16_t throughputKbits;       ///< Average audio throughput.
+    uint16_t numSendFailures;       ///< Audio send failures in the interval.
+    uint16_t datagramQueueMax;      ///< Worst audio datagram queue depth.
+    int16_t batteryCurrentMA;       ///< Battery current at the end of the interval.
+} HistoryRecord;
+
+/* ----------------------------------------------------------------
+ * HISTORY M2M C++ OBJECT DEFINITION
+ * -------------------------------------------------------------- */
+
+/** Per-minute history of diagnostics, read a page at a time.
+ * Implementation is as a custom object, I have chosen
+ * ID urn:oma:lwm2m:x:32772: the server writes the page it
+ * wants to the page resource and reads the page data resource.
+ */
+class IocM2mHistory : public M2MObjectHelper {
+public:
+
+    /** The history information (with types that match
+     * the LWM2M types).
+     */
+    typedef struct {
+        int64_t page;       ///< 0 is the most recent page.
+        String pageData;    ///< The records of the page, see
+                            /// pHistoryPageString() in ioc_history.cpp.
+        int64_t numRecords; ///< The number of records held.
+    } History;
+
+    /** Constructor.
+     *
+     * @param setPageCallback callback to select the page.
+     * @param getCallback     callback to get the history information.
+     * @param debugOn         true if you want debug prints, otherwise false.
+     */
+    IocM2mHistory(Callback<void(int64_t)> setPageCallback,
+                  Callback<bool(History *)> getCallback,
+                  bool debugOn = false);
+
+    /** Destructor.
+     */
+    ~IocM2mHistory();
+
+    /** Callback for when the object is updated, which
+     * will select the page using setPageCallback().
+     *
+     * @param pResourceName the resource that was updated.
+     */
+    void objectUpdated(const char *pResourceName);
+
+    /** Update the observable resources (using getCallback()).
+     */
+    void updateObservableResources();
+
+protected:
+
+    /** The resource number for page, a Mode resource
+     * for the sake of anything better.
+     */
+#   define RESOURCE_NUMBER_HISTORY_PAGE "5526"
+
+    /** The resource number for pageData, a Text resource.
+     */
+#   define RESOURCE_NUMBER_HISTORY_PAGE_DATA "5527"
+
+    /** The resource number for numRecords, a Counter resource.
+     */
+#   define RESOURCE_NUMBER_HISTORY_NUM_RECORDS "5534"
+
+    /** Definition of this object.
+     */
+    static const DefObject _defObject;
+
+    /** Callback to select the page.
+     */
+    Callback<void(int64_t)> _setPageCallback;
+
+    /** Callback to get history values.
+     */
+    Callback<bool(History *)> _getCallback;
+};
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Initialise the history object and start recording
+ * history on the event queue, which must be running.
+ *
+ * @return  a pointer to the IocM2mHistory object.
+ */
+IocM2mHistory *pInitHistory();
+
+/** Stop recording history and shut down the history object;
+ * the records are retained.
+ */
+void deinitHistory();
+
+#endif // _IOC_HISTORY_
+
+// End of file
@@ -22,6 +22,7 @@
 #include "ioc_cloud_client_dm.h"
 #include "ioc_diagnostics.h"
 #include "ioc_location.h"
+#include "ioc_trace.h"
 #include "ioc_utils.h"
 
 /* This file implements the LWM2M location object.
@@ -140,7 +141,9 @@ static bool gnssUpdate(IocM2mLocation::Location *location)
     int year;
     int months;
     int gpsTime = 0;
+    TraceSpan span;
 
+    traceSpanStart(&span);
     if (gpGnss) {
         // See ublox7-V14_ReceiverDescrProtSpec section 39.7 (NAV-PVT)
         // Send length is 0 bytes of payload + 6 bytes header + 2 bytes CRC
@@ -226,6 +229,8 @@ static bool gnssUpdate(IocM2mLocation::Location *location)
         }
     }
 
+    traceSpanEnd(&span, TRACE_SPAN_GNSS_UPDATE);
+
     return success;
 }
 
@@ -255,6 +260,8 @@ IocM2mLocation *pInitLocation()
 // Start the GNSS chip.
 bool startGnss()
 {
+    HeapTag heapTag = heapTagStart(HEAP_TAG_GNSS);
+
     flash();
     LOG(EVENT_GNSS_START, 0);
     printf("Starting GNSS...\n");
@@ -266,19 +273,24 @@ bool startGnss()
         delete gpGnss;
         gpGnss = NULL;
     }
-    
+    heapTagStop(heapTag);
+
     return (gpGnss != NULL);
 }
 
 // Shut down the GNSS chip.
 void stopGnss()
 {
+    HeapTag heapTag;
+
     if (gpGnss != NULL) {
         flash();
         LOG(EVENT_GNSS_STOP, 0);
         printf ("Stopping GNSS...\n");
+        heapTag = heapTagStart(HEAP_TAG_GNSS);
         delete gpGnss;
         gpGnss = NULL;
+        heapTagStop(heapTag);
     }
 }
 
@@ -0,0 +1,414 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "log.h"
+
+#include "ioc_utils.h"
+#include "ioc_log_compact.h"
+#include "ioc_log_index.h"
+
+/* This file implements compaction of log files into the format
+ * described in ioc_log_compact.h.  The logging library writes
+ * raw LogEntry structures to file and there is no way to change
+ * that, so instead log files are compacted once they are no
+ * longer being written to, which is in time for them to be
+ * uploaded.
+ */
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A log entry as it was encoded, for matching runs.
+typedef struct {
+    uint32_t index;          // In the dictionary.
+    uint32_t parameterDelta;
+} LogCompactHistory;
+
+// The state of the encoder.
+typedef struct {
+    int numEvents;
+    int32_t event[LOG_COMPACT_MAX_NUM_EVENTS];         // The dictionary.
+    uint32_t lastParameter[LOG_COMPACT_MAX_NUM_EVENTS];
+    uint32_t lastTimestamp;
+    LogCompactHistory history[LOG_COMPACT_MAX_PATTERN]; // Most recent last.
+    int numHistory;
+} LogCompactState;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: ENCODING
+ * -------------------------------------------------------------- */
+
+// Zigzag encode a difference, so that small negative numbers
+// make small varints.
+static uint32_t zigzag(uint32_t difference)
+{
+    return (difference << 1) ^ (uint32_t) ((int32_t) difference >> 31);
+}
+
+// Write a varint.
+static bool writeVarint(FILE *pFile, uint32_t value)
+{
+    uint8_t buf[5];
+    int x = 0;
+
+    do {
+        buf[x] = value & 0x7f;
+        value >>= 7;
+        if (value != 0) {
+            buf[x] |= 0x80;
+        }
+        x++;
+    } while (value != 0);
+
+    return (fwrite(buf, 1, x, pFile) == (size_t) x);
+}
+
+// Find an event in the dictionary, -1 if it's not there.
+static int findEvent(const LogCompactState *pState, int32_t event)
+{
+    for (int x = 0; x < pState->numEvents; x++) {
+        if (pState->event[x] == event) {
+            return x;
+        }
+    }
+
+    return -1;
+}
+
+// Update the state with an entry that has been encoded.
+static void addEntry(LogCompactState *pState, const LogEntry *pEntry, int index)
+{
+    LogCompactHistory history;
+
+    history.index = index;
+    history.parameterDelta = (uint32_t) pEntry->parameter - pState->lastParameter[index];
+    pState->lastParameter[index] = (uint32_t) pEntry->parameter;
+    pState->lastTimestamp = (uint32_t) pEntry->timestamp;
+
+    if (pState->numHistory < LOG_COMPACT_MAX_PATTERN) {
+        pState->numHistory++;
+    } else {
+        memmove(&pState->history[0], &pState->history[1],
+                sizeof (pState->history) - sizeof (pState->history[0]));
+    }
+    pState->history[pState->numHistory - 1] = history;
+}
+
+// Return how many of the given entries repeat the
+// pattern of the last patternLength entries.
+static int matchLength(const LogCompactState *pState, const LogEntry *pEntries,
+                       int numEntries, int patternLength)
+{
+    const LogCompactHistory *pPattern = &pState->history[pState->numHistory - patternLength];
+    const LogCompactHistory *pRef;
+    uint32_t lastParameter[LOG_COMPACT_MAX_PATTERN];
+    int x;
+
+    // The pattern covers at most patternLength events, so that
+    // is all the last parameters that can change in a match
+    for (x = 0; x < patternLength; x++) {
+        lastParameter[x] = pState->lastParameter[pPattern[x].index];
+    }
+
+    for (x = 0; x < numEntries; x++) {
+        pRef = &pPattern[x % patternLength];
+        if ((pState->event[pRef->index] != (int32_t) pEntries[x].event) ||
+            ((uint32_t) pEntries[x].parameter - lastParameter[x % patternLength] != pRef->parameterDelta)) {
+            break;
+        }
+        // Carry the parameter to every slot in the pattern
+        // that holds the same event
+        for (int y = 0; y < patternLength; y++) {
+            if (pPattern[y].index == pRef->index) {
+                lastParameter[y] = (uint32_t) pEntries[x].parameter;
+            }
+        }
+    }
+
+    return x;
+}
+
+// Encode a chunk of log entries.
+// Note: here be multiple return statements.
+static bool encodeEntries(LogCompactState *pState, const LogEntry *pEntries,
+                          int numEntries, FILE *pFile)
+{
+    int covered;
+    int patternLength;
+    int numRepeats;
+    int length;
+    int index;
+    int x = 0;
+
+    while (x < numEntries) {
+        covered = 0;
+        patternLength = 0;
+        numRepeats = 0;
+        for (int y = 1; y <= pState->numHistory; y++) {
+            length = matchLength(pState, pEntries + x, numEntries - x, y);
+            if ((length / y) * y > covered) {
+                covered = (length / y) * y;
+                patternLength = y;
+                numRepeats = length / y;
+            }
+        }
+
+        if (covered >= 2) {
+            // A run: head, repeat count then the timestamps
+            if (!writeVarint(pFile, (patternLength << 2) | 2) ||
+                !writeVarint(pFile, numRepeats)) {
+                return false;
+            }
+            for (int y = 0; y < covered; y++) {
+                if (!writeVarint(pFile, zigzag((uint32_t) pEntries[x].timestamp - pState->lastTimestamp))) {
+                    return false;
+                }
+                addEntry(pState, &pEntries[x], pState->history[pState->numHistory - patternLength].index);
+                x++;
+            }
+        } else {
+            index = findEvent(pState, (int32_t) pEntries[x].event);
+            if (index < 0) {
+                if (pState->numEvents >= LOG_COMPACT_MAX_NUM_EVENTS) {
+                    return false;
+                }
+                index = pState->numEvents;
+                pState->event[index] = (int32_t) pEntries[x].event;
+                pState->lastParameter[index] = 0;
+                pState->numEvents++;
+                if (!writeVarint(pFile, ((uint32_t) pEntries[x].event << 2) | 1)) {
+                    return false;
+                }
+            }
+            if (!writeVarint(pFile, index << 2) ||
+                !writeVarint(pFile, zigzag((uint32_t) pEntries[x].timestamp - pState->lastTimestamp)) ||
+                !writeVarint(pFile, zigzag((uint32_t) pEntries[x].parameter - pState->lastParameter[index]))) {
+                return false;
+            }
+            addEntry(pState, &pEntries[x], index);
+            x++;
+        }
+    }
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: FILES
+ * -------------------------------------------------------------- */
+
+// Return the size of a file, -1 on error.
+static long fileSize(FILE *pFile)
+{
+    long size = -1;
+
+    if (fseek(pFile, 0, SEEK_END) == 0) {
+        size = ftell(pFile);
+    }
+    if (fseek(pFile, 0, SEEK_SET) != 0) {
+        size = -1;
+    }
+
+    return size;
+}
+
+// Return true if a file is a raw log file which needs
+// compacting; it may end in part of an entry, e.g. if it was
+// open when the device was reset.
+static bool isRawLogFile(const char *pPath)
+{
+    FILE *pFile = fopen(pPath, "rb");
+    char magic[sizeof (LOG_COMPACT_MAGIC) - 1];
+    long size;
+    bool isRaw = false;
+
+    if (pFile != NULL) {
+        size = fileSize(pFile);
+        if ((size > 0) &&
+            ((fread(magic, 1, sizeof (magic), pFile) != sizeof (magic)) ||
+             (memcmp(magic, LOG_COMPACT_MAGIC, sizeof (magic)) != 0))) {
+            isRaw = true;
+        }
+        fclose(pFile);
+    }
+
+    return isRaw;
+}
+
+// Write the compact log file header.
+static bool writeHeader(FILE *pFile)
+{
+    uint8_t header[LOG_COMPACT_HEADER_SIZE];
+    uint32_t firstAppEvent = EVENT_SYSTEM_START;
+
+    memset(header, 0, sizeof (header));
+    memcpy(header, LOG_COMPACT_MAGIC, sizeof (LOG_COMPACT_MAGIC) - 1);
+    header[4] = LOG_COMPACT_VERSION;
+    for (int x = 0; x < 4; x++) {
+        header[8 + x] = (uint8_t) (firstAppEvent >> (x * 8));
+    }
+
+    return (fwrite(header, 1, sizeof (header), pFile) == sizeof (header));
+}
+
+// Write the temporary file path for a log file into pBuf.
+static char *pTemporaryPath(const char *pPath, char *pBuf, int lenBuf)
+{
+    const char *pSlash = strrchr(pPath, '/');
+    int lenDir = 0;
+
+    if (pSlash != NULL) {
+        lenDir = pSlash - pPath + 1;
+    }
+    snprintf(pBuf, lenBuf, "%.*s%s", lenDir, pPath, LOG_COMPACT_TEMPORARY_FILE_NAME);
+
+    return pBuf;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Compact a raw log file in place.
+// Note: here be multiple return statements.
+bool compactLogFile(const char *pPath)
+{
+    char *pTempPath;
+    LogCompactState *pState;
+    LogEntry *pEntries;
+    FILE *pRawFile;
+    FILE *pCompactFile;
+    long rawSize = 0;
+    long compactSize = 0;
+    size_t numEntries;
+    bool success;
+
+    if (isCompactLogFile(pPath)) {
+        return true;
+    }
+    if (!isRawLogFile(pPath)) {
+        return false;
+    }
+
+    pTempPath = new char[LOG_COMPACT_MAX_LEN_PATH];
+    pState = new LogCompactState;
+    pEntries = new LogEntry[LOG_COMPACT_CHUNK_NUM_ENTRIES];
+    memset(pState, 0, sizeof (*pState));
+    pTemporaryPath(pPath, pTempPath, LOG_COMPACT_MAX_LEN_PATH);
+
+    success = false;
+    pRawFile = fopen(pPath, "rb");
+    pCompactFile = fopen(pTempPath, "wb");
+    if ((pRawFile != NULL) && (pCompactFile != NULL)) {
+        rawSize = fileSize(pRawFile);
+        success = writeHeader(pCompactFile);
+        while (success &&
+               ((numEntries = fread(pEntries, sizeof (LogEntry), LOG_COMPACT_CHUNK_NUM_ENTRIES, pRawFile)) > 0)) {
+            success = encodeEntries(pState, pEntries, numEntries, pCompactFile);
+        }
+        compactSize = ftell(pCompactFile);
+    }
+    if (pRawFile != NULL) {
+        fclose(pRawFile);
+    }
+    if (pCompactFile != NULL) {
+        if (fclose(pCompactFile) != 0) {
+            success = false;
+        }
+    }
+
+    if (success) {
+        success = (remove(pPath) == 0) && (rename(pTempPath, pPath) == 0);
+    } else {
+        remove(pTempPath);
+    }
+
+    if (success) {
+        if (rawSize % sizeof (LogEntry) != 0) {
+            // Only whole entries are compacted
+            LOG(EVENT_LOG_COMPACT_PART_ENTRY_DROPPED, rawSize % sizeof (LogEntry));
+        }
+        LOG(EVENT_LOG_COMPACT_RAW_SIZE, rawSize);
+        LOG(EVENT_LOG_COMPACT_SIZE, compactSize);
+    } else {
+        LOG(EVENT_LOG_COMPACT_FAILURE, rawSize);
+        printf("Unable to compact log file \"%s\".\n", pPath);
+    }
+
+    delete[] pEntries;
+    delete pState;
+    delete[] pTempPath;
+
+    return success;
+}
+
+// Return true if a file is a compact log file.
+bool isCompactLogFile(const char *pPath)
+{
+    FILE *pFile = fopen(pPath, "rb");
+    char magic[sizeof (LOG_COMPACT_MAGIC) - 1];
+    bool isCompact = false;
+
+    if (pFile != NULL) {
+        isCompact = (fread(magic, 1, sizeof (magic), pFile) == sizeof (magic)) &&
+                    (memcmp(magic, LOG_COMPACT_MAGIC, sizeof (magic)) == 0);
+        fclose(pFile);
+    }
+
+    return isCompact;
+}
+
+// Compact the raw log files in the log index.
+int compactLogFiles(const char *pDirPath)
+{
+    char (*pNames)[LOG_INDEX_MAX_LEN_FILE_NAME] = new char[LOG_COMPACT_MAX_NUM_FILES][LOG_INDEX_MAX_LEN_FILE_NAME];
+    char *pPath = new char[LOG_COMPACT_MAX_LEN_PATH];
+    FILE *pFile;
+    int numFiles;
+    int numCompacted = 0;
+    int size;
+
+    // A temporary file left by an interrupted
+    // compaction is of no use
+    snprintf(pPath, LOG_COMPACT_MAX_LEN_PATH, "%s/%s", pDirPath, LOG_COMPACT_TEMPORARY_FILE_NAME);
+    remove(pPath);
+
+    numFiles = getLogIndexFiles(LOG_INDEX_STATE_RAW, pNames, LOG_COMPACT_MAX_NUM_FILES);
+    for (int x = 0; x < numFiles; x++) {
+        feedWatchdog();
+        snprintf(pPath, LOG_COMPACT_MAX_LEN_PATH, "%s/%s", pDirPath, pNames[x]);
+        if (compactLogFile(pPath)) {
+            size = 0;
+            pFile = fopen(pPath, "rb");
+            if (pFile != NULL) {
+                size = fileSize(pFile);
+                fclose(pFile);
+            }
+            updateLogIndexFile(pNames[x], LOG_INDEX_STATE_COMPACT, size);
+            numCompacted++;
+        }
+    }
+    saveLogIndex();
+
+    delete[] pPath;
+    delete[] pNames;
+
+    return numCompacted;
+}
+
+// End of file
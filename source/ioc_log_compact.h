@@ -0,0 +1,128 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdint.h>
+
+#ifndef _IOC_LOG_COMPACT_
+#define _IOC_LOG_COMPACT_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The first four bytes of a compact log file, "IOCL".
+#define LOG_COMPACT_MAGIC "IOCL"
+
+// The version of the compact log file format.
+#define LOG_COMPACT_VERSION 1
+
+// The size of the compact log file header: magic, version,
+// three reserved bytes and the value of the first application
+// log event (EVENT_SYSTEM_START), little-endian.
+#define LOG_COMPACT_HEADER_SIZE 12
+
+// The maximum number of different events in a compact
+// log file.
+#define LOG_COMPACT_MAX_NUM_EVENTS 256
+
+// The longest pattern of entries that can be repeated
+// by a run record.
+#define LOG_COMPACT_MAX_PATTERN 4
+
+// The number of raw log entries compacted at a time.
+#define LOG_COMPACT_CHUNK_NUM_ENTRIES 128
+
+// The maximum number of log files compacted by one call
+// to compactLogFiles().
+#define LOG_COMPACT_MAX_NUM_FILES 32
+
+// The maximum length of a log file path (including
+// terminator).
+#define LOG_COMPACT_MAX_LEN_PATH 64
+
+// The name of the temporary file a log file is compacted
+// into before it replaces the original.
+#define LOG_COMPACT_TEMPORARY_FILE_NAME "compact.tmp"
+
+/* The compact log file format
+ *
+ * A raw log file, as written by the logging library, is an
+ * array of LogEntry structures, each of twelve bytes: a
+ * microsecond timestamp, an event and a parameter.  A compact
+ * log file holds the same entries, losslessly, as a header of
+ * LOG_COMPACT_HEADER_SIZE bytes followed by records, each of
+ * which begins with an unsigned LEB128 varint, "head", the
+ * bottom two bits of which give the type of record:
+ *
+ * 0 ENTRY:  a log entry, head >> 2 being the index of its event
+ *           in the dictionary, followed by the zigzag varint
+ *           difference between its timestamp and that of the
+ *           previous entry (0 for the first) and the zigzag
+ *           varint difference between its parameter and that of
+ *           the last entry with the same event (0 for the first).
+ * 1 DEFINE: adds event head >> 2 to the end of the dictionary.
+ * 2 RUN:    head >> 2 is a pattern length, K, from 1 to
+ *           LOG_COMPACT_MAX_PATTERN, followed by a varint repeat
+ *           count, N, then N * K zigzag varint timestamp
+ *           differences: the last K entries are repeated N times,
+ *           each repeated entry having the dictionary index and
+ *           parameter difference of the entry K before it and the
+ *           next of the timestamp differences.
+ *
+ * All arithmetic is modulo 2^32.  The periodic events (e.g.
+ * EVENT_THROUGHPUT_BITS_S and EVENT_NUM_DATAGRAMS_QUEUED once
+ * a second while streaming) collapse into runs costing little
+ * more than their timestamps.  tools/log_decode.py turns either
+ * form of log file back into text.
+ */
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Compact a raw log file in place; a file that is already
+ * compact is left alone.  A raw log file that ends in part of
+ * an entry, e.g. because it was open when the device was reset,
+ * is compacted up to the last whole entry.  The log file must
+ * not be open for writing.
+ *
+ * @param pPath the path of the log file.
+ * @return      true if the file is now compact, false if it
+ *              could not be compacted or is neither a raw nor
+ *              a compact log file (e.g. it is empty).
+ */
+bool compactLogFile(const char *pPath);
+
+/** Compact the log files which the log index (see
+ * ioc_log_index.h) has as raw, e.g. at start of day before
+ * initLogFile() opens a new log file, and mark them in the log
+ * index as compact.
+ *
+ * @param pDirPath the log file directory.
+ * @return         the number of files compacted.
+ */
+int compactLogFiles(const char *pDirPath);
+
+/** Return whether a file is a compact log file.
+ *
+ * @param pPath the path of the file.
+ * @return      true if the file is a compact log file,
+ *              otherwise false.
+ */
+bool isCompactLogFile(const char *pPath);
+
+#endif // _IOC_LOG_COMPACT_
+
+// End of file
@@ -0,0 +1,607 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "log.h"
+
+#include "ioc_log_compact.h"
+#include "ioc_log_index.h"
+
+/* This file implements the log index (see ioc_log_index.h),
+ * which is shared by the log writer task, which adds log files,
+ * the log upload task, which removes them, and start of day,
+ * which compacts them.  All access is under a mutex and the
+ * log index is only written to file when asked, since each
+ * save is a handful of SD card writes.
+ */
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The first word of the log index file.
+#define LOG_INDEX_MAGIC "IOCI"
+
+// The maximum number of log files taken in from the session
+// directory by one call to initLogIndex().
+#define LOG_INDEX_MAX_NUM_SESSION_FILES 4
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A log file in the log index.
+typedef struct {
+    char name[LOG_INDEX_MAX_LEN_FILE_NAME];
+    char state;
+    int size;
+    int uploaded;
+    time_t startTime;
+    time_t endTime;
+} LogIndexFile;
+
+// The log index, allocated by initLogIndex().
+typedef struct {
+    char dirPath[LOG_INDEX_MAX_LEN_PATH];
+    int nextSequenceNumber;
+    time_t sessionStartTime;
+    time_t sessionEndTime;
+    LogIndexFile file[LOG_INDEX_MAX_NUM_FILES];  // Oldest first.
+    int numFiles;
+    char path[LOG_INDEX_MAX_LEN_PATH];
+    char otherPath[LOG_INDEX_MAX_LEN_PATH];
+    char line[LOG_INDEX_MAX_LEN_LINE];
+} LogIndex;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The log index.
+static LogIndex *gpLogIndex = NULL;
+
+// Mutex to protect the above.
+static Mutex gLogIndexMutex;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Write the path of a file in a sub-directory of the log file
+// directory into pBuf, or in the log file directory itself if
+// pSubDirName is NULL, or of the sub-directory itself if
+// pFileName is NULL.
+static const char *pPath(char *pBuf, int lenBuf, const char *pSubDirName,
+                         const char *pFileName)
+{
+    if (pSubDirName == NULL) {
+        snprintf(pBuf, lenBuf, "%s/%s", gpLogIndex->dirPath, pFileName);
+    } else if (pFileName == NULL) {
+        snprintf(pBuf, lenBuf, "%s/%s", gpLogIndex->dirPath, pSubDirName);
+    } else {
+        snprintf(pBuf, lenBuf, "%s/%s/%s", gpLogIndex->dirPath, pSubDirName, pFileName);
+    }
+
+    return pBuf;
+}
+
+// Return the size of a file, -1 if it can't be opened.
+static int fileSize(const char *pPath)
+{
+    FILE *pFile = fopen(pPath, "rb");
+    int size = -1;
+
+    if (pFile != NULL) {
+        if (fseek(pFile, 0, SEEK_END) == 0) {
+            size = ftell(pFile);
+        }
+        fclose(pFile);
+    }
+
+    return size;
+}
+
+// Find a log file in the log index, NULL if it isn't there.
+static LogIndexFile *pFindFile(const char *pName)
+{
+    for (int x = 0; x < gpLogIndex->numFiles; x++) {
+        if (strcmp(gpLogIndex->file[x].name, pName) == 0) {
+            return &gpLogIndex->file[x];
+        }
+    }
+
+    return NULL;
+}
+
+// Remove a log file from the log index, keeping the order.
+static void removeFile(LogIndexFile *pFile)
+{
+    LogIndexFile *pEnd = &gpLogIndex->file[gpLogIndex->numFiles];
+
+    memmove(pFile, pFile + 1, (pEnd - (pFile + 1)) * sizeof (*pFile));
+    gpLogIndex->numFiles--;
+}
+
+// Delete a log file and remove it from the log index.
+static void deleteFile(LogIndexFile *pFile)
+{
+    LOG(EVENT_LOG_INDEX_FILE_DELETED, pFile->size);
+    printf("Deleting log file \"%s\" (%d byte(s), %d uploaded) to make room.\n",
+           pFile->name, pFile->size, pFile->uploaded);
+    remove(pPath(gpLogIndex->path, sizeof (gpLogIndex->path), NULL, pFile->name));
+    removeFile(pFile);
+}
+
+// Delete the oldest log file which is not being written,
+// returning false if there is none.
+static bool deleteOldestFile()
+{
+    for (int x = 0; x < gpLogIndex->numFiles; x++) {
+        if (gpLogIndex->file[x].state != LOG_INDEX_STATE_WRITING) {
+            deleteFile(&gpLogIndex->file[x]);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Add a log file to the end of the log index, returning
+// NULL if there is no room.
+static LogIndexFile *pAddFile(const char *pName, LogIndexState state, int size)
+{
+    LogIndexFile *pFile = NULL;
+
+    if (strlen(pName) < sizeof (pFile->name)) {
+        if ((gpLogIndex->numFiles < LOG_INDEX_MAX_NUM_FILES) || deleteOldestFile()) {
+            pFile = &gpLogIndex->file[gpLogIndex->numFiles];
+            memset(pFile, 0, sizeof (*pFile));
+            strcpy(pFile->name, pName);
+            pFile->state = state;
+            pFile->size = size;
+            pFile->startTime = time(NULL);
+            pFile->endTime = pFile->startTime;
+            gpLogIndex->numFiles++;
+        }
+    }
+
+    return pFile;
+}
+
+// Make sure that the next sequence number is beyond that
+// in a log file name, a prefix character followed by digits.
+static void skipSequenceNumber(const char *pName)
+{
+    int sequenceNumber;
+
+    if ((*pName != 0) && (*(pName + 1) >= '0') && (*(pName + 1) <= '9')) {
+        sequenceNumber = atoi(pName + 1);
+        if (sequenceNumber >= gpLogIndex->nextSequenceNumber) {
+            gpLogIndex->nextSequenceNumber = sequenceNumber + 1;
+        }
+    }
+}
+
+// Load the log index from file.
+// Note: here be multiple return statements.
+static bool loadLogIndex()
+{
+    LogIndexFile *pFile;
+    FILE *pIndexFile;
+    char *pSpace;
+    char state;
+    int version = 0;
+    long startTime;
+    long endTime;
+
+    pIndexFile = fopen(pPath(gpLogIndex->path, sizeof (gpLogIndex->path),
+                             LOG_INDEX_STATE_DIR_NAME, LOG_INDEX_FILE_NAME), "r");
+    if (pIndexFile == NULL) {
+        // Saving may have been interrupted between
+        // the removal and the rename
+        pIndexFile = fopen(pPath(gpLogIndex->path, sizeof (gpLogIndex->path),
+                                 LOG_INDEX_STATE_DIR_NAME, LOG_INDEX_TEMPORARY_FILE_NAME), "r");
+    }
+    if (pIndexFile == NULL) {
+        return false;
+    }
+
+    if ((fgets(gpLogIndex->line, sizeof (gpLogIndex->line), pIndexFile) == NULL) ||
+        (sscanf(gpLogIndex->line, LOG_INDEX_MAGIC " %d %d %ld %ld", &version,
+                &gpLogIndex->nextSequenceNumber, &startTime, &endTime) != 4) ||
+        (version != LOG_INDEX_VERSION)) {
+        fclose(pIndexFile);
+        return false;
+    }
+    gpLogIndex->sessionStartTime = startTime;
+    gpLogIndex->sessionEndTime = endTime;
+
+    while (fgets(gpLogIndex->line, sizeof (gpLogIndex->line), pIndexFile) != NULL) {
+        pSpace = strchr(gpLogIndex->line, ' ');
+        if ((pSpace != NULL) && (gpLogIndex->numFiles < LOG_INDEX_MAX_NUM_FILES)) {
+            *pSpace = 0;
+            pFile = pAddFile(gpLogIndex->line, LOG_INDEX_STATE_RAW, 0);
+            if ((pFile != NULL) &&
+                (sscanf(pSpace + 1, "%c %d %d %ld %ld", &state, &pFile->size,
+                        &pFile->uploaded, &startTime, &endTime) == 5)) {
+                pFile->state = state;
+                pFile->startTime = startTime;
+                pFile->endTime = endTime;
+            } else if (pFile != NULL) {
+                removeFile(pFile);
+            }
+        }
+    }
+    fclose(pIndexFile);
+
+    return true;
+}
+
+// Build the log index by walking the log file directory,
+// which is only done if there is no log index.
+static void buildLogIndex()
+{
+    DIR *pDir;
+    struct dirent *pDirEnt;
+    LogIndexFile *pFile;
+    LogIndexState state;
+    int size;
+
+    gpLogIndex->numFiles = 0;
+    gpLogIndex->nextSequenceNumber = 1;
+    pDir = opendir(gpLogIndex->dirPath);
+    if (pDir != NULL) {
+        while ((gpLogIndex->numFiles < LOG_INDEX_MAX_NUM_FILES) &&
+               ((pDirEnt = readdir(pDir)) != NULL)) {
+            if ((strlen(pDirEnt->d_name) < LOG_INDEX_MAX_LEN_FILE_NAME) &&
+                (strcmp(pDirEnt->d_name, LOG_COMPACT_TEMPORARY_FILE_NAME) != 0)) {
+                pPath(gpLogIndex->path, sizeof (gpLogIndex->path), NULL, pDirEnt->d_name);
+                size = fileSize(gpLogIndex->path);
+                if (isCompactLogFile(gpLogIndex->path)) {
+                    state = LOG_INDEX_STATE_COMPACT;
+                } else if (size > 0) {
+                    // Possibly ending in part of an entry, if it
+                    // was open at a reset, which compaction drops
+                    state = LOG_INDEX_STATE_RAW;
+                } else {
+                    continue;
+                }
+                pFile = pAddFile(pDirEnt->d_name, state, size);
+                if (pFile != NULL) {
+                    // When it was written isn't known
+                    pFile->startTime = 0;
+                    pFile->endTime = 0;
+                    skipSequenceNumber(pDirEnt->d_name);
+                }
+            }
+        }
+        closedir(pDir);
+    }
+}
+
+// Find the name of a file in the session directory, returning
+// false if there is none.
+static bool findSessionFile(char *pName, int lenName)
+{
+    DIR *pDir;
+    struct dirent *pDirEnt;
+    bool found = false;
+
+    pDir = opendir(pPath(gpLogIndex->path, sizeof (gpLogIndex->path),
+                         LOG_INDEX_SESSION_DIR_NAME, NULL));
+    if (pDir != NULL) {
+        while (!found && ((pDirEnt = readdir(pDir)) != NULL)) {
+            if ((pDirEnt->d_name[0] != '.') && ((int) strlen(pDirEnt->d_name) < lenName)) {
+                strcpy(pName, pDirEnt->d_name);
+                found = true;
+            }
+        }
+        closedir(pDir);
+    }
+
+    return found;
+}
+
+// Move the log files left in the session directory by the
+// last session into the log file directory and the log index.
+static void takeInSessionFiles()
+{
+    LogIndexFile *pFile;
+    char name[LOG_INDEX_MAX_LEN_FILE_NAME];
+    int size;
+
+    for (int x = 0; (x < LOG_INDEX_MAX_NUM_SESSION_FILES) &&
+                    findSessionFile(name, sizeof (name)); x++) {
+        pPath(gpLogIndex->otherPath, sizeof (gpLogIndex->otherPath),
+              LOG_INDEX_SESSION_DIR_NAME, name);
+        size = fileSize(gpLogIndex->otherPath);
+        pFile = NULL;
+        if (size > 0) {
+            snprintf(name, sizeof (name), "%s%07d", LOG_INDEX_FILE_NAME_PREFIX,
+                     getLogIndexSequenceNumber());
+            if (rename(gpLogIndex->otherPath,
+                       pPath(gpLogIndex->path, sizeof (gpLogIndex->path), NULL, name)) == 0) {
+                pFile = pAddFile(name, LOG_INDEX_STATE_RAW, size);
+            }
+        }
+        if (pFile != NULL) {
+            pFile->startTime = gpLogIndex->sessionStartTime;
+            pFile->endTime = gpLogIndex->sessionEndTime;
+            LOG(EVENT_LOG_INDEX_SESSION_FILE, size);
+        } else {
+            remove(gpLogIndex->otherPath);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Load the log index and begin a new session.
+bool initLogIndex(const char *pDirPath)
+{
+    LogIndexFile *pFile;
+    bool success;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex == NULL) {
+        gpLogIndex = new LogIndex;
+    }
+    memset(gpLogIndex, 0, sizeof (*gpLogIndex));
+    strncpy(gpLogIndex->dirPath, pDirPath, sizeof (gpLogIndex->dirPath) - 1);
+
+    if (loadLogIndex()) {
+        LOG(EVENT_LOG_INDEX_LOADED, gpLogIndex->numFiles);
+    } else {
+        buildLogIndex();
+        LOG(EVENT_LOG_INDEX_BUILT, gpLogIndex->numFiles);
+        printf("Log index built, %d log file(s).\n", gpLogIndex->numFiles);
+    }
+
+    // What was being written last time is now closed
+    for (int x = gpLogIndex->numFiles - 1; x >= 0; x--) {
+        pFile = &gpLogIndex->file[x];
+        if (pFile->state == LOG_INDEX_STATE_WRITING) {
+            pFile->state = LOG_INDEX_STATE_RAW;
+            pFile->size = fileSize(pPath(gpLogIndex->path, sizeof (gpLogIndex->path),
+                                         NULL, pFile->name));
+            if (pFile->size <= 0) {
+                remove(gpLogIndex->path);
+                removeFile(pFile);
+            }
+        }
+    }
+
+    mkdir(pPath(gpLogIndex->path, sizeof (gpLogIndex->path), LOG_INDEX_STATE_DIR_NAME, NULL), 0777);
+    mkdir(pPath(gpLogIndex->path, sizeof (gpLogIndex->path), LOG_INDEX_SESSION_DIR_NAME, NULL), 0777);
+    takeInSessionFiles();
+
+    gpLogIndex->sessionStartTime = time(NULL);
+    success = saveLogIndex();
+    gLogIndexMutex.unlock();
+
+    return success;
+}
+
+// Save the log index.
+bool saveLogIndex()
+{
+    LogIndexFile *pFile;
+    FILE *pIndexFile;
+    bool success = false;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        gpLogIndex->sessionEndTime = time(NULL);
+        pIndexFile = fopen(pPath(gpLogIndex->path, sizeof (gpLogIndex->path),
+                                 LOG_INDEX_STATE_DIR_NAME, LOG_INDEX_TEMPORARY_FILE_NAME), "w");
+        if (pIndexFile != NULL) {
+            success = (fprintf(pIndexFile, LOG_INDEX_MAGIC " %d %d %ld %ld\n", LOG_INDEX_VERSION,
+                               gpLogIndex->nextSequenceNumber,
+                               (long) gpLogIndex->sessionStartTime,
+                               (long) gpLogIndex->sessionEndTime) > 0);
+            for (int x = 0; success && (x < gpLogIndex->numFiles); x++) {
+                pFile = &gpLogIndex->file[x];
+                success = (fprintf(pIndexFile, "%s %c %d %d %ld %ld\n", pFile->name,
+                                   pFile->state, pFile->size, pFile->uploaded,
+                                   (long) pFile->startTime, (long) pFile->endTime) > 0);
+            }
+            if (fclose(pIndexFile) != 0) {
+                success = false;
+            }
+        }
+        if (success) {
+            pPath(gpLogIndex->otherPath, sizeof (gpLogIndex->otherPath),
+                  LOG_INDEX_STATE_DIR_NAME, LOG_INDEX_FILE_NAME);
+            remove(gpLogIndex->otherPath);
+            success = (rename(gpLogIndex->path, gpLogIndex->otherPath) == 0);
+        }
+        if (!success) {
+            LOG(EVENT_LOG_INDEX_SAVE_FAILURE, gpLogIndex->numFiles);
+        }
+    }
+    gLogIndexMutex.unlock();
+
+    return success;
+}
+
+// Get a new sequence number.
+int getLogIndexSequenceNumber()
+{
+    int sequenceNumber = 0;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        sequenceNumber = gpLogIndex->nextSequenceNumber;
+        gpLogIndex->nextSequenceNumber = (sequenceNumber + 1) % 10000000;
+    }
+    gLogIndexMutex.unlock();
+
+    return sequenceNumber;
+}
+
+// Add a log file to the log index.
+bool addLogIndexFile(const char *pName, LogIndexState state)
+{
+    bool success = false;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        success = (pAddFile(pName, state, 0) != NULL);
+    }
+    gLogIndexMutex.unlock();
+
+    return success;
+}
+
+// Update a log file in the log index.
+bool updateLogIndexFile(const char *pName, LogIndexState state, int size)
+{
+    LogIndexFile *pFile = NULL;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        pFile = pFindFile(pName);
+        if (pFile != NULL) {
+            pFile->state = state;
+            pFile->size = size;
+            pFile->endTime = time(NULL);
+        }
+    }
+    gLogIndexMutex.unlock();
+
+    return (pFile != NULL);
+}
+
+// Remove a log file from the log index.
+void removeLogIndexFile(const char *pName)
+{
+    LogIndexFile *pFile;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        pFile = pFindFile(pName);
+        if (pFile != NULL) {
+            removeFile(pFile);
+        }
+    }
+    gLogIndexMutex.unlock();
+}
+
+// Get the names of the log files in a given state.
+int getLogIndexFiles(LogIndexState state, char (*pNames)[LOG_INDEX_MAX_LEN_FILE_NAME],
+                     int maxNumFiles)
+{
+    int numFiles = 0;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        for (int x = 0; (x < gpLogIndex->numFiles) && (numFiles < maxNumFiles); x++) {
+            if (gpLogIndex->file[x].state == state) {
+                strcpy(pNames[numFiles], gpLogIndex->file[x].name);
+                numFiles++;
+            }
+        }
+    }
+    gLogIndexMutex.unlock();
+
+    return numFiles;
+}
+
+// Get how much of a log file has been uploaded.
+int getLogIndexUploaded(const char *pName)
+{
+    LogIndexFile *pFile;
+    int uploaded = 0;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        pFile = pFindFile(pName);
+        if (pFile != NULL) {
+            uploaded = pFile->uploaded;
+        }
+    }
+    gLogIndexMutex.unlock();
+
+    return uploaded;
+}
+
+// Get the time a log file was begun.
+time_t getLogIndexStartTime(const char *pName)
+{
+    LogIndexFile *pFile;
+    time_t startTime = 0;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        pFile = pFindFile(pName);
+        if (pFile != NULL) {
+            startTime = pFile->startTime;
+        }
+    }
+    gLogIndexMutex.unlock();
+
+    return startTime;
+}
+
+// Set how much of a log file has been uploaded.
+void setLogIndexUploaded(const char *pName, int uploaded)
+{
+    LogIndexFile *pFile;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        pFile = pFindFile(pName);
+        if (pFile != NULL) {
+            pFile->uploaded = uploaded;
+        }
+    }
+    gLogIndexMutex.unlock();
+}
+
+// Keep the total size of the log files within a limit.
+int capLogIndexTotalSize(int maxTotalSize)
+{
+    int totalSize = 0;
+    int numDeleted = 0;
+    int x;
+
+    gLogIndexMutex.lock();
+    if (gpLogIndex != NULL) {
+        for (x = 0; x < gpLogIndex->numFiles; x++) {
+            totalSize += gpLogIndex->file[x].size;
+        }
+        x = 0;
+        while ((totalSize > maxTotalSize) && (x < gpLogIndex->numFiles)) {
+            if (gpLogIndex->file[x].state != LOG_INDEX_STATE_WRITING) {
+                totalSize -= gpLogIndex->file[x].size;
+                deleteFile(&gpLogIndex->file[x]);
+                numDeleted++;
+            } else {
+                x++;
+            }
+        }
+        if (numDeleted > 0) {
+            saveLogIndex();
+        }
+    }
+    gLogIndexMutex.unlock();
+
+    return numDeleted;
+}
+
+// End of file
@@ -0,0 +1,205 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+
+#ifndef _IOC_LOG_INDEX_
+#define _IOC_LOG_INDEX_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The version of the log index file format.
+#define LOG_INDEX_VERSION 1
+
+// The maximum number of log files in the index; when it is
+// full the oldest is deleted to make room.
+#define LOG_INDEX_MAX_NUM_FILES 64
+
+// The maximum length of a log file name (including
+// terminator).
+#define LOG_INDEX_MAX_LEN_FILE_NAME 32
+
+// The maximum length of a log file path (including
+// terminator).
+#define LOG_INDEX_MAX_LEN_PATH 64
+
+// The maximum length of a line of the log index file
+// (including terminator).
+#define LOG_INDEX_MAX_LEN_LINE 96
+
+// The total size of the log files is kept below this by
+// deleting the oldest of them.
+#define LOG_INDEX_MAX_TOTAL_SIZE (32 * 1024 * 1024)
+
+// The directory, inside the log file directory, where the
+// log index is kept; being a directory it is not mistaken
+// for a log file.
+#define LOG_INDEX_STATE_DIR_NAME "state"
+
+// The name of the log index file in LOG_INDEX_STATE_DIR_NAME.
+#define LOG_INDEX_FILE_NAME "index"
+
+// The name of the file the log index is written to before
+// it replaces the log index file.
+#define LOG_INDEX_TEMPORARY_FILE_NAME "index.tmp"
+
+// The directory, inside the log file directory, in which the
+// logging library writes its log file (see below).
+#define LOG_INDEX_SESSION_DIR_NAME "session"
+
+// The prefix of the name given to a log file written by the
+// logging library, which is followed by a seven digit
+// sequence number.
+#define LOG_INDEX_FILE_NAME_PREFIX "l"
+
+/* The log index
+ *
+ * The log index is a list of the log files in the log file
+ * directory, oldest first, giving for each its name, state,
+ * size, how much of it the logging server is known to hold and
+ * the time range (Unix time, 0 if the RTC wasn't set) over
+ * which it was written.  It is kept in RAM and saved to
+ * LOG_INDEX_FILE_NAME, so that the log files to compact or
+ * upload are known without a walk of the directory, which can
+ * take seconds on a well used SD card.  The directory is only
+ * walked if there is no log index, to build one.  The file is
+ * text:
+ *
+ * IOCI <version> <next sequence number> <session start> <session end>
+ * <name> <state> <size> <uploaded> <start time> <end time>
+ * ...
+ *
+ * The logging library names its log file itself, so it is given
+ * LOG_INDEX_SESSION_DIR_NAME to write in and the file it leaves
+ * there is moved into the log file directory, under a name from
+ * the log index, by the next initLogIndex().
+ */
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+/** The states of a log file.
+ */
+typedef enum {
+    LOG_INDEX_STATE_WRITING = 'w',
+    LOG_INDEX_STATE_RAW = 'r',
+    LOG_INDEX_STATE_COMPACT = 'c'
+} LogIndexState;
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Load the log index of a directory, building it if there
+ * is none, take in the log file left in the session directory
+ * by the last session and begin a new session.  Log files
+ * still marked as being written are from the last session and
+ * so are marked as raw.
+ *
+ * @param pDirPath the log file directory.
+ * @return         true if the log index is usable, otherwise false.
+ */
+bool initLogIndex(const char *pDirPath);
+
+/** Save the log index to file.
+ *
+ * @return true if successful, otherwise false.
+ */
+bool saveLogIndex();
+
+/** Get a new sequence number with which to name a log file.
+ *
+ * @return the sequence number.
+ */
+int getLogIndexSequenceNumber();
+
+/** Add a log file to the end of the log index, deleting the
+ * oldest log file if the index is full.
+ *
+ * @param pName the name of the log file.
+ * @param state the state of the log file.
+ * @return      true if successful, otherwise false.
+ */
+bool addLogIndexFile(const char *pName, LogIndexState state);
+
+/** Update the state and size of a log file in the log index,
+ * setting the end of its time range to now.
+ *
+ * @param pName the name of the log file.
+ * @param state the state of the log file.
+ * @param size  the size of the log file.
+ * @return      true if the log file is in the index, otherwise false.
+ */
+bool updateLogIndexFile(const char *pName, LogIndexState state, int size);
+
+/** Remove a log file from the log index; the file itself is
+ * left alone.
+ *
+ * @param pName the name of the log file.
+ */
+void removeLogIndexFile(const char *pName);
+
+/** Get the names of the log files in a given state, oldest
+ * first.
+ *
+ * @param state       the state.
+ * @param pNames      an array of maxNumFiles names.
+ * @param maxNumFiles the maximum number of names to get.
+ * @return            the number of names got.
+ */
+int getLogIndexFiles(LogIndexState state, char (*pNames)[LOG_INDEX_MAX_LEN_FILE_NAME],
+                     int maxNumFiles);
+
+/** Get how much of a log file has been uploaded.
+ *
+ * @param pName the name of the log file.
+ * @return      the number of bytes uploaded, 0 if the file
+ *              is not in the log index.
+ */
+int getLogIndexUploaded(const char *pName);
+
+/** Get the time a log file was begun.
+ *
+ * @param pName the name of the log file.
+ * @return      the Unix time at which the log file was begun, 0
+ *              if the RTC wasn't set or the file is not in the
+ *              log index.
+ */
+time_t getLogIndexStartTime(const char *pName);
+
+/** Set how much of a log file has been uploaded; call
+ * saveLogIndex() to save it.
+ *
+ * @param pName    the name of the log file.
+ * @param uploaded the number of bytes uploaded.
+ */
+void setLogIndexUploaded(const char *pName, int uploaded);
+
+/** Delete the oldest log files, other than those being
+ * written, until the total size of the log files in the log
+ * index is no more than a given size, saving the log index
+ * if any are deleted.
+ *
+ * @param maxTotalSize the maximum total size.
+ * @return             the number of log files deleted.
+ */
+int capLogIndexTotalSize(int maxTotalSize);
+
+#endif // _IOC_LOG_INDEX_
+
+// End of file
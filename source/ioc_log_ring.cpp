@@ -0,0 +1,331 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "us_ticker_api.h"
+#include "log.h"
+
+#include "ioc_log_compact.h"
+#include "ioc_log_index.h"
+#include "ioc_log_upload.h"
+#include "ioc_log_ring.h"
+
+/* This file implements the log ring, a RAM log that interrupts,
+ * the I2S bottom half, the send task and the event queue can all
+ * write to at once without a mutex.  It sits in main SRAM: CCMRAM
+ * is all but filled by the datagram storage and the log buffer.
+ *
+ * The ring is a bounded multi-producer queue of the kind described
+ * by Dmitry Vyukov: each entry has a sequence number which says
+ * whose turn it is.  An entry at position p (counting from
+ * initLogRing()) is free for a writer when its sequence number is
+ * p, committed when it is p + 1 and free again, for position
+ * p + LOG_RING_NUM_ENTRIES, once read.  A writer which finds the
+ * sequence number of the entry at the head less than the head
+ * knows that the ring is full and counts an overflow rather than
+ * overwriting an entry that has not been read.  There is a single
+ * reader, the log writer task, which writes the entries to a log
+ * ring file: a raw log file like any other, time-stamped in the
+ * same way as the log, so that the two can be merged.  Log ring
+ * files are rotated by size and age and, unlike the log file
+ * written by the logging library, can be compacted and uploaded
+ * while the device is running.
+ */
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// An entry in the log ring.
+typedef struct {
+    volatile uint32_t sequence;
+    LogEntry entry;
+} LogRingCell;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The log ring.
+static LogRingCell gLogRing[LOG_RING_NUM_ENTRIES];
+
+// The position of the next entry to reserve.
+static volatile uint32_t gLogRingHead = 0;
+
+// The position of the next entry to read.
+static uint32_t gLogRingTail = 0;
+
+// The time from which the log ring's time stamps count.
+static uint32_t gLogRingBaseUs = 0;
+
+// The number of entries dropped because the ring was full,
+// and the number of those already logged.
+static volatile uint32_t gLogRingNumOverflows = 0;
+static uint32_t gLogRingNumOverflowsLogged = 0;
+
+// The log ring file, NULL if there is none, the directory
+// it is in, its name and path, when it was opened and the
+// number of entries written to it.
+static FILE *gpLogRingFile = NULL;
+static char gLogRingDirPath[LOG_RING_MAX_LEN_PATH];
+static char gLogRingFileName[LOG_INDEX_MAX_LEN_FILE_NAME];
+static char gLogRingFilePath[LOG_RING_MAX_LEN_PATH];
+static time_t gLogRingFileOpenTime = 0;
+static int gLogRingFileNumEntries = 0;
+
+// Mutex to protect the reading side of the ring and the file.
+static Mutex gLogRingMutex;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Take the oldest committed entry from the ring.
+static bool logRingGet(LogEntry *pEntry)
+{
+    LogRingCell *pCell = &gLogRing[gLogRingTail & (LOG_RING_NUM_ENTRIES - 1)];
+
+    if (pCell->sequence != gLogRingTail + 1) {
+        // Empty or not yet committed
+        return false;
+    }
+    __DMB();
+    *pEntry = pCell->entry;
+    __DMB();
+    pCell->sequence = gLogRingTail + LOG_RING_NUM_ENTRIES;
+    gLogRingTail++;
+
+    return true;
+}
+
+// Open a new log ring file in gLogRingDirPath, adding it to
+// the log index; gLogRingMutex must be locked.
+static bool openFile()
+{
+    int sequenceNumber = getLogIndexSequenceNumber();
+
+    snprintf(gLogRingFileName, sizeof (gLogRingFileName), "%s%07d",
+             LOG_RING_FILE_NAME_PREFIX, sequenceNumber);
+    snprintf(gLogRingFilePath, sizeof (gLogRingFilePath), "%s/%s",
+             gLogRingDirPath, gLogRingFileName);
+    gpLogRingFile = fopen(gLogRingFilePath, "wb");
+    gLogRingFileOpenTime = time(NULL);
+    gLogRingFileNumEntries = 0;
+    if (gpLogRingFile != NULL) {
+        addLogIndexFile(gLogRingFileName, LOG_INDEX_STATE_WRITING);
+        saveLogIndex();
+        LOG(EVENT_LOG_RING_FILE_OPEN, sequenceNumber);
+    } else {
+        LOG(EVENT_LOG_RING_FILE_OPEN_FAILURE, sequenceNumber);
+        printf("Unable to open log ring file \"%s\".\n", gLogRingFilePath);
+    }
+
+    return (gpLogRingFile != NULL);
+}
+
+// Close the log ring file, marking it in the log index as
+// raw or, if nothing was written to it, removing it;
+// gLogRingMutex must be locked.
+static void closeFile()
+{
+    fclose(gpLogRingFile);
+    gpLogRingFile = NULL;
+    if (gLogRingFileNumEntries > 0) {
+        updateLogIndexFile(gLogRingFileName, LOG_INDEX_STATE_RAW,
+                           gLogRingFileNumEntries * sizeof (LogEntry));
+    } else {
+        remove(gLogRingFilePath);
+        removeLogIndexFile(gLogRingFileName);
+    }
+    saveLogIndex();
+}
+
+// Return true if the log ring file is due to be rotated.
+static bool isRotationDue()
+{
+    time_t age = time(NULL) - gLogRingFileOpenTime;
+
+    if (age < 0) {
+        // The RTC has been set back
+        gLogRingFileOpenTime = time(NULL);
+        age = 0;
+    }
+
+    return (gLogRingFileNumEntries * (int) sizeof (LogEntry) >= LOG_RING_FILE_MAX_SIZE) ||
+           ((gLogRingFileNumEntries > 0) && (age >= LOG_RING_FILE_MAX_AGE_SECONDS));
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Empty the log ring.
+void initLogRing()
+{
+    gLogRingMutex.lock();
+    for (unsigned int x = 0; x < sizeof (gLogRing) / sizeof (gLogRing[0]); x++) {
+        gLogRing[x].sequence = x;
+    }
+    gLogRingTail = 0;
+    gLogRingNumOverflows = 0;
+    gLogRingNumOverflowsLogged = 0;
+    gLogRingBaseUs = us_ticker_read();
+    __DMB();
+    gLogRingHead = 0;
+    gLogRingMutex.unlock();
+}
+
+// Put an entry into the log ring.
+bool logRingPut(int event, int parameter)
+{
+    LogRingCell *pCell;
+    uint32_t position = gLogRingHead;
+    int32_t difference;
+
+    // Reserve an entry
+    for (;;) {
+        pCell = &gLogRing[position & (LOG_RING_NUM_ENTRIES - 1)];
+        difference = (int32_t) (pCell->sequence - position);
+        if (difference == 0) {
+            // On failure this updates position to the
+            // current head, so just go round again
+            if (core_util_atomic_cas_u32(&gLogRingHead, &position, position + 1)) {
+                break;
+            }
+        } else if (difference < 0) {
+            core_util_atomic_incr_u32(&gLogRingNumOverflows, 1);
+            return false;
+        } else {
+            // Another writer got here first
+            position = gLogRingHead;
+        }
+    }
+
+    // Fill it in and commit it
+    pCell->entry.timestamp = us_ticker_read() - gLogRingBaseUs;
+    pCell->entry.event = (LogEvent) event;
+    pCell->entry.parameter = parameter;
+    __DMB();
+    pCell->sequence = position + 1;
+
+    return true;
+}
+
+// Open a new log ring file.
+bool openLogRingFile(const char *pDirPath)
+{
+    bool success = true;
+
+    gLogRingMutex.lock();
+    if (gpLogRingFile == NULL) {
+        strncpy(gLogRingDirPath, pDirPath, sizeof (gLogRingDirPath) - 1);
+        gLogRingDirPath[sizeof (gLogRingDirPath) - 1] = 0;
+        success = openFile();
+    }
+    gLogRingMutex.unlock();
+
+    return success;
+}
+
+// Write out the log ring.
+int writeLogRing()
+{
+    LogEntry entries[LOG_RING_WRITE_CHUNK_NUM_ENTRIES];
+    uint32_t numOverflows;
+    int numEntries;
+    int numWritten = 0;
+    bool rotated = false;
+
+    gLogRingMutex.lock();
+    do {
+        numEntries = 0;
+        while ((numEntries < LOG_RING_WRITE_CHUNK_NUM_ENTRIES) &&
+               logRingGet(&entries[numEntries])) {
+            numEntries++;
+        }
+        if (numEntries > 0) {
+            if (gpLogRingFile != NULL) {
+                fwrite(entries, sizeof (entries[0]), numEntries, gpLogRingFile);
+                gLogRingFileNumEntries += numEntries;
+            } else {
+                for (int x = 0; x < numEntries; x++) {
+                    LOG(entries[x].event, entries[x].parameter);
+                }
+            }
+            numWritten += numEntries;
+        }
+    } while (numEntries == LOG_RING_WRITE_CHUNK_NUM_ENTRIES);
+    if ((numWritten > 0) && (gpLogRingFile != NULL)) {
+        fflush(gpLogRingFile);
+    }
+
+    numOverflows = gLogRingNumOverflows;
+    if (numOverflows != gLogRingNumOverflowsLogged) {
+        LOG(EVENT_LOG_RING_OVERFLOW, numOverflows - gLogRingNumOverflowsLogged);
+        gLogRingNumOverflowsLogged = numOverflows;
+    }
+
+    if ((gpLogRingFile != NULL) && isRotationDue()) {
+        LOG(EVENT_LOG_RING_FILE_ROTATE, gLogRingFileNumEntries * sizeof (LogEntry));
+        closeFile();
+        openFile();
+        rotated = true;
+    }
+    gLogRingMutex.unlock();
+
+    if (rotated) {
+        // Make what was rotated out ready for upload, and have
+        // it uploaded, outside the mutex so as not to hold up
+        // closeLogRingFile()
+        compactLogFiles(gLogRingDirPath);
+        capLogIndexTotalSize(LOG_INDEX_MAX_TOTAL_SIZE);
+        notifyLogUploadNewFiles();
+    }
+
+    return numWritten;
+}
+
+// Write out the log ring and close the log ring file.
+void closeLogRingFile()
+{
+    writeLogRing();
+    gLogRingMutex.lock();
+    if (gpLogRingFile != NULL) {
+        closeFile();
+    }
+    gLogRingMutex.unlock();
+}
+
+// Write out the log ring and commit the log ring file to the
+// SD card.
+void syncLogRingFile()
+{
+    writeLogRing();
+    gLogRingMutex.lock();
+    if (gpLogRingFile != NULL) {
+        fflush(gpLogRingFile);
+        fsync(fileno(gpLogRingFile));
+    }
+    gLogRingMutex.unlock();
+}
+
+// Get the number of overflows.
+unsigned int getLogRingNumOverflows()
+{
+    return gLogRingNumOverflows;
+}
+
+// End of file
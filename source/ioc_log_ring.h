@@ -0,0 +1,121 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+
+#ifndef _IOC_LOG_RING_
+#define _IOC_LOG_RING_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of entries in the log ring; must be a power of two.
+#define LOG_RING_NUM_ENTRIES 128
+
+// The number of entries written to file at a time.
+#define LOG_RING_WRITE_CHUNK_NUM_ENTRIES 16
+
+// The prefix of the name of a log ring file, which is
+// followed by a seven digit sequence number from the log
+// index.
+#define LOG_RING_FILE_NAME_PREFIX "r"
+
+// A log ring file is closed, compacted and a new one begun
+// when it reaches this size...
+#define LOG_RING_FILE_MAX_SIZE (256 * 1024)
+
+// ...or has been open for this long.
+#define LOG_RING_FILE_MAX_AGE_SECONDS (24 * 3600)
+
+// The maximum length of a log ring file path (including
+// terminator).
+#define LOG_RING_MAX_LEN_PATH 64
+
+/** Log an event from anywhere, including interrupt context,
+ * without taking a lock (see logRingPut()).
+ */
+#define LOG_RING(event, parameter) logRingPut(event, parameter)
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Empty the log ring and start its time stamps from now; call
+ * this straight after initLog() so that the time stamps of the
+ * log ring and the log match.
+ */
+void initLogRing();
+
+/** Put an entry into the log ring; may be called from any
+ * thread or interrupt, concurrently, without locking.  A
+ * writer reserves an entry by advancing the head of the ring
+ * with compare-and-swap and commits it, once written, by
+ * setting its sequence number; an entry is only read once
+ * committed, so a writer which is interrupted part way through
+ * never leaves a torn entry.  If the ring is full the entry is
+ * counted as an overflow and dropped, nothing being overwritten.
+ *
+ * @param event     the event.
+ * @param parameter the parameter to log with it.
+ * @return          true if the entry was added, false if the
+ *                  ring was full.
+ */
+bool logRingPut(int event, int parameter);
+
+/** Open a new log ring file, a raw log file, in the given
+ * directory, to which writeLogRing() will write, and add it
+ * to the log index (see ioc_log_index.h), which must have been
+ * initialised.
+ *
+ * @param pDirPath the directory, e.g. that of the log files.
+ * @return         true if the file was opened, otherwise false.
+ */
+bool openLogRingFile(const char *pDirPath);
+
+/** Take the committed entries out of the log ring, oldest
+ * first, and write them to the log ring file or, if there is
+ * none open, add them to the log with LOG(), in which case they
+ * are time-stamped when written; must not be called from
+ * interrupt context.  When the log ring file reaches
+ * LOG_RING_FILE_MAX_SIZE or LOG_RING_FILE_MAX_AGE_SECONDS it
+ * is compacted, ready for upload, and a new one is begun.
+ *
+ * @return the number of entries written.
+ */
+int writeLogRing();
+
+/** Write out the log ring and close the log ring file,
+ * updating the log index.
+ */
+void closeLogRingFile();
+
+/** Write out the log ring and commit the log ring file to the
+ * SD card, leaving it open: what has been written then
+ * survives a reset, the log index taking in the log ring file
+ * (see initLogIndex()) as it would one that had been closed.
+ */
+void syncLogRingFile();
+
+/** Get the number of entries dropped because the log ring
+ * was full.
+ *
+ * @return the number of overflows since initLogRing().
+ */
+unsigned int getLogRingNumOverflows();
+
+#endif // _IOC_LOG_RING_
+
+// End of file
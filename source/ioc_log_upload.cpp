@@ -0,0 +1,722 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "log.h"
+
+#include "ioc_audio.h"
+#include "ioc_config.h"
+#include "ioc_network.h"
+#include "ioc_log_index.h"
+#include "ioc_lzss.h"
+#include "ioc_utils.h"
+#include "ioc_log_upload.h"
+
+/* This file implements the upload of log files to the logging
+ * server, a chunk at a time, so that a dropped connection costs
+ * no more than the chunk that was in flight (see the protocol
+ * in ioc_log_upload.h).
+ *
+ * The upload runs in a task of its own, at below normal priority,
+ * since reading the SD card and waiting on the server can each
+ * take a while.  The log files to upload are taken from the log
+ * index (see ioc_log_index.h) and how far each has got is saved
+ * there every few chunks, so that it survives a reset or standby,
+ * though it is the logging server's idea of how much it holds
+ * that decides where an upload resumes.  If the logging server
+ * supports it each chunk is compressed as it is read from the SD
+ * card, so that cellular data is only spent on what the compact
+ * log format couldn't squeeze out.  Only compact log files
+ * are uploaded: a raw log file is either being written or will be
+ * compacted at the next start of day.  The upload gives way to
+ * audio streaming and keeps within a budget (see "Scheduling" in
+ * ioc_log_upload.h).
+ */
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Signal to the log upload task to stop.
+#define SIG_LOG_UPLOAD_STOP 0x01
+
+// The length of the device ID string (including terminator):
+// the 96 bit unique ID of the STM32 as hex.
+#define LOG_UPLOAD_LEN_DEVICE_ID 25
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// Everything the log upload task works with, allocated
+// when it is started.
+typedef struct {
+    char dirPath[LOG_UPLOAD_MAX_LEN_PATH];
+    char serverUrl[LOG_UPLOAD_MAX_LEN_SERVER_ADDRESS];
+    char deviceId[LOG_UPLOAD_LEN_DEVICE_ID];
+    char fileName[LOG_UPLOAD_MAX_NUM_FILES][LOG_INDEX_MAX_LEN_FILE_NAME];
+    int numFiles;
+    int numFilesUploaded;
+    bool paused;
+    int protocolVersion;
+    bool compress;
+    LzssState lzss;
+    char compressed[LZSS_MAX_COMPRESSED_SIZE(LOG_UPLOAD_CHUNK_SIZE)];
+    char path[LOG_UPLOAD_MAX_LEN_PATH];
+    char line[LOG_UPLOAD_MAX_LEN_LINE];
+    char buf[LOG_UPLOAD_CHUNK_SIZE];
+} LogUploadContext;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The log upload task and its context.
+static Thread *gpLogUploadTask = NULL;
+static LogUploadContext *gpLogUploadContext = NULL;
+
+// Set to ask the log upload task to stop.
+static volatile bool gLogUploadStop = false;
+
+// Set when there are new compact log files for the log upload
+// task to go round again for; gLogUploadTaskDone is set by the
+// task once it has decided to exit.  Both are protected by a
+// critical section.
+static volatile bool gLogUploadNewFiles = false;
+static volatile bool gLogUploadTaskDone = false;
+
+// The number of bytes uploaded in this budget period and
+// when the period began.
+static volatile int gLogUploadBytesThisPeriod = 0;
+static volatile time_t gLogUploadBudgetPeriodStart = 0;
+
+// Mutex to protect the above.
+static Mutex gLogUploadMutex;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: SCHEDULING
+ * -------------------------------------------------------------- */
+
+// Return true if audio is, or may soon be, using the link.
+static bool isLinkBusy()
+{
+    return isAudioStreamingEnabled() ||
+           (getUrtpDatagramsQueued() > LOG_UPLOAD_MAX_DATAGRAMS_QUEUED);
+}
+
+// Return the number of bytes that may be uploaded in this
+// budget period, -1 if there is no limit.
+static int budgetBytesLeft()
+{
+    int budgetBytes = getLogUploadBudgetBytes();
+    int bytesLeft = -1;
+    time_t now = time(NULL);
+
+    // A device that doesn't sleep gets a new budget period
+    // every LOG_UPLOAD_BUDGET_PERIOD_SECONDS (or if the RTC
+    // has been set back)
+    if ((now < gLogUploadBudgetPeriodStart) ||
+        (now - gLogUploadBudgetPeriodStart >= LOG_UPLOAD_BUDGET_PERIOD_SECONDS)) {
+        resetLogUploadBudget();
+    }
+
+    if (budgetBytes > 0) {
+        bytesLeft = budgetBytes - gLogUploadBytesThisPeriod;
+        if (bytesLeft < 0) {
+            bytesLeft = 0;
+        }
+    }
+
+    return bytesLeft;
+}
+
+// Return true if the upload may go on now.
+static bool mayUpload()
+{
+    return !isLinkBusy() && (budgetBytesLeft() != 0);
+}
+
+// Wait until the upload may go on, for up to maxWaitMs
+// (or for ever if maxWaitMs is negative), returning true
+// if it may.
+static bool waitToUpload(int maxWaitMs)
+{
+    int waitedMs = 0;
+    bool paused = false;
+
+    while (!gLogUploadStop && !mayUpload() &&
+           ((maxWaitMs < 0) || (waitedMs < maxWaitMs))) {
+        if (!paused) {
+            paused = true;
+            if (isLinkBusy()) {
+                LOG(EVENT_LOG_UPLOAD_PAUSED_LINK_BUSY, getUrtpDatagramsQueued());
+            } else {
+                LOG(EVENT_LOG_UPLOAD_PAUSED_BUDGET_SPENT, gLogUploadBytesThisPeriod);
+            }
+        }
+        Thread::signal_wait(SIG_LOG_UPLOAD_STOP, LOG_UPLOAD_PAUSE_CHECK_INTERVAL_MS);
+        waitedMs += LOG_UPLOAD_PAUSE_CHECK_INTERVAL_MS;
+    }
+
+    if (gLogUploadStop || !mayUpload()) {
+        return false;
+    }
+    if (paused) {
+        LOG(EVENT_LOG_UPLOAD_RESUMED, waitedMs);
+    }
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: PROTOCOL
+ * -------------------------------------------------------------- */
+
+// Send all of a buffer to the logging server.
+static bool sendAll(TCPSocket *pSock, const char *pBuf, int len)
+{
+    nsapi_size_or_error_t size;
+
+    while ((len > 0) && ((size = pSock->send(pBuf, len)) > 0)) {
+        pBuf += size;
+        len -= size;
+    }
+
+    return (len == 0);
+}
+
+// Send the line in pContext->line to the logging server.
+static bool sendLine(TCPSocket *pSock, LogUploadContext *pContext)
+{
+    return sendAll(pSock, pContext->line, strlen(pContext->line));
+}
+
+// Receive a line from the logging server into pContext->line,
+// without the '\n'.
+static bool receiveLine(TCPSocket *pSock, LogUploadContext *pContext)
+{
+    char c = 0;
+    int x = 0;
+
+    while ((x < (int) sizeof (pContext->line) - 1) &&
+           (pSock->recv(&c, 1) == 1) && (c != '\n')) {
+        pContext->line[x] = c;
+        x++;
+    }
+    pContext->line[x] = 0;
+
+    return (c == '\n');
+}
+
+// Receive a line from the logging server that should be
+// pKeyword followed by an offset, returning the offset or
+// -1 if the line was something else.
+static int receiveOffset(TCPSocket *pSock, LogUploadContext *pContext, const char *pKeyword)
+{
+    int offset = -1;
+    int len = strlen(pKeyword);
+
+    if (receiveLine(pSock, pContext)) {
+        if ((strncmp(pContext->line, pKeyword, len) == 0) &&
+            (pContext->line[len] == ' ')) {
+            offset = atoi(pContext->line + len + 1);
+        } else {
+            printf("Logging server said \"%s\".\n", pContext->line);
+        }
+    }
+
+    return offset;
+}
+
+// Return the size of a file, -1 on error.
+static long fileSize(FILE *pFile)
+{
+    long size = -1;
+
+    if (fseek(pFile, 0, SEEK_END) == 0) {
+        size = ftell(pFile);
+    }
+
+    return size;
+}
+
+// Add bytes to a 32 bit FNV-1a hash.
+static uint32_t fnv1a(uint32_t hash, const char *pBuf, int length)
+{
+    for (int x = 0; x < length; x++) {
+        hash ^= (uint8_t) *(pBuf + x);
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+// Work out the identity of a log file (see the protocol in
+// ioc_log_upload.h), using pContext->buf; returns false on
+// error.
+static bool fileIdentity(FILE *pFile, long size, LogUploadContext *pContext,
+                         const char *pName, uint32_t *pIdentity)
+{
+    uint32_t startTime = (uint32_t) getLogIndexStartTime(pName);
+    char startTimeBytes[4];
+    int length = LOG_UPLOAD_IDENTITY_LENGTH;
+
+    for (unsigned int x = 0; x < sizeof (startTimeBytes); x++) {
+        startTimeBytes[x] = (char) (startTime >> (x * 8));
+    }
+    if (length > size) {
+        length = size;
+    }
+    *pIdentity = fnv1a(2166136261U, startTimeBytes, sizeof (startTimeBytes));
+
+    if ((fseek(pFile, 0, SEEK_SET) != 0) ||
+        (fread(pContext->buf, 1, length, pFile) != (size_t) length)) {
+        return false;
+    }
+    *pIdentity = fnv1a(*pIdentity, pContext->buf, length);
+
+    return true;
+}
+
+// Upload a log file, deleting it once the logging server
+// has all of it.
+// Note: here be multiple return statements.
+static bool uploadFile(TCPSocket *pSock, LogUploadContext *pContext, const char *pName)
+{
+    FILE *pFile;
+    long size;
+    int savedOffset;
+    int offset;
+    int uploaded;
+    int length;
+    int sendLength;
+    const char *pSendBuf;
+    int bytesLeft;
+    int numChunks = 0;
+    int bytesSent = 0;
+    uint32_t identity = 0;
+
+    snprintf(pContext->path, sizeof (pContext->path), "%s/%s", pContext->dirPath, pName);
+    pFile = fopen(pContext->path, "rb");
+    if (pFile == NULL) {
+        // Gone, so nothing more to upload
+        removeLogIndexFile(pName);
+        saveLogIndex();
+        return true;
+    }
+    size = fileSize(pFile);
+    savedOffset = getLogIndexUploaded(pName);
+
+    // Find out how much the server already has
+    LOG(EVENT_LOG_UPLOAD_FILE, size);
+    if (pContext->protocolVersion > 1) {
+        if ((size < 0) || !fileIdentity(pFile, size, pContext, pName, &identity)) {
+            size = -1;
+        }
+        snprintf(pContext->line, sizeof (pContext->line), "FILE %s %ld %d %08x\n",
+                 pName, size, savedOffset, (unsigned int) identity);
+    } else {
+        snprintf(pContext->line, sizeof (pContext->line), "FILE %s %ld %d\n", pName, size, savedOffset);
+    }
+    offset = -1;
+    if ((size >= 0) && sendLine(pSock, pContext)) {
+        offset = receiveOffset(pSock, pContext, "OFFSET");
+    }
+    if ((offset >= 0) && (offset != savedOffset)) {
+        LOG(EVENT_LOG_UPLOAD_OFFSET_MISMATCH, savedOffset);
+    }
+    if (offset > 0) {
+        LOG(EVENT_LOG_UPLOAD_RESUME_OFFSET, offset);
+        printf("Resuming upload of log file \"%s\" at %d of %ld byte(s).\n", pName, offset, size);
+    }
+
+    // Send it the rest, a chunk at a time
+    if (pContext->compress) {
+        lzssReset(&pContext->lzss);
+    }
+    uploaded = offset;
+    while ((offset >= 0) && (offset < size) && !gLogUploadStop) {
+        if (!waitToUpload(LOG_UPLOAD_MAX_PAUSE_MS)) {
+            // Give up the connection until the link is free
+            pContext->paused = !gLogUploadStop;
+            break;
+        }
+        length = size - offset;
+        if (length > (int) sizeof (pContext->buf)) {
+            length = sizeof (pContext->buf);
+        }
+        bytesLeft = budgetBytesLeft();
+        if ((bytesLeft > 0) && (length > bytesLeft)) {
+            length = bytesLeft;
+        }
+        if ((fseek(pFile, offset, SEEK_SET) == 0) &&
+            (fread(pContext->buf, 1, length, pFile) == (size_t) length)) {
+            // Compress the chunk, sending it as it is if that
+            // doesn't make it any smaller
+            pSendBuf = pContext->buf;
+            sendLength = length;
+            snprintf(pContext->line, sizeof (pContext->line), "DATA %d %d\n", offset, length);
+            if (pContext->compress) {
+                sendLength = lzssCompress(&pContext->lzss, pContext->buf, length,
+                                          pContext->compressed);
+                if (sendLength < length) {
+                    pSendBuf = pContext->compressed;
+                    snprintf(pContext->line, sizeof (pContext->line), "ZDATA %d %d %d\n",
+                             offset, length, sendLength);
+                } else {
+                    sendLength = length;
+                }
+            }
+            if (sendLine(pSock, pContext) && sendAll(pSock, pSendBuf, sendLength)) {
+                gLogUploadBytesThisPeriod += sendLength;
+                bytesSent += sendLength;
+                offset = receiveOffset(pSock, pContext, "ACK");
+            } else {
+                offset = -1;
+            }
+        } else {
+            offset = -1;
+        }
+        if (offset > size) {
+            offset = -1;
+        }
+        if (offset >= 0) {
+            uploaded = offset;
+            numChunks++;
+            if (numChunks % LOG_UPLOAD_SAVE_INTERVAL_CHUNKS == 0) {
+                setLogIndexUploaded(pName, uploaded);
+                saveLogIndex();
+            }
+        }
+    }
+    fclose(pFile);
+
+    if (offset == size) {
+        snprintf(pContext->path, sizeof (pContext->path), "%s/%s", pContext->dirPath, pName);
+        remove(pContext->path);
+        removeLogIndexFile(pName);
+        saveLogIndex();
+        pContext->numFilesUploaded++;
+        LOG(EVENT_LOG_UPLOAD_FILE_COMPLETE, size);
+        LOG(EVENT_LOG_UPLOAD_FILE_BYTES_SENT, bytesSent);
+        return true;
+    }
+
+    if (uploaded >= 0) {
+        setLogIndexUploaded(pName, uploaded);
+        saveLogIndex();
+    }
+    if (!gLogUploadStop && !pContext->paused) {
+        LOG(EVENT_LOG_UPLOAD_FAILURE, uploaded);
+        printf("Upload of log file \"%s\" stopped at %d of %ld byte(s).\n", pName, uploaded, size);
+    }
+
+    return false;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: TASK
+ * -------------------------------------------------------------- */
+
+// Say hello to the logging server, agreeing what it
+// supports.
+static bool hello(TCPSocket *pSock, LogUploadContext *pContext)
+{
+    bool success;
+
+    pContext->compress = false;
+    if (pContext->protocolVersion > 1) {
+        snprintf(pContext->line, sizeof (pContext->line), "IOCU %d %s%s\n",
+                 pContext->protocolVersion, pContext->deviceId,
+                 LOG_UPLOAD_COMPRESSION_ENABLED ? " " LOG_UPLOAD_CAPABILITY_LZSS : "");
+    } else {
+        snprintf(pContext->line, sizeof (pContext->line), "IOCU %d %s\n",
+                 pContext->protocolVersion, pContext->deviceId);
+    }
+    success = sendLine(pSock, pContext) && receiveLine(pSock, pContext) &&
+              (strncmp(pContext->line, "OK", 2) == 0) &&
+              ((pContext->line[2] == 0) || (pContext->line[2] == ' '));
+    if (success) {
+        pContext->compress = (strstr(pContext->line, " " LOG_UPLOAD_CAPABILITY_LZSS) != NULL);
+        LOG(EVENT_LOG_UPLOAD_PROTOCOL, (pContext->protocolVersion << 8) | pContext->compress);
+    }
+
+    return success;
+}
+
+// Open a connection to the logging server.
+static TCPSocket *pOpen(const SocketAddress &server)
+{
+    TCPSocket *pSock = new TCPSocket();
+    nsapi_error_t nsapiError;
+
+    nsapiError = pSock->open(pGetNetworkInterface());
+    if (nsapiError == NSAPI_ERROR_OK) {
+        pSock->set_timeout(LOG_UPLOAD_SOCKET_TIMEOUT_MS);
+        nsapiError = pSock->connect(server);
+    }
+    if (nsapiError != NSAPI_ERROR_OK) {
+        delete pSock;
+        pSock = NULL;
+        LOG(EVENT_LOG_UPLOAD_CONNECT_FAILURE, nsapiError);
+        printf("Unable to connect to logging server (error %d).\n", nsapiError);
+    }
+
+    return pSock;
+}
+
+// Connect to the logging server and say hello.
+// Note: here be multiple return statements.
+static TCPSocket *pConnect(LogUploadContext *pContext)
+{
+    TCPSocket *pSock;
+    SocketAddress server;
+    bool accepted;
+    int port;
+
+    getAddressFromUrl(pContext->serverUrl, pContext->buf, sizeof (pContext->buf));
+    if ((pGetNetworkInterface()->gethostbyname(pContext->buf, &server) != 0) ||
+        !getPortFromUrl(pContext->serverUrl, &port)) {
+        LOG(EVENT_LOG_UPLOAD_CONNECT_FAILURE, 0);
+        printf("Unable to locate logging server \"%s\".\n", pContext->serverUrl);
+        return NULL;
+    }
+    server.set_port(port);
+
+    pSock = pOpen(server);
+    if (pSock == NULL) {
+        return NULL;
+    }
+    accepted = hello(pSock, pContext);
+    if (!accepted && (pContext->protocolVersion > 1) &&
+        (strncmp(pContext->line, "ERROR", 5) == 0)) {
+        // An older logging server, which will have closed
+        // the connection: try again with version 1
+        delete pSock;
+        pContext->protocolVersion = 1;
+        pSock = pOpen(server);
+        if (pSock == NULL) {
+            return NULL;
+        }
+        accepted = hello(pSock, pContext);
+    }
+    if (!accepted) {
+        delete pSock;
+        LOG(EVENT_LOG_UPLOAD_CONNECT_FAILURE, 0);
+        printf("Logging server did not accept the connection.\n");
+        return NULL;
+    }
+
+    return pSock;
+}
+
+// Make one attempt at uploading the log files, returning
+// true if there are none left to upload.
+// Note: here be multiple return statements.
+static bool uploadFiles(LogUploadContext *pContext)
+{
+    TCPSocket *pSock;
+    bool success = true;
+
+    pContext->numFiles = getLogIndexFiles(LOG_INDEX_STATE_COMPACT, pContext->fileName,
+                                          LOG_UPLOAD_MAX_NUM_FILES);
+    if (pContext->numFiles == 0) {
+        return true;
+    }
+
+    pContext->paused = false;
+    if (!waitToUpload(-1) || !isNetworkConnected()) {
+        return false;
+    }
+    pSock = pConnect(pContext);
+    if (pSock == NULL) {
+        return false;
+    }
+
+    printf("Uploading %d log file(s)...\n", pContext->numFiles);
+    for (int x = 0; success && (x < pContext->numFiles) && !gLogUploadStop; x++) {
+        success = uploadFile(pSock, pContext, pContext->fileName[x]);
+    }
+    if (success && !gLogUploadStop) {
+        strcpy(pContext->line, "BYE\n");
+        sendLine(pSock, pContext);
+    }
+
+    // No need to close() the socket,
+    // the destructor does that.
+    delete pSock;
+
+    return success && !gLogUploadStop;
+}
+
+// The body of the log upload task.
+static void logUploadTask()
+{
+    LogUploadContext *pContext = gpLogUploadContext;
+    bool done;
+    bool more;
+    int numTries;
+
+    do {
+        done = false;
+        numTries = 0;
+        while (!done && !gLogUploadStop && (numTries < LOG_UPLOAD_MAX_NUM_TRIES)) {
+            done = uploadFiles(pContext);
+            if (!pContext->paused) {
+                // Giving way to audio isn't a failed try
+                numTries++;
+            }
+            if (!done && !pContext->paused && (numTries < LOG_UPLOAD_MAX_NUM_TRIES)) {
+                Thread::signal_wait(SIG_LOG_UPLOAD_STOP, LOG_UPLOAD_RETRY_INTERVAL_MS);
+            }
+        }
+
+        // Go round again if more log files turned up
+        // (see notifyLogUploadNewFiles()), otherwise
+        // say that we're done
+        core_util_critical_section_enter();
+        more = gLogUploadNewFiles && !gLogUploadStop;
+        gLogUploadNewFiles = false;
+        if (!more) {
+            gLogUploadTaskDone = true;
+        }
+        core_util_critical_section_exit();
+    } while (more);
+
+    LOG(EVENT_LOG_UPLOAD_STOP, pContext->numFilesUploaded);
+    printf("%d log file(s) uploaded.\n", pContext->numFilesUploaded);
+}
+
+// Free the log upload task and its context, which must
+// no longer be running.
+static void freeLogUploadTask()
+{
+    delete gpLogUploadTask;
+    gpLogUploadTask = NULL;
+    delete gpLogUploadContext;
+    gpLogUploadContext = NULL;
+}
+
+// Start the log upload task; gLogUploadMutex must be
+// locked and there must be no log upload task.
+static bool startLogUploadTask(const char *pDirPath, const char *pServerUrl)
+{
+    LogUploadContext *pContext;
+    const uint32_t *pUid = (const uint32_t *) UID_BASE;
+    bool success = true;
+    osStatus status;
+
+    pContext = new LogUploadContext;
+    memset(pContext, 0, sizeof (*pContext));
+    strncpy(pContext->dirPath, pDirPath, sizeof (pContext->dirPath) - 1);
+    strncpy(pContext->serverUrl, pServerUrl, sizeof (pContext->serverUrl) - 1);
+    pContext->protocolVersion = LOG_UPLOAD_PROTOCOL_VERSION;
+    snprintf(pContext->deviceId, sizeof (pContext->deviceId), "%08" PRIx32 "%08" PRIx32 "%08" PRIx32,
+             *(pUid + 2), *(pUid + 1), *pUid);
+    gpLogUploadContext = pContext;
+    gLogUploadStop = false;
+    gLogUploadNewFiles = false;
+    gLogUploadTaskDone = false;
+    gpLogUploadTask = new Thread(osPriorityBelowNormal, LOG_UPLOAD_STACK_SIZE, NULL, "log upload");
+    status = gpLogUploadTask->start(callback(&logUploadTask));
+    if (status == osOK) {
+        LOG(EVENT_LOG_UPLOAD_START, 0);
+    } else {
+        freeLogUploadTask();
+        LOG(EVENT_LOG_UPLOAD_START_FAILURE, status);
+        printf("Unable to start log upload task (%d).\n", status);
+        success = false;
+    }
+
+    return success;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Start the log upload task.
+bool startLogUpload(const char *pDirPath, const char *pServerUrl)
+{
+    bool success = true;
+
+    gLogUploadMutex.lock();
+    if ((gpLogUploadTask != NULL) && gLogUploadTaskDone) {
+        // Finished last time
+        gpLogUploadTask->join();
+        freeLogUploadTask();
+    }
+
+    if (gpLogUploadTask == NULL) {
+        success = startLogUploadTask(pDirPath, pServerUrl);
+    }
+    gLogUploadMutex.unlock();
+
+    return success;
+}
+
+// Let the log upload task know that there are new compact
+// log files.
+void notifyLogUploadNewFiles()
+{
+    char dirPath[LOG_UPLOAD_MAX_LEN_PATH];
+    char serverUrl[LOG_UPLOAD_MAX_LEN_SERVER_ADDRESS];
+    bool running;
+
+    gLogUploadMutex.lock();
+    // Nothing to do if log upload was never started, or
+    // has been stopped
+    if (gpLogUploadTask != NULL) {
+        core_util_critical_section_enter();
+        running = !gLogUploadTaskDone;
+        if (running) {
+            gLogUploadNewFiles = true;
+        }
+        core_util_critical_section_exit();
+        if (!running) {
+            // Finished, start it again with the same settings
+            strcpy(dirPath, gpLogUploadContext->dirPath);
+            strcpy(serverUrl, gpLogUploadContext->serverUrl);
+            gpLogUploadTask->join();
+            freeLogUploadTask();
+            startLogUploadTask(dirPath, serverUrl);
+        }
+    }
+    gLogUploadMutex.unlock();
+}
+
+// Stop uploading log files.
+void stopLogUpload()
+{
+    gLogUploadMutex.lock();
+    if (gpLogUploadTask != NULL) {
+        gLogUploadStop = true;
+        gpLogUploadTask->signal_set(SIG_LOG_UPLOAD_STOP);
+        gpLogUploadTask->join();
+        freeLogUploadTask();
+    }
+    gLogUploadMutex.unlock();
+}
+
+// Start a new budget period for log upload.
+void resetLogUploadBudget()
+{
+    LOG(EVENT_LOG_UPLOAD_BUDGET_RESET, gLogUploadBytesThisPeriod);
+    gLogUploadBytesThisPeriod = 0;
+    gLogUploadBudgetPeriodStart = time(NULL);
+}
+
+// End of file
@@ -0,0 +1,196 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+
+#ifndef _IOC_LOG_UPLOAD_
+#define _IOC_LOG_UPLOAD_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The version of the log upload protocol; the client falls
+// back to version 1 if the logging server doesn't support it.
+#define LOG_UPLOAD_PROTOCOL_VERSION 2
+
+// Set to false to never compress log data, whatever the
+// logging server supports.
+#define LOG_UPLOAD_COMPRESSION_ENABLED true
+
+// The name of the compression capability of the log upload
+// protocol (see ioc_lzss.h).
+#define LOG_UPLOAD_CAPABILITY_LZSS "LZSS"
+
+// The amount of a log file sent in one chunk.
+#define LOG_UPLOAD_CHUNK_SIZE 1024
+
+// The number of bytes at the start of a log file that go
+// into its identity (see below); no more than
+// LOG_UPLOAD_CHUNK_SIZE.
+#define LOG_UPLOAD_IDENTITY_LENGTH 1024
+
+// The uploaded offset is saved in the log index after
+// this many chunks (and at the end of each file).
+#define LOG_UPLOAD_SAVE_INTERVAL_CHUNKS 8
+
+// The longest a budget period lasts if the device doesn't
+// sleep.
+#define LOG_UPLOAD_BUDGET_PERIOD_SECONDS (24 * 3600)
+
+// The maximum number of log files uploaded in one go.
+#define LOG_UPLOAD_MAX_NUM_FILES 32
+
+// The maximum length of a log file path (including
+// terminator).
+#define LOG_UPLOAD_MAX_LEN_PATH 64
+
+// The maximum length of a line of the protocol (including
+// terminator).
+#define LOG_UPLOAD_MAX_LEN_LINE 80
+
+// The maximum length of the logging server address (including
+// terminator).
+#define LOG_UPLOAD_MAX_LEN_SERVER_ADDRESS 128
+
+// How long to wait for the logging server to respond.
+#define LOG_UPLOAD_SOCKET_TIMEOUT_MS 5000
+
+// How long to wait before trying again after an upload
+// has failed.
+#define LOG_UPLOAD_RETRY_INTERVAL_MS 30000
+
+// The number of times an upload is tried before giving up
+// until the next call to startLogUpload().
+#define LOG_UPLOAD_MAX_NUM_TRIES 5
+
+// How often the upload checks whether it may go on while
+// it is paused.
+#define LOG_UPLOAD_PAUSE_CHECK_INTERVAL_MS 1000
+
+// If an upload has been paused for longer than this the
+// connection to the logging server is given up, to be made
+// again when the upload resumes.
+#define LOG_UPLOAD_MAX_PAUSE_MS 30000
+
+// Upload is paused while more than this many URTP datagrams
+// are queued for sending.
+#define LOG_UPLOAD_MAX_DATAGRAMS_QUEUED 0
+
+// The stack size of the log upload task.
+#define LOG_UPLOAD_STACK_SIZE OS_STACK_SIZE
+
+/* The log upload protocol
+ *
+ * Compact log files (see ioc_log_compact.h) are uploaded to the
+ * logging server over TCP, a chunk at a time, so that an upload
+ * which is interrupted resumes where it stopped rather than
+ * starting again.  Lines are ASCII, ending in '\n':
+ *
+ * C: IOCU <version> <device ID> [<capability>...]
+ *                                       once per connection
+ * S: OK [<capability>...]               those the server will use
+ * C: FILE <name> <size> <offset> <identity>
+ *                                       offset: what the client
+ *                                       has saved as uploaded
+ * S: OFFSET <n>                         n: what the server holds
+ * C: DATA <n> <length>, then <length> bytes of the file from n
+ *    or, with capability LZSS,
+ * C: ZDATA <n> <length> <compressed length>, then the LZSS
+ *    compressed form of <length> bytes of the file from n
+ * S: ACK <n>                            n: what the server now holds
+ *    ...DATA/ACK until n is the size of the file, which the
+ *       client then deletes; then the next FILE...
+ * C: BYE
+ *
+ * The server is authoritative: the client always carries on from
+ * the offset in the last OFFSET or ACK, so a chunk that did not
+ * arrive, or arrived twice, is put right.  The server answers
+ * anything it can't deal with with "ERROR <text>", which ends
+ * the connection.  The offsets saved on the client are kept in
+ * the log index (see ioc_log_index.h).
+ *
+ * With LZSS, the bytes carried by the DATA and ZDATA lines since
+ * the FILE line form one compressed stream (see ioc_lzss.h), so
+ * that a chunk can refer back to the chunks before it; the server
+ * must decompress every chunk, even one that it doesn't keep, and
+ * add the bytes of a DATA chunk, which the client sends when
+ * compression doesn't help, to the stream too.
+ *
+ * Log file names are reused, e.g. when the log index is rebuilt,
+ * so the identity, eight hex digits, is a 32 bit FNV-1a hash of
+ * the time at which the log file was begun (four bytes, little-
+ * endian) followed by its first LOG_UPLOAD_IDENTITY_LENGTH bytes.
+ * If the file the server holds under that name has a different
+ * identity the server starts it again from nothing.  Version 1
+ * has no capabilities and no identity on the FILE line.
+ * tools/log_server.py is a stand-in for the logging server.
+ */
+
+/* Scheduling
+ *
+ * The upload shares the modem with audio streaming, which must
+ * never lose a datagram on its account, and with Mbed Cloud
+ * Client.  So, before each chunk, the upload pauses for as long
+ * as audio streaming is enabled or URTP datagrams are queued,
+ * otherwise it goes at full rate.  The amount uploaded in a
+ * budget period, which begins each time the device wakes up or,
+ * if it stays awake, every LOG_UPLOAD_BUDGET_PERIOD_SECONDS, may
+ * be limited to a budget, configured through the LWM2M
+ * configuration object (by default there is no limit); when the
+ * budget is spent the upload pauses until the next period.
+ */
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Start the task that uploads the compact log files in the
+ * log index to the logging server, deleting each one once the
+ * server has all of it; files which are not compact (e.g. the
+ * log file currently being written) are left alone.  The task
+ * runs below normal priority, retries a failed upload up to
+ * LOG_UPLOAD_MAX_NUM_TRIES times and exits when done; call
+ * notifyLogUploadNewFiles() when there are more files for it.
+ *
+ * @param pDirPath    the directory containing the log files.
+ * @param pServerUrl  the logging server, "address:port".
+ * @return            true if the task was started, otherwise false.
+ */
+bool startLogUpload(const char *pDirPath, const char *pServerUrl);
+
+/** Let log upload know that there are new compact log files
+ * in the log index, e.g. a log ring file that has just been
+ * rotated out: the log upload task goes round again for them,
+ * or is started again, with the settings it was last started
+ * with, if it has finished.  Does nothing if log upload has
+ * not been started or has been stopped.
+ */
+void notifyLogUploadNewFiles();
+
+/** Stop uploading log files, saving the uploaded offsets; call
+ * this before the network or file system is shut down.
+ */
+void stopLogUpload();
+
+/** Start a new budget period for log upload, i.e. allow another
+ * getLogUploadBudgetBytes() bytes to be uploaded; call this on
+ * waking up from sleep.
+ */
+void resetLogUploadBudget();
+
+#endif // _IOC_LOG_UPLOAD_
+
+// End of file
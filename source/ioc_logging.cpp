@@ -17,12 +17,43 @@
 #include "mbed.h"
 #include "MbedCloudClient.h"
 #include "m2m_object_helper.h"
+#include "low_power.h"
 #include "log.h"
 
 #include "ioc_logging.h"
+#include "ioc_log_ring.h"
 #include "ioc_utils.h"
 
-/* This file implements the control of logging.
+/* This file implements the control of logging, including the
+ * task that writes the log to file.
+ *
+ * LOG() only ever writes to the log store in RAM; writeLog()
+ * moves what has been logged from there to the log file on the
+ * SD card, which can take hundreds of milliseconds if the card
+ * is busy.  So that this doesn't hold up everything else on the
+ * event queue (e.g. LWM2M updates), writeLog() is called from a
+ * task of its own, at below normal priority, which writes the
+ * log periodically or when asked to by flushLog().  The log
+ * store is the staging buffer, filled by LOG() while the task
+ * empties it, and the file system gathers what is written into
+ * whole blocks before it goes to the SD card.
+ *
+ * Events that are too frequent to log all of the time (e.g.
+ * those on the audio hot path) are logged with LOG_FILTERED(),
+ * which checks the event's bit in the log filter before going
+ * anywhere near LOG().  The filter is set through the LWM2M
+ * configuration object so that detailed tracing can be turned
+ * on, or sampled, in the field.  LOG_FILTERED() puts what it
+ * logs into the log ring (see ioc_log_ring.h) rather than the
+ * log store, so that it never takes a lock, and the log writer
+ * task writes the log ring out alongside the log.
+ *
+ * Before going to sleep, checkpointLog() writes out the log and
+ * commits the files to the SD card but closes nothing, so that
+ * logging carries on where it left off on waking from Stop mode
+ * and the SD card sees no more than the data.  Only standby,
+ * which loses the log store in RAM, needs the full
+ * stopLogWriter()/deinitLog().
  */
 
 /* ----------------------------------------------------------------
@@ -34,6 +65,12 @@
 #define LOGGING_DEFAULT_UPLOAD_ENABLED  true
 #define LOGGING_DEFAULT_SERVER_URL      "ciot.it-sgn.u-blox.com:5060"
 
+// Signal to the log writer task to write the log now.
+#define SIG_LOG_FLUSH 0x01
+
+// Signal to the log writer task to write the log and exit.
+#define SIG_LOG_STOP 0x02
+
 /* ----------------------------------------------------------------
  * TYPES
  * -------------------------------------------------------------- */
@@ -45,18 +82,287 @@ typedef struct {
     String loggingServerUrl;
 } LoggingLocal;
 
+// An event sampled by the log filter.
+typedef struct {
+    int event;
+    int everyN;
+} LogFilterSample;
+
 /* ----------------------------------------------------------------
  * VARIABLES
  * -------------------------------------------------------------- */
 
+// The log filter enable bits.
+BACKUP_SRAM
+volatile uint32_t gLogFilterEnabled[LOG_FILTER_MAX_NUM_EVENTS / 32];
+
+// The events sampled by the log filter.
+BACKUP_SRAM
+static LogFilterSample gLogFilterSample[LOG_FILTER_MAX_NUM_SAMPLED];
+
+// The number of events sampled by the log filter.
+BACKUP_SRAM
+static int gLogFilterNumSampled;
+
+// The string form of the log filter.
+BACKUP_SRAM
+static char gLogFilterString[LOG_FILTER_MAX_LEN_STRING];
+
+// The number of times each sampled event has occurred.
+static uint32_t gLogFilterCount[LOG_FILTER_MAX_NUM_SAMPLED];
+
 static LoggingLocal gLoggingLocal = {LOGGING_DEFAULT_TO_FILE_ENABLED,
                                      LOGGING_DEFAULT_TO_FILE_ENABLED,
                                      LOGGING_DEFAULT_SERVER_URL};
 
+// The log writer task.
+static Thread *gpLogWriterTask = NULL;
+
+// Released by the log writer task when a flush is done.
+static Semaphore gLogFlushed(0);
+
+// Mutex to protect the above.
+static Mutex gLogWriterMutex;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// The body of the log writer task.
+static void logWriterTask()
+{
+    osEvent event;
+    bool stop = false;
+
+    while (!stop) {
+        event = Thread::signal_wait(0, LOG_WRITE_INTERVAL_MS);
+        writeLog();
+        writeLogRing();
+        if (event.status == osEventSignal) {
+            if (event.value.signals & SIG_LOG_FLUSH) {
+                gLogFlushed.release();
+            }
+            stop = ((event.value.signals & SIG_LOG_STOP) != 0);
+        }
+    }
+}
+
+// Skip spaces.
+static const char *pSkipSpaces(const char *p)
+{
+    while (*p == ' ') {
+        p++;
+    }
+
+    return p;
+}
+
+// Parse a number, returning NULL on error.
+static const char *pParseNumber(const char *p, int *pValue)
+{
+    int value = 0;
+    int numDigits = 0;
+
+    while ((*p >= '0') && (*p <= '9') && (numDigits < 6)) {
+        value = value * 10 + *p - '0';
+        numDigits++;
+        p++;
+    }
+    if ((numDigits == 0) || ((*p >= '0') && (*p <= '9'))) {
+        return NULL;
+    }
+    *pValue = value;
+
+    return p;
+}
+
 /* ----------------------------------------------------------------
  * PUBLIC: INITIALISATION
  * -------------------------------------------------------------- */
 
+// Start the log writer task.
+bool startLogWriter()
+{
+    bool success = true;
+    osStatus status;
+
+    gLogWriterMutex.lock();
+    if (gpLogWriterTask == NULL) {
+        gpLogWriterTask = new Thread(osPriorityBelowNormal, LOG_WRITER_STACK_SIZE, NULL, "log writer");
+        status = gpLogWriterTask->start(callback(&logWriterTask));
+        if (status != osOK) {
+            delete gpLogWriterTask;
+            gpLogWriterTask = NULL;
+            LOG(EVENT_LOG_WRITER_START_FAILURE, status);
+            printf("Unable to start log writer task (%d).\n", status);
+            success = false;
+        }
+    }
+    gLogWriterMutex.unlock();
+
+    return success;
+}
+
+// Write the log to file and stop the log writer task.
+void stopLogWriter()
+{
+    gLogWriterMutex.lock();
+    if (gpLogWriterTask != NULL) {
+        gpLogWriterTask->signal_set(SIG_LOG_STOP);
+        gpLogWriterTask->join();
+        delete gpLogWriterTask;
+        gpLogWriterTask = NULL;
+    }
+    closeLogRingFile();
+    gLogWriterMutex.unlock();
+}
+
+// Write the log to file now.
+void flushLog()
+{
+    gLogWriterMutex.lock();
+    if (gpLogWriterTask != NULL) {
+        // Clear out any release left over from a flush
+        // that timed out, then ask for a flush and wait
+        while (gLogFlushed.wait(0) > 0) {}
+        gpLogWriterTask->signal_set(SIG_LOG_FLUSH);
+        if (gLogFlushed.wait(LOG_FLUSH_TIMEOUT_MS) <= 0) {
+            LOG(EVENT_LOG_FLUSH_TIMEOUT, LOG_FLUSH_TIMEOUT_MS);
+        }
+    } else {
+        writeLog();
+        writeLogRing();
+    }
+    gLogWriterMutex.unlock();
+}
+
+// Write the log to file and commit it to the SD card, leaving
+// the log writer task running.
+void checkpointLog()
+{
+    flushLog();
+    syncLogRingFile();
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: LOG FILTER
+ * -------------------------------------------------------------- */
+
+// Disable all of the filtered log events.
+void resetLogFilter()
+{
+    setLogFilter("");
+}
+
+// Set the log filter from its string form.
+// Note: here be multiple return statements.
+bool setLogFilter(const char *pString)
+{
+    uint32_t enabled[LOG_FILTER_MAX_NUM_EVENTS / 32];
+    LogFilterSample sample[LOG_FILTER_MAX_NUM_SAMPLED];
+    int numSampled = 0;
+    int event;
+    int everyN;
+    const char *p = pSkipSpaces(pString);
+
+    if (strlen(pString) >= sizeof (gLogFilterString)) {
+        return false;
+    }
+
+    memset(enabled, 0, sizeof (enabled));
+    while (*p != 0) {
+        event = -1;
+        everyN = 1;
+        if (*p == '*') {
+            p++;
+        } else {
+            p = pParseNumber(p, &event);
+            if ((p == NULL) || (event >= LOG_FILTER_MAX_NUM_EVENTS)) {
+                return false;
+            }
+        }
+        if (*p == '/') {
+            p = pParseNumber(p + 1, &everyN);
+            if ((p == NULL) || (everyN < 1)) {
+                return false;
+            }
+        }
+        if (event < 0) {
+            // Can't sample everything
+            if (everyN > 1) {
+                return false;
+            }
+            memset(enabled, 0xFF, sizeof (enabled));
+        } else {
+            enabled[event >> 5] |= 1UL << (event & 0x1f);
+            if (everyN > 1) {
+                if (numSampled >= LOG_FILTER_MAX_NUM_SAMPLED) {
+                    return false;
+                }
+                sample[numSampled].event = event;
+                sample[numSampled].everyN = everyN;
+                numSampled++;
+            }
+        }
+        p = pSkipSpaces(p);
+        if (*p == ',') {
+            p = pSkipSpaces(p + 1);
+        } else if (*p != 0) {
+            return false;
+        }
+    }
+
+    // Disable everything while the sampling is changed,
+    // since LOG_FILTERED() may be called from interrupt
+    // context
+    for (unsigned int x = 0; x < sizeof (enabled) / sizeof (enabled[0]); x++) {
+        gLogFilterEnabled[x] = 0;
+    }
+    memcpy(gLogFilterSample, sample, sizeof (sample[0]) * numSampled);
+    memset(gLogFilterCount, 0, sizeof (gLogFilterCount));
+    gLogFilterNumSampled = numSampled;
+    for (unsigned int x = 0; x < sizeof (enabled) / sizeof (enabled[0]); x++) {
+        gLogFilterEnabled[x] = enabled[x];
+    }
+    strcpy(gLogFilterString, pString);
+
+    return true;
+}
+
+// Get the string form of the log filter.
+const char *pGetLogFilterString()
+{
+    // Back-up SRAM may contain garbage after a power-on reset
+    // and before resetLogFilter() is called, so be safe
+    gLogFilterString[sizeof (gLogFilterString) - 1] = 0;
+
+    return gLogFilterString;
+}
+
+// Log an event that the log filter enables.
+// Note: here be multiple return statements.
+void logFilteredEvent(int event, int parameter)
+{
+    int numSampled = gLogFilterNumSampled;
+
+    for (int x = 0; (x < numSampled) && (x < LOG_FILTER_MAX_NUM_SAMPLED); x++) {
+        if (gLogFilterSample[x].event == event) {
+            if ((gLogFilterSample[x].everyN > 1) &&
+                ((core_util_atomic_incr_u32(&gLogFilterCount[x], 1) - 1) %
+                 gLogFilterSample[x].everyN != 0)) {
+                return;
+            }
+            break;
+        }
+    }
+
+    LOG_RING(event, parameter);
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: LOGGING CONFIGURATION
+ * -------------------------------------------------------------- */
+
 // Return whether loggin to file is enabled or not.
 bool isLoggingToFileEnabled()
 {
@@ -18,10 +18,126 @@
 #ifndef _IOC_LOGGING_
 #define _IOC_LOGGING_
 
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The log write interval.
+#define LOG_WRITE_INTERVAL_MS 1000
+
+// The longest flushLog() will wait for the log to be written.
+#define LOG_FLUSH_TIMEOUT_MS 5000
+
+// The stack size of the log writer task, which has to
+// get through the file system and the SD card driver.
+#define LOG_WRITER_STACK_SIZE OS_STACK_SIZE
+
+// The number of log events covered by the log filter;
+// events beyond this are always logged.
+#define LOG_FILTER_MAX_NUM_EVENTS 512
+
+// The maximum number of events that the log filter
+// can sample.
+#define LOG_FILTER_MAX_NUM_SAMPLED 8
+
+// The maximum length of the string form of the log filter
+// (including terminator).
+#define LOG_FILTER_MAX_LEN_STRING 128
+
+/** Log an event that is only wanted when tracing in detail,
+ * e.g. on the audio hot path: the event is logged only if the
+ * log filter (see setLogFilter()) enables it, which costs a
+ * single bit test when it does not, and then only one time
+ * in N if the filter samples it.  May be called from interrupt
+ * context.
+ */
+#define LOG_FILTERED(event, parameter)                           \
+    do {                                                         \
+        if (IS_LOG_EVENT_ENABLED(event)) {                       \
+            logFilteredEvent(event, parameter);                  \
+        }                                                        \
+    } while (0)
+
+/** Determine whether the log filter enables an event.
+ */
+#define IS_LOG_EVENT_ENABLED(event)                              \
+    (((unsigned int) (event) < LOG_FILTER_MAX_NUM_EVENTS) &&     \
+     ((gLogFilterEnabled[(unsigned int) (event) >> 5] &          \
+       (1UL << ((unsigned int) (event) & 0x1f))) != 0))
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+/** The enable bits of the log filter, one per event; only
+ * for use by IS_LOG_EVENT_ENABLED().
+ */
+extern volatile uint32_t gLogFilterEnabled[LOG_FILTER_MAX_NUM_EVENTS / 32];
+
 /* ----------------------------------------------------------------
  * FUNCTION PROTOTYPES
  * -------------------------------------------------------------- */
 
+/** Start the task that writes the log to file, below normal
+ * priority, every LOG_WRITE_INTERVAL_MS; initLogFile() must
+ * have been called.
+ * @return true if the task was started, otherwise false.
+ */
+bool startLogWriter();
+
+/** Write the log to file and stop the log writer task; call
+ * this before deinitLog().
+ */
+void stopLogWriter();
+
+/** Write the log to file now, waiting (for up to
+ * LOG_FLUSH_TIMEOUT_MS) until it has been written.
+ */
+void flushLog();
+
+/** Write the log to file, as flushLog(), and commit the log
+ * ring file to the SD card, without stopping the log writer
+ * task or closing the log file; call this before a sleep
+ * that keeps RAM (e.g. Stop mode) in place of stopLogWriter()
+ * and deinitLog().
+ */
+void checkpointLog();
+
+/** Disable all of the events logged with LOG_FILTERED();
+ * call this at power-on, the filter being otherwise
+ * retained through standby.
+ */
+void resetLogFilter();
+
+/** Set the log filter, which determines which of the events
+ * logged with LOG_FILTERED() are logged, from its string form:
+ * a list of events separated by ',', each of the form
+ * "event[/N]", where event is the number of the event, as
+ * printed by tools/log_decode.py, or "*" for all events, and
+ * N, if present, means that only one in N of that event is
+ * logged, e.g. "108/50,143".  Events that are not listed are
+ * not logged; an empty string disables them all.
+ *
+ * @param pString the filter as a null terminated string.
+ * @return        true if the filter was valid and has been
+ *                set, false if it was not valid, in which case
+ *                the filter is unchanged.
+ */
+bool setLogFilter(const char *pString);
+
+/** Get the string form of the log filter.
+ * @return a pointer to a null terminated string.
+ */
+const char *pGetLogFilterString();
+
+/** Log an event that the log filter enables, applying
+ * any sampling, to the log ring; use LOG_FILTERED() rather
+ * than calling this directly.
+ * @param event     the event.
+ * @param parameter the parameter to log with it.
+ */
+void logFilteredEvent(int event, int parameter);
+
 /** Return whether logging to file is enabled or not.
  * @return true if logging to file is enabled, otherwise false.
  */
@@ -0,0 +1,138 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "ioc_lzss.h"
+
+/* This file implements an LZSS compressor, of the heatshrink
+ * kind, for streams (see ioc_lzss.h).  It needs no more RAM than
+ * its LzssState and looks for a match at only one place, the
+ * last position with the same hash, which costs some compression
+ * but keeps it quick enough to run a chunk at a time alongside
+ * reading the SD card.
+ */
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Hash the three bytes at p.
+static unsigned int hash(const uint8_t *p)
+{
+    uint32_t x = ((uint32_t) *p << 16) | ((uint32_t) *(p + 1) << 8) | *(p + 2);
+
+    return (uint32_t) (x * 2654435761U) >> (32 - LZSS_HASH_BITS);
+}
+
+// Return the length of the match at pIn with the window at
+// a given position, no longer than maxLength.
+static int matchLength(const LzssState *pState, uint32_t position,
+                       const uint8_t *pIn, int maxLength)
+{
+    int length = 0;
+
+    while ((length < maxLength) &&
+           (pState->window[(position + length) & (LZSS_WINDOW_SIZE - 1)] == *(pIn + length))) {
+        length++;
+    }
+
+    return length;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Begin a new stream.
+void lzssReset(LzssState *pState)
+{
+    memset(pState->head, 0, sizeof (pState->head));
+    pState->position = 0;
+}
+
+// Compress the next block of a stream.
+int lzssCompress(LzssState *pState, const char *pIn, int length, char *pOut)
+{
+    const uint8_t *pBytes = (const uint8_t *) pIn;
+    uint8_t *pFlags = NULL;
+    int outLength = 0;
+    int numItems = 0;
+    int matched;
+    int maxLength;
+    unsigned int h;
+    uint32_t candidate;
+    uint32_t distance;
+    int x = 0;
+
+    while (x < length) {
+        if (numItems % 8 == 0) {
+            pFlags = (uint8_t *) pOut + outLength;
+            *pFlags = 0;
+            outLength++;
+        }
+
+        // Look for a match, which may not run past the end of
+        // the block or overlap the bytes it produces
+        matched = 0;
+        distance = 0;
+        if (x + LZSS_MIN_MATCH <= length) {
+            h = hash(pBytes + x);
+            candidate = pState->head[h];
+            if (candidate > 0) {
+                distance = pState->position - (candidate - 1);
+                if ((distance > 0) && (distance <= LZSS_WINDOW_SIZE)) {
+                    maxLength = length - x;
+                    if (maxLength > LZSS_MAX_MATCH) {
+                        maxLength = LZSS_MAX_MATCH;
+                    }
+                    if (maxLength > (int) distance) {
+                        maxLength = distance;
+                    }
+                    matched = matchLength(pState, candidate - 1, pBytes + x, maxLength);
+                }
+            }
+        }
+
+        if (matched >= LZSS_MIN_MATCH) {
+            *pFlags |= 1 << (numItems % 8);
+            *(pOut + outLength) = (char) ((((distance - 1) << LZSS_LENGTH_BITS) |
+                                           (matched - LZSS_MIN_MATCH)) >> 8);
+            *(pOut + outLength + 1) = (char) (((distance - 1) << LZSS_LENGTH_BITS) |
+                                              (matched - LZSS_MIN_MATCH));
+            outLength += 2;
+        } else {
+            matched = 1;
+            *(pOut + outLength) = *(pIn + x);
+            outLength++;
+        }
+        numItems++;
+
+        // Move what was matched into the window, remembering
+        // where each position that can be hashed was
+        for (int y = 0; y < matched; y++) {
+            if (x + LZSS_MIN_MATCH <= length) {
+                pState->head[hash(pBytes + x)] = pState->position + 1;
+            }
+            pState->window[pState->position & (LZSS_WINDOW_SIZE - 1)] = *(pBytes + x);
+            pState->position++;
+            x++;
+        }
+    }
+
+    return outLength;
+}
+
+// End of file
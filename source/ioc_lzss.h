@@ -0,0 +1,103 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdint.h>
+
+#ifndef _IOC_LZSS_
+#define _IOC_LZSS_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of bits of a match offset; the window, how far
+// back a match can reach, is two to the power of this.
+#define LZSS_OFFSET_BITS 11
+
+// The number of bits of a match length.
+#define LZSS_LENGTH_BITS 5
+
+// The size of the window.
+#define LZSS_WINDOW_SIZE (1 << LZSS_OFFSET_BITS)
+
+// The shortest and longest matches.
+#define LZSS_MIN_MATCH 3
+#define LZSS_MAX_MATCH (LZSS_MIN_MATCH + (1 << LZSS_LENGTH_BITS) - 1)
+
+// The number of bits of the hash used to find matches.
+#define LZSS_HASH_BITS 9
+
+/** The most that a block of length bytes can compress to:
+ * one flag byte for every eight literals.
+ */
+#define LZSS_MAX_COMPRESSED_SIZE(length) ((length) + (((length) + 7) / 8))
+
+/* The LZSS stream format
+ *
+ * A stream is compressed a block at a time, each block being
+ * compressed to a whole number of bytes, while matches may reach
+ * back into the blocks before it, by up to LZSS_WINDOW_SIZE
+ * bytes; the decompressor must therefore see every block, in
+ * order, from the last lzssReset().  A compressed block is a
+ * sequence of groups of up to eight items, each group beginning
+ * with a flag byte, bit 0 of which is for the first item: 0 for
+ * a literal byte, which follows as is, 1 for a match, which
+ * follows as two bytes, big-endian, the top LZSS_OFFSET_BITS
+ * bits being the distance back less one and the bottom
+ * LZSS_LENGTH_BITS bits the length less LZSS_MIN_MATCH.  A match
+ * never overlaps the bytes it produces.  tools/log_server.py has
+ * a decompressor.
+ */
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+/** The state of a compressed stream: its window and the table
+ * used to find matches in it; about 4 kbytes.
+ */
+typedef struct {
+    uint8_t window[LZSS_WINDOW_SIZE];
+    uint32_t head[1 << LZSS_HASH_BITS]; // Position + 1, 0 if none.
+    uint32_t position;
+} LzssState;
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Begin a new stream.
+ *
+ * @param pState the stream.
+ */
+void lzssReset(LzssState *pState);
+
+/** Compress the next block of a stream.  Whatever is done with
+ * the result, the block becomes part of the window: if it is
+ * sent uncompressed the decompressor must still add it to its
+ * window.
+ *
+ * @param pState the stream.
+ * @param pIn    the block.
+ * @param length the length of the block.
+ * @param pOut   somewhere to put the compressed block, at least
+ *               LZSS_MAX_COMPRESSED_SIZE(length) bytes.
+ * @return       the length of the compressed block.
+ */
+int lzssCompress(LzssState *pState, const char *pIn, int length, char *pOut);
+
+#endif // _IOC_LZSS_
+
+// End of file
@@ -19,6 +19,7 @@
 #include "log.h"
 
 #include "ioc_utils.h"
+#include "ioc_network_stats.h"
 #include "ioc_network.h"
 
 /* This file implements cellular network connectivity.
@@ -75,6 +76,7 @@ NetworkInterface *pInitNetwork()
     pSecondTicker->detach();
     delete pSecondTicker;
     LOG(EVENT_NETWORK_CONNECTED, 0);
+    startNetworkStats();
 
     return (NetworkInterface *) gpCellular;
 }
@@ -83,6 +85,7 @@ NetworkInterface *pInitNetwork()
 void deinitNetwork()
 {
     if (gpCellular != NULL) {
+        stopNetworkStats();
         feedWatchdog();
         flash();
         LOG(EVENT_NETWORK_DISCONNECTING, 0);
@@ -0,0 +1,363 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "MbedCloudClient.h"
+#include "m2m_object_helper.h"
+#include "lwip/opt.h"
+#include "lwip/stats.h"
+#include "log.h"
+
+#include "ioc_utils.h"
+#include "ioc_network_stats.h"
+
+/* This file implements collection of the lwIP statistics which
+ * matter when tuning TCP_WND, TCP_SND_BUF, PBUF_POOL_SIZE and
+ * MEMP_NUM_TCP_SEG: TCP retransmissions, pbuf pool exhaustion,
+ * TCP segment pool use and PPP frame errors.  They are sampled
+ * on the system monitor tick, anything that has got worse is
+ * logged, a summary is logged at the end of each network session
+ * and they are reported through an LWM2M object.
+ *
+ * The lwIP counters are STAT_COUNTERs, which are only 16 bits
+ * wide unless LWIP_STATS_LARGE is set, so they are accumulated
+ * here into 32 bit totals; this is fine provided no counter
+ * goes up by more than 65535 between samples.  The counters are
+ * only there if lwIP is built with LWIP_STATS, which the mbed-os
+ * lwipopts.h forces off unless lwip.debug-enabled is set, hence
+ * that is set in mbed_app.json, along with MEMP_STATS, LINK_STATS
+ * and, for the TCP retransmissions, MIB2_STATS; the other lwIP
+ * statistics are switched off there to save RAM.
+ */
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Which of the lwIP statistics are available.
+#define NETWORK_STATS_MIB2 (LWIP_STATS && MIB2_STATS && LWIP_TCP)
+#define NETWORK_STATS_MEMP (LWIP_STATS && MEMP_STATS && LWIP_TCP)
+#define NETWORK_STATS_LINK (LWIP_STATS && LINK_STATS)
+
+#if !NETWORK_STATS_MIB2 || !NETWORK_STATS_MEMP || !NETWORK_STATS_LINK
+# error lwIP statistics missing: set lwip.debug-enabled, MEMP_STATS, LINK_STATS and MIB2_STATS in mbed_app.json.
+#endif
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+#if LWIP_STATS
+// The lwIP counters as at the last sample.
+typedef struct {
+    STAT_COUNTER tcpRetransSegs;
+    STAT_COUNTER pbufPoolErr;
+    STAT_COUNTER tcpSegErr;
+    STAT_COUNTER linkChkErr;
+    STAT_COUNTER linkLenErr;
+    STAT_COUNTER linkProtErr;
+    STAT_COUNTER linkDrop;
+} NetworkStatsLast;
+#endif
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The network statistics since power-on/wake-up.
+static NetworkStats gNetworkStats = {-1, -1, -1, -1, -1, -1, -1, -1};
+
+#if LWIP_STATS
+// The lwIP counters as at the last sample.
+static NetworkStatsLast gNetworkStatsLast = {0};
+#endif
+
+// The network statistics and time at the start of
+// the network session, if there is one.
+static NetworkStats gNetworkStatsSession;
+static time_t gNetworkSessionStartTime = 0;
+static bool gNetworkSessionStarted = false;
+
+// Mutex to protect the above.
+static Mutex gNetworkStatsMutex;
+
+// The LWM2M object.
+static IocM2mNetworkStats *gpM2mObject = NULL;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: MISC
+ * -------------------------------------------------------------- */
+
+#if LWIP_STATS
+// Add the increase in an lwIP counter to a total.
+static void accumulate(int32_t *pTotal, STAT_COUNTER *pLast, STAT_COUNTER now)
+{
+    if (*pTotal < 0) {
+        *pTotal = 0;
+    }
+    *pTotal += (STAT_COUNTER) (now - *pLast);
+    *pLast = now;
+}
+#endif
+
+// Log a value if it has gone up.
+static void logIfUp(LogEvent event, int32_t now, int32_t previous)
+{
+    if (now > previous) {
+        LOG(event, now);
+    }
+}
+
+// Return the change in a value over the session, -1
+// if not known.
+static int32_t sessionDelta(int32_t now, int32_t start)
+{
+    if (now < 0) {
+        return -1;
+    }
+    if (start < 0) {
+        start = 0;
+    }
+
+    return now - start;
+}
+
+// Sample the lwIP statistics; gNetworkStatsMutex must
+// be locked.
+static void sampleNetworkStatsLocked()
+{
+    NetworkStats previous = gNetworkStats;
+
+#if NETWORK_STATS_MIB2
+    accumulate(&gNetworkStats.numTcpRetransmissions, &gNetworkStatsLast.tcpRetransSegs,
+               lwip_stats.mib2.tcpretranssegs);
+#endif
+#if NETWORK_STATS_MEMP
+    accumulate(&gNetworkStats.numPbufPoolExhausted, &gNetworkStatsLast.pbufPoolErr,
+               lwip_stats.memp[MEMP_PBUF_POOL]->err);
+    accumulate(&gNetworkStats.numTcpSegExhausted, &gNetworkStatsLast.tcpSegErr,
+               lwip_stats.memp[MEMP_TCP_SEG]->err);
+    gNetworkStats.numTcpSegsUsed = lwip_stats.memp[MEMP_TCP_SEG]->used;
+    gNetworkStats.numTcpSegsMaxUsed = lwip_stats.memp[MEMP_TCP_SEG]->max;
+    gNetworkStats.numTcpSegsAvailable = lwip_stats.memp[MEMP_TCP_SEG]->avail;
+#endif
+#if NETWORK_STATS_LINK
+    accumulate(&gNetworkStats.numPppFrameErrors, &gNetworkStatsLast.linkChkErr,
+               lwip_stats.link.chkerr);
+    accumulate(&gNetworkStats.numPppFrameErrors, &gNetworkStatsLast.linkLenErr,
+               lwip_stats.link.lenerr);
+    accumulate(&gNetworkStats.numPppFrameErrors, &gNetworkStatsLast.linkProtErr,
+               lwip_stats.link.proterr);
+    accumulate(&gNetworkStats.numPppFramesDropped, &gNetworkStatsLast.linkDrop,
+               lwip_stats.link.drop);
+#endif
+
+    logIfUp(EVENT_NETWORK_STATS_TCP_RETRANSMISSIONS, gNetworkStats.numTcpRetransmissions,
+            previous.numTcpRetransmissions);
+    logIfUp(EVENT_NETWORK_STATS_PBUF_POOL_EXHAUSTED, gNetworkStats.numPbufPoolExhausted,
+            previous.numPbufPoolExhausted);
+    logIfUp(EVENT_NETWORK_STATS_TCP_SEG_EXHAUSTED, gNetworkStats.numTcpSegExhausted,
+            previous.numTcpSegExhausted);
+    logIfUp(EVENT_NETWORK_STATS_TCP_SEGS_MAX_USED, gNetworkStats.numTcpSegsMaxUsed,
+            previous.numTcpSegsMaxUsed);
+    logIfUp(EVENT_NETWORK_STATS_PPP_FRAME_ERRORS, gNetworkStats.numPppFrameErrors,
+            previous.numPppFrameErrors);
+    logIfUp(EVENT_NETWORK_STATS_PPP_FRAMES_DROPPED, gNetworkStats.numPppFramesDropped,
+            previous.numPppFramesDropped);
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: HOOK FOR NETWORK STATS M2M C++ OBJECT
+ * -------------------------------------------------------------- */
+
+// Callback that gets data for the IocM2mNetworkStats object.
+static bool getNetworkStatsData(IocM2mNetworkStats::Stats *pData)
+{
+    NetworkStats stats;
+
+    getNetworkStats(&stats);
+    pData->numTcpRetransmissions = stats.numTcpRetransmissions;
+    pData->numPbufPoolExhausted = stats.numPbufPoolExhausted;
+    pData->numTcpSegExhausted = stats.numTcpSegExhausted;
+    pData->numPppFrameErrors = stats.numPppFrameErrors;
+    pData->numPppFramesDropped = stats.numPppFramesDropped;
+    pData->numTcpSegsUsed = stats.numTcpSegsUsed;
+    pData->numTcpSegsMaxUsed = stats.numTcpSegsMaxUsed;
+    pData->numTcpSegsAvailable = stats.numTcpSegsAvailable;
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: INITIALISATION
+ * -------------------------------------------------------------- */
+
+// Initialise the network stats object.
+IocM2mNetworkStats *pInitNetworkStats()
+{
+    gpM2mObject = new IocM2mNetworkStats(getNetworkStatsData, MBED_CONF_APP_OBJECT_DEBUG_ON);
+
+    return gpM2mObject;
+}
+
+// Shut down the network stats object.
+void deinitNetworkStats()
+{
+    delete gpM2mObject;
+    gpM2mObject = NULL;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: MISC
+ * -------------------------------------------------------------- */
+
+// Note the start of a network session.
+void startNetworkStats()
+{
+    gNetworkStatsMutex.lock();
+    sampleNetworkStatsLocked();
+    gNetworkStatsSession = gNetworkStats;
+    gNetworkSessionStartTime = time(NULL);
+    gNetworkSessionStarted = true;
+    gNetworkStatsMutex.unlock();
+}
+
+// Note the end of a network session, logging a summary.
+void stopNetworkStats()
+{
+    NetworkStats session;
+    int sessionSeconds;
+
+    gNetworkStatsMutex.lock();
+    if (gNetworkSessionStarted) {
+        sampleNetworkStatsLocked();
+        sessionSeconds = time(NULL) - gNetworkSessionStartTime;
+        session.numTcpRetransmissions = sessionDelta(gNetworkStats.numTcpRetransmissions,
+                                                     gNetworkStatsSession.numTcpRetransmissions);
+        session.numPbufPoolExhausted = sessionDelta(gNetworkStats.numPbufPoolExhausted,
+                                                    gNetworkStatsSession.numPbufPoolExhausted);
+        session.numTcpSegExhausted = sessionDelta(gNetworkStats.numTcpSegExhausted,
+                                                  gNetworkStatsSession.numTcpSegExhausted);
+        session.numPppFrameErrors = sessionDelta(gNetworkStats.numPppFrameErrors,
+                                                 gNetworkStatsSession.numPppFrameErrors);
+        session.numPppFramesDropped = sessionDelta(gNetworkStats.numPppFramesDropped,
+                                                   gNetworkStatsSession.numPppFramesDropped);
+        session.numTcpSegsMaxUsed = gNetworkStats.numTcpSegsMaxUsed;
+        session.numTcpSegsAvailable = gNetworkStats.numTcpSegsAvailable;
+        gNetworkSessionStarted = false;
+
+        LOG(EVENT_NETWORK_STATS_SESSION_SECONDS, sessionSeconds);
+        LOG(EVENT_NETWORK_STATS_TCP_RETRANSMISSIONS, session.numTcpRetransmissions);
+        LOG(EVENT_NETWORK_STATS_PBUF_POOL_EXHAUSTED, session.numPbufPoolExhausted);
+        LOG(EVENT_NETWORK_STATS_TCP_SEG_EXHAUSTED, session.numTcpSegExhausted);
+        LOG(EVENT_NETWORK_STATS_TCP_SEGS_MAX_USED, session.numTcpSegsMaxUsed);
+        LOG(EVENT_NETWORK_STATS_PPP_FRAME_ERRORS, session.numPppFrameErrors);
+        LOG(EVENT_NETWORK_STATS_PPP_FRAMES_DROPPED, session.numPppFramesDropped);
+        printf("Network session of %d second(s): %d TCP retransmission(s), pbuf pool exhausted %d time(s), "
+               "TCP segment pool exhausted %d time(s), most TCP segments used %d of %d, "
+               "%d PPP frame error(s), %d PPP frame(s) dropped (-1 means not known).\n",
+               sessionSeconds, (int) session.numTcpRetransmissions, (int) session.numPbufPoolExhausted,
+               (int) session.numTcpSegExhausted, (int) session.numTcpSegsMaxUsed,
+               (int) session.numTcpSegsAvailable, (int) session.numPppFrameErrors,
+               (int) session.numPppFramesDropped);
+    }
+    gNetworkStatsMutex.unlock();
+}
+
+// Sample the lwIP statistics.
+void sampleNetworkStats()
+{
+    gNetworkStatsMutex.lock();
+    sampleNetworkStatsLocked();
+    gNetworkStatsMutex.unlock();
+}
+
+// Get the network statistics.
+void getNetworkStats(NetworkStats *pStats)
+{
+    gNetworkStatsMutex.lock();
+    sampleNetworkStatsLocked();
+    *pStats = gNetworkStats;
+    gNetworkStatsMutex.unlock();
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: NETWORK STATS M2M C++ OBJECT
+ * -------------------------------------------------------------- */
+
+/** The definition of the object (C++ pre C11 won't let this const
+ * initialisation be done in the class definition).
+ */
+const M2MObjectHelper::DefObject IocM2mNetworkStats::_defObject =
+    {0, "32775", 8,
+        RESOURCE_INSTANCE_TCP_RETRANSMISSIONS, RESOURCE_NUMBER_NETWORK_COUNTER, "up counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        RESOURCE_INSTANCE_PBUF_POOL_EXHAUSTED, RESOURCE_NUMBER_NETWORK_COUNTER, "up counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        RESOURCE_INSTANCE_TCP_SEG_EXHAUSTED, RESOURCE_NUMBER_NETWORK_COUNTER, "up counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        RESOURCE_INSTANCE_PPP_FRAME_ERRORS, RESOURCE_NUMBER_NETWORK_COUNTER, "up counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        RESOURCE_INSTANCE_PPP_FRAMES_DROPPED, RESOURCE_NUMBER_NETWORK_COUNTER, "up counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_TCP_SEGS_USED, "segments", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_TCP_SEGS_MAX_USED, "segments", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_TCP_SEGS_AVAILABLE, "segments", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL
+    };
+
+// Constructor.
+IocM2mNetworkStats::IocM2mNetworkStats(Callback<bool(Stats *)> getCallback,
+                                       bool debugOn)
+                   :M2MObjectHelper(&_defObject, NULL, NULL, debugOn)
+{
+    _getCallback = getCallback;
+
+    // Make the object and its resources
+    MBED_ASSERT(makeObject());
+
+    // Update the values held in the resources
+    updateObservableResources();
+
+    printf("IocM2mNetworkStats: object initialised.\n");
+}
+
+// Destructor.
+IocM2mNetworkStats::~IocM2mNetworkStats()
+{
+}
+
+// Update the observable data for this object.
+void IocM2mNetworkStats::updateObservableResources()
+{
+    Stats data;
+
+    // Update the data
+    if (_getCallback) {
+        if (_getCallback(&data)) {
+            // Set the values in the resources based on the new data
+            MBED_ASSERT(setResourceValue(data.numTcpRetransmissions, RESOURCE_NUMBER_NETWORK_COUNTER,
+                                         RESOURCE_INSTANCE_TCP_RETRANSMISSIONS));
+            MBED_ASSERT(setResourceValue(data.numPbufPoolExhausted, RESOURCE_NUMBER_NETWORK_COUNTER,
+                                         RESOURCE_INSTANCE_PBUF_POOL_EXHAUSTED));
+            MBED_ASSERT(setResourceValue(data.numTcpSegExhausted, RESOURCE_NUMBER_NETWORK_COUNTER,
+                                         RESOURCE_INSTANCE_TCP_SEG_EXHAUSTED));
+            MBED_ASSERT(setResourceValue(data.numPppFrameErrors, RESOURCE_NUMBER_NETWORK_COUNTER,
+                                         RESOURCE_INSTANCE_PPP_FRAME_ERRORS));
+            MBED_ASSERT(setResourceValue(data.numPppFramesDropped, RESOURCE_NUMBER_NETWORK_COUNTER,
+                                         RESOURCE_INSTANCE_PPP_FRAMES_DROPPED));
+            MBED_ASSERT(setResourceValue(data.numTcpSegsUsed, RESOURCE_NUMBER_TCP_SEGS_USED));
+            MBED_ASSERT(setResourceValue(data.numTcpSegsMaxUsed, RESOURCE_NUMBER_TCP_SEGS_MAX_USED));
+            MBED_ASSERT(setResourceValue(data.numTcpSegsAvailable, RESOURCE_NUMBER_TCP_SEGS_AVAILABLE));
+        }
+    }
+}
+
+// End of file
@@ -0,0 +1,172 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+#include "MbedCloudClient.h"
+#include "m2m_object_helper.h"
+
+#ifndef _IOC_NETWORK_STATS_
+#define _IOC_NETWORK_STATS_
+
+/* ----------------------------------------------------------------
+ * GENERAL TYPES
+ * -------------------------------------------------------------- */
+
+// The network statistics that are collected; each is -1 if
+// the relevant lwIP statistics are not compiled in.
+typedef struct {
+    int32_t numTcpRetransmissions;   // TCP segments retransmitted.
+    int32_t numPbufPoolExhausted;    // Times a pbuf could not be allocated from the pool.
+    int32_t numTcpSegsUsed;          // TCP segments currently allocated.
+    int32_t numTcpSegsMaxUsed;       // Most TCP segments ever allocated.
+    int32_t numTcpSegsAvailable;     // Size of the TCP segment pool.
+    int32_t numTcpSegExhausted;      // Times a TCP segment could not be allocated.
+    int32_t numPppFrameErrors;       // PPP frames with bad FCS, length or protocol.
+    int32_t numPppFramesDropped;     // PPP frames dropped.
+} NetworkStats;
+
+/* ----------------------------------------------------------------
+ * NETWORK STATS M2M C++ OBJECT DEFINITION
+ * -------------------------------------------------------------- */
+
+/** lwIP and PPP link statistics, so that the lwIP buffer
+ * configuration can be tuned from data.
+ * Implementation is as a custom object, I have chosen
+ * ID urn:oma:lwm2m:x:32775.
+ */
+class IocM2mNetworkStats : public M2MObjectHelper {
+public:
+
+    /** The network statistics (with types that match
+     * the LWM2M types), all since power-on or wake-up
+     * from standby, -1 if not known.
+     */
+    typedef struct {
+        int64_t numTcpRetransmissions;
+        int64_t numPbufPoolExhausted;
+        int64_t numTcpSegExhausted;
+        int64_t numPppFrameErrors;
+        int64_t numPppFramesDropped;
+        int64_t numTcpSegsUsed;
+        int64_t numTcpSegsMaxUsed;
+        int64_t numTcpSegsAvailable;
+    } Stats;
+
+    /** Constructor.
+     *
+     * @param getCallback callback to get network statistics.
+     * @param debugOn     true if you want debug prints, otherwise false.
+     */
+    IocM2mNetworkStats(Callback<bool(Stats *)> getCallback,
+                       bool debugOn = false);
+
+    /** Destructor.
+     */
+    ~IocM2mNetworkStats();
+
+    /** Update the observable resources (using getCallback()).
+     */
+    void updateObservableResources();
+
+protected:
+
+    /** The resource number for the counters, a multi-instance
+     * Up Counter resource.
+     */
+#   define RESOURCE_NUMBER_NETWORK_COUNTER "5541"
+
+    /** The resource instance for numTcpRetransmissions.
+     */
+#   define RESOURCE_INSTANCE_TCP_RETRANSMISSIONS 0
+
+    /** The resource instance for numPbufPoolExhausted.
+     */
+#   define RESOURCE_INSTANCE_PBUF_POOL_EXHAUSTED 1
+
+    /** The resource instance for numTcpSegExhausted.
+     */
+#   define RESOURCE_INSTANCE_TCP_SEG_EXHAUSTED 2
+
+    /** The resource instance for numPppFrameErrors.
+     */
+#   define RESOURCE_INSTANCE_PPP_FRAME_ERRORS 3
+
+    /** The resource instance for numPppFramesDropped.
+     */
+#   define RESOURCE_INSTANCE_PPP_FRAMES_DROPPED 4
+
+    /** The resource number for numTcpSegsUsed, a Sensor
+     * Value resource.
+     */
+#   define RESOURCE_NUMBER_TCP_SEGS_USED "5700"
+
+    /** The resource number for numTcpSegsMaxUsed, a Max
+     * Measured Value resource.
+     */
+#   define RESOURCE_NUMBER_TCP_SEGS_MAX_USED "5602"
+
+    /** The resource number for numTcpSegsAvailable, a Max
+     * Range Value resource.
+     */
+#   define RESOURCE_NUMBER_TCP_SEGS_AVAILABLE "5604"
+
+    /** Definition of this object.
+     */
+    static const DefObject _defObject;
+
+    /** Callback to get network statistics.
+     */
+    Callback<bool(Stats *)> _getCallback;
+};
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Note the start of a network session, i.e. that the network
+ * has connected: the session summary logged by
+ * stopNetworkStats() is from this point.
+ */
+void startNetworkStats();
+
+/** Note the end of a network session, logging and printing
+ * a summary of the statistics for the session.
+ */
+void stopNetworkStats();
+
+/** Sample the lwIP statistics, logging anything that has
+ * got worse; called periodically by the system monitor.
+ */
+void sampleNetworkStats();
+
+/** Get the network statistics since power-on or wake-up
+ * from standby.
+ * @param pStats a place to put the statistics.
+ */
+void getNetworkStats(NetworkStats *pStats);
+
+/** Initialise the network statistics object.
+ *
+ * @return  a pointer to the IocM2mNetworkStats object.
+ */
+IocM2mNetworkStats *pInitNetworkStats();
+
+/** Shut down the network statistics object.
+ */
+void deinitNetworkStats();
+
+#endif // _IOC_NETWORK_STATS_
+
+// End of file
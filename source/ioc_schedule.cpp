@@ -0,0 +1,318 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "low_power.h"
+#include "log.h"
+#include "ioc_schedule.h"
+
+/* This file implements a recurring weekly schedule of windows,
+ * evaluated against the RTC, which is used to decide when audio
+ * streaming should run unattended and, in between, how long the
+ * device can sleep without powering up the modem.  The schedule
+ * is kept in back-up SRAM so that it survives standby.
+ */
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+#define SECONDS_PER_MINUTE 60
+#define MINUTES_PER_DAY (24 * 60)
+#define SECONDS_PER_DAY (MINUTES_PER_DAY * SECONDS_PER_MINUTE)
+#define DAYS_PER_WEEK 7
+
+// A day mask meaning every day.
+#define SCHEDULE_ALL_DAYS 0x7F
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The schedule windows.
+BACKUP_SRAM
+static ScheduleWindow gWindow[SCHEDULE_MAX_NUM_WINDOWS];
+
+// The number of schedule windows.
+BACKUP_SRAM
+static int gNumWindows;
+
+// The string form of the schedule.
+BACKUP_SRAM
+static char gScheduleString[SCHEDULE_MAX_LEN_STRING];
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Skip spaces.
+static const char *pSkipSpaces(const char *p)
+{
+    while (*p == ' ') {
+        p++;
+    }
+
+    return p;
+}
+
+// Parse a number between min and max, returning NULL on error.
+static const char *pParseNumber(const char *p, int min, int max, int *pValue)
+{
+    int value = 0;
+    int numDigits = 0;
+
+    while ((*p >= '0') && (*p <= '9') && (numDigits < 4)) {
+        value = value * 10 + *p - '0';
+        numDigits++;
+        p++;
+    }
+
+    if ((numDigits == 0) || (value < min) || (value > max)) {
+        return NULL;
+    }
+    *pValue = value;
+
+    return p;
+}
+
+// Parse "HH:MM" into minutes past midnight, returning NULL on error.
+// Note: here be multiple return statements.
+static const char *pParseTime(const char *p, unsigned short *pMinute)
+{
+    int hours;
+    int minutes;
+
+    p = pParseNumber(p, 0, 23, &hours);
+    if ((p == NULL) || (*p != ':')) {
+        return NULL;
+    }
+    p = pParseNumber(p + 1, 0, 59, &minutes);
+    if (p == NULL) {
+        return NULL;
+    }
+    *pMinute = (unsigned short) (hours * 60 + minutes);
+
+    return p;
+}
+
+// Parse a day specification, "*" or a list of day numbers
+// and ranges, returning NULL on error.
+// Note: here be multiple return statements.
+static const char *pParseDays(const char *p, unsigned char *pDayMask)
+{
+    int first;
+    int last;
+
+    *pDayMask = 0;
+    if (*p == '*') {
+        *pDayMask = SCHEDULE_ALL_DAYS;
+        return p + 1;
+    }
+
+    do {
+        if (*p == ',') {
+            p++;
+        }
+        p = pParseNumber(p, 0, DAYS_PER_WEEK - 1, &first);
+        if (p == NULL) {
+            return NULL;
+        }
+        last = first;
+        if (*p == '-') {
+            p = pParseNumber(p + 1, 0, DAYS_PER_WEEK - 1, &last);
+            if ((p == NULL) || (last < first)) {
+                return NULL;
+            }
+        }
+        for (int x = first; x <= last; x++) {
+            *pDayMask |= 1 << x;
+        }
+    } while (*p == ',');
+
+    return p;
+}
+
+// Parse a single window, "[days ]HH:MM-HH:MM", returning NULL on error.
+// Note: here be multiple return statements.
+static const char *pParseWindow(const char *p, ScheduleWindow *pWindow)
+{
+    const char *pDays;
+
+    pWindow->dayMask = SCHEDULE_ALL_DAYS;
+    p = pSkipSpaces(p);
+
+    // The day specification is optional: it is present
+    // if a space follows it
+    pDays = p;
+    while ((*p != 0) && (*p != ' ') && (*p != ';')) {
+        p++;
+    }
+    if (*p == ' ') {
+        if (pParseDays(pDays, &pWindow->dayMask) != p) {
+            return NULL;
+        }
+        p = pSkipSpaces(p);
+    } else {
+        p = pDays;
+    }
+
+    p = pParseTime(p, &pWindow->startMinute);
+    if ((p == NULL) || (*p != '-')) {
+        return NULL;
+    }
+    p = pParseTime(p + 1, &pWindow->endMinute);
+    if (p == NULL) {
+        return NULL;
+    }
+
+    return pSkipSpaces(p);
+}
+
+// Get the day of the week (0 = Sunday) of a Unix day number;
+// 1st January 1970 was a Thursday.
+static int dayOfWeek(time_t day)
+{
+    return (int) ((day + 4) % DAYS_PER_WEEK);
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Clear the schedule.
+void resetSchedule()
+{
+    gNumWindows = 0;
+    gScheduleString[0] = 0;
+}
+
+// Set the schedule from its string form.
+// Note: here be multiple return statements.
+bool setSchedule(const char *pString)
+{
+    ScheduleWindow window[SCHEDULE_MAX_NUM_WINDOWS];
+    int numWindows = 0;
+    const char *p = pSkipSpaces(pString);
+
+    if (strlen(pString) >= sizeof(gScheduleString)) {
+        return false;
+    }
+
+    while (*p != 0) {
+        if (numWindows >= SCHEDULE_MAX_NUM_WINDOWS) {
+            return false;
+        }
+        p = pParseWindow(p, &window[numWindows]);
+        if (p == NULL) {
+            return false;
+        }
+        numWindows++;
+        if (*p == ';') {
+            p++;
+        } else if (*p != 0) {
+            return false;
+        }
+    }
+
+    memcpy(gWindow, window, sizeof(window[0]) * numWindows);
+    gNumWindows = numWindows;
+    strcpy(gScheduleString, pString);
+
+    return true;
+}
+
+// Get the string form of the schedule.
+const char *pGetScheduleString()
+{
+    // Back-up SRAM may contain garbage after a power-on reset
+    // and before resetSchedule() is called, so be safe
+    gScheduleString[sizeof(gScheduleString) - 1] = 0;
+
+    return gScheduleString;
+}
+
+// Determine whether there is a schedule.
+bool isScheduleSet()
+{
+    return (gNumWindows > 0) && (gNumWindows <= SCHEDULE_MAX_NUM_WINDOWS);
+}
+
+// Determine whether a time is within a window of the schedule.
+// A window that crosses midnight belongs to the day on which
+// it starts, so yesterday's windows are checked as well as today's.
+bool isInScheduleWindow(time_t now, time_t *pEnd)
+{
+    bool inWindow = false;
+    time_t today = now / SECONDS_PER_DAY;
+    time_t windowStart;
+    time_t windowEnd;
+    time_t end = 0;
+
+    if (isScheduleSet() && (now >= SCHEDULE_MIN_VALID_TIME)) {
+        for (time_t day = today - 1; day <= today; day++) {
+            for (int x = 0; x < gNumWindows; x++) {
+                if (gWindow[x].dayMask & (1 << dayOfWeek(day))) {
+                    windowStart = day * SECONDS_PER_DAY + gWindow[x].startMinute * SECONDS_PER_MINUTE;
+                    windowEnd = day * SECONDS_PER_DAY + gWindow[x].endMinute * SECONDS_PER_MINUTE;
+                    if (gWindow[x].endMinute <= gWindow[x].startMinute) {
+                        windowEnd += SECONDS_PER_DAY;
+                    }
+                    if ((now >= windowStart) && (now < windowEnd)) {
+                        inWindow = true;
+                        // Where windows overlap, take the latest end
+                        if (windowEnd > end) {
+                            end = windowEnd;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (inWindow && (pEnd != NULL)) {
+        *pEnd = end;
+    }
+
+    return inWindow;
+}
+
+// Get the start time of the next window after a given time.
+time_t getScheduleNextStart(time_t now)
+{
+    time_t today = now / SECONDS_PER_DAY;
+    time_t windowStart;
+    time_t nextStart = 0;
+
+    if (isScheduleSet() && (now >= SCHEDULE_MIN_VALID_TIME)) {
+        // Looking a week and a day ahead is sufficient to
+        // find a window that has any days set
+        for (time_t day = today; (day <= today + DAYS_PER_WEEK) && (nextStart == 0); day++) {
+            for (int x = 0; x < gNumWindows; x++) {
+                if (gWindow[x].dayMask & (1 << dayOfWeek(day))) {
+                    windowStart = day * SECONDS_PER_DAY + gWindow[x].startMinute * SECONDS_PER_MINUTE;
+                    if ((windowStart > now) &&
+                        ((nextStart == 0) || (windowStart < nextStart))) {
+                        nextStart = windowStart;
+                    }
+                }
+            }
+        }
+    }
+
+    return nextStart;
+}
+
+// End of file
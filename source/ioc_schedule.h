@@ -0,0 +1,107 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+
+#ifndef _IOC_SCHEDULE_
+#define _IOC_SCHEDULE_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The maximum number of windows in a schedule.
+#define SCHEDULE_MAX_NUM_WINDOWS 8
+
+// The maximum length of the string form of a schedule
+// (including terminator).
+#define SCHEDULE_MAX_LEN_STRING 128
+
+// Any time earlier than this means that the RTC has not
+// been set (from GNSS) and so a schedule cannot be evaluated.
+#define SCHEDULE_MIN_VALID_TIME 1500000000
+
+// How long before the start of a window to wake up from
+// sleep, allowing time to register with the network and
+// the LWM2M server.
+#define SCHEDULE_WAKE_UP_LEAD_SECONDS 120
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+/** A recurring window: every day in dayMask (bit 0 is Sunday,
+ * as for tm_wday) from startMinute to endMinute past midnight UTC.
+ * If endMinute is not greater than startMinute the window runs
+ * on past midnight into the following day.
+ */
+typedef struct {
+    unsigned char dayMask;
+    unsigned short startMinute;
+    unsigned short endMinute;
+} ScheduleWindow;
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Clear the schedule.
+ */
+void resetSchedule();
+
+/** Set the schedule from its string form, which is a list of
+ * windows separated by ';', each of the form
+ * "[days ]HH:MM-HH:MM", where days is "*" (the default) or a
+ * list of day numbers (0 = Sunday) and ranges separated by ',',
+ * e.g. "1-5 07:30-09:00;0,6 10:00-12:00".  Times are UTC.
+ * An empty string clears the schedule.
+ *
+ * @param pString the schedule as a null terminated string.
+ * @return        true if the schedule was valid and has been
+ *                set, false if it was not valid, in which case
+ *                the schedule is unchanged.
+ */
+bool setSchedule(const char *pString);
+
+/** Get the string form of the current schedule.
+ * @return a pointer to a null terminated string.
+ */
+const char *pGetScheduleString();
+
+/** Determine whether there is a schedule.
+ * @return true if at least one window is defined.
+ */
+bool isScheduleSet();
+
+/** Determine whether a time is within a window of the schedule.
+ *
+ * @param now  the time (Unix format).
+ * @param pEnd if not NULL, a place to put the time at which the
+ *             window ends.
+ * @return     true if now is within a window.
+ */
+bool isInScheduleWindow(time_t now, time_t *pEnd);
+
+/** Get the start time of the next window after a given time.
+ *
+ * @param now the time (Unix format).
+ * @return    the start time of the next window, 0 if there is
+ *            none (or the time is not valid).
+ */
+time_t getScheduleNextStart(time_t now);
+
+#endif // _IOC_SCHEDULE_
+
+// End of file
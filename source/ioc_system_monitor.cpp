@@ -0,0 +1,313 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "us_ticker_api.h"
+#ifdef MBED_STACK_STATS_ENABLED
+#include "mbed_stats.h"
+#endif
+#include "MbedCloudClient.h"
+#include "m2m_object_helper.h"
+#include "log.h"
+
+#include "ioc_utils.h"
+#include "ioc_network_stats.h"
+#include "ioc_system_monitor.h"
+
+/* This file implements the LWM2M system monitor object, which
+ * reports CPU load and the stack high-water marks of all
+ * threads, so that stack sizes and thread priorities can be
+ * set from data rather than guesswork.
+ *
+ * CPU load is measured by replacing the RTOS idle hook with one
+ * that does what the default does (sleep with interrupts locked)
+ * but counts the time spent doing it.  When the MCU is in a deep
+ * sleep the microsecond ticker stops, so the load is that while
+ * awake.  Stack high-water marks come from mbed_stats_stack_get_each(),
+ * which requires MBED_STACK_STATS_ENABLED.  The slowest event
+ * queue handlers and the number of times the event queue was
+ * full come from the event queue instrumentation in ioc_utils.
+ * The lwIP statistics (see ioc_network_stats) are sampled on the
+ * same tick.
+ */
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// What we keep for each thread.
+typedef struct {
+    uint32_t threadId;
+    uint32_t maxUsed;
+    uint32_t size;
+} SystemMonitorThread;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The time spent in the idle hook, in microseconds (wraps).
+static volatile uint32_t gIdleTimeUs = 0;
+
+// The idle time and ticker value at the last sample.
+static uint32_t gIdleTimeUsLast = 0;
+static uint32_t gTickerUsLast = 0;
+
+// The CPU load in the last interval and the worst
+// CPU load, as percentages, -1 if not known.
+static int gCpuLoad = -1;
+static int gCpuLoadMax = -1;
+
+// The threads seen at the last sample.
+static SystemMonitorThread gThread[SYSTEM_MONITOR_MAX_NUM_THREADS];
+static int gNumThreads = 0;
+
+// The event queue ID of the sampling event.
+static int gSampleEventId = 0;
+
+// The LWM2M object.
+static IocM2mSystemMonitor *gpM2mObject = NULL;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: MISC
+ * -------------------------------------------------------------- */
+
+// RTOS idle hook: as the default idle hook but timed.
+static void idleHook()
+{
+    uint32_t start;
+
+    core_util_critical_section_enter();
+    start = us_ticker_read();
+    sleep();
+    gIdleTimeUs += us_ticker_read() - start;
+    core_util_critical_section_exit();
+}
+
+// Sample the CPU load.
+static void sampleCpuLoad()
+{
+    uint32_t tickerUs = us_ticker_read();
+    uint32_t idleTimeUs = gIdleTimeUs;
+    uint32_t elapsedUs = tickerUs - gTickerUsLast;
+    uint32_t idleUs = idleTimeUs - gIdleTimeUsLast;
+
+    if (elapsedUs > 0) {
+        if (idleUs > elapsedUs) {
+            idleUs = elapsedUs;
+        }
+        gCpuLoad = 100 - (int) (((uint64_t) idleUs * 100) / elapsedUs);
+        if (gCpuLoad > gCpuLoadMax) {
+            gCpuLoadMax = gCpuLoad;
+        }
+        LOG(EVENT_CPU_LOAD_PERCENT, gCpuLoad);
+    }
+    gTickerUsLast = tickerUs;
+    gIdleTimeUsLast = idleTimeUs;
+}
+
+// Sample the thread stacks, logging any new high-water mark.
+static void sampleThreadStacks()
+{
+#ifdef MBED_STACK_STATS_ENABLED
+    mbed_stats_stack_t *pStats = new mbed_stats_stack_t[SYSTEM_MONITOR_MAX_NUM_THREADS];
+    SystemMonitorThread thread[SYSTEM_MONITOR_MAX_NUM_THREADS];
+    int numThreads;
+    uint32_t maxUsedLast;
+
+    numThreads = mbed_stats_stack_get_each(pStats, SYSTEM_MONITOR_MAX_NUM_THREADS);
+    for (int x = 0; x < numThreads; x++) {
+        thread[x].threadId = pStats[x].thread_id;
+        thread[x].maxUsed = pStats[x].max_size;
+        thread[x].size = pStats[x].reserved_size;
+        maxUsedLast = 0;
+        for (int y = 0; y < gNumThreads; y++) {
+            if (gThread[y].threadId == thread[x].threadId) {
+                maxUsedLast = gThread[y].maxUsed;
+            }
+        }
+        if (thread[x].maxUsed > maxUsedLast) {
+            LOG(EVENT_THREAD_STACK_ID, thread[x].threadId);
+            LOG(EVENT_THREAD_STACK_SIZE, thread[x].size);
+            LOG(EVENT_THREAD_STACK_MAX_USED, thread[x].maxUsed);
+        }
+    }
+    memcpy(gThread, thread, sizeof (thread[0]) * numThreads);
+    gNumThreads = numThreads;
+
+    delete[] pStats;
+#endif
+}
+
+// Sample everything; called on the event queue.
+static void sample()
+{
+    sampleCpuLoad();
+    sampleThreadStacks();
+    sampleNetworkStats();
+}
+
+// Write the thread stack watermarks into a buffer.
+static char *pThreadStacksString(char *pBuf, int lenBuf)
+{
+    int x = 0;
+    const char *pName;
+
+    *pBuf = 0;
+    for (int y = 0; (y < gNumThreads) && (x < lenBuf); y++) {
+        pName = osThreadGetName((osThreadId_t) gThread[y].threadId);
+        if (pName == NULL) {
+            pName = "?";
+        }
+        x += snprintf(pBuf + x, lenBuf - x, "%s%.*s:%u/%u", y > 0 ? "," : "",
+                      SYSTEM_MONITOR_MAX_LEN_THREAD_NAME, pName,
+                      (unsigned int) gThread[y].maxUsed, (unsigned int) gThread[y].size);
+    }
+
+    return pBuf;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: HOOK FOR SYSTEM MONITOR M2M C++ OBJECT
+ * -------------------------------------------------------------- */
+
+// Callback that gets data for the IocM2mSystemMonitor object.
+static bool getSystemMonitorData(IocM2mSystemMonitor::SystemMonitor *pData)
+{
+    char *pBuf = new char[SYSTEM_MONITOR_STACKS_MAX_LEN_STRING];
+    int headroom;
+
+    pData->cpuLoad = gCpuLoad;
+    pData->cpuLoadMax = gCpuLoadMax;
+    pData->threadStacks = pThreadStacksString(pBuf, SYSTEM_MONITOR_STACKS_MAX_LEN_STRING);
+    pData->minStackHeadroom = -1;
+    for (int x = 0; x < gNumThreads; x++) {
+        headroom = gThread[x].size - gThread[x].maxUsed;
+        if ((pData->minStackHeadroom < 0) || (headroom < pData->minStackHeadroom)) {
+            pData->minStackHeadroom = headroom;
+        }
+    }
+    delete[] pBuf;
+    pBuf = new char[SYSTEM_MONITOR_HANDLERS_MAX_LEN_STRING];
+    pData->slowestHandlers = pEventQueueSlowestHandlersString(pBuf, SYSTEM_MONITOR_HANDLERS_MAX_LEN_STRING,
+                                                              SYSTEM_MONITOR_NUM_SLOWEST_HANDLERS);
+    delete[] pBuf;
+    pData->eventQueueNumFull = getEventQueueNumFull();
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: INITIALISATION
+ * -------------------------------------------------------------- */
+
+// Initialise the system monitor object.
+IocM2mSystemMonitor *pInitSystemMonitor()
+{
+    gTickerUsLast = us_ticker_read();
+    gIdleTimeUsLast = gIdleTimeUs;
+    Thread::attach_idle_hook(&idleHook);
+    if (gSampleEventId == 0) {
+        gSampleEventId = eventQueueCallEvery("sys monitor", SYSTEM_MONITOR_INTERVAL_SECONDS * 1000, callback(&sample));
+    }
+
+    gpM2mObject = new IocM2mSystemMonitor(getSystemMonitorData, MBED_CONF_APP_OBJECT_DEBUG_ON);
+
+    return gpM2mObject;
+}
+
+// Shut down the system monitor object.
+void deinitSystemMonitor()
+{
+    char *pBuf;
+
+    if (gSampleEventId != 0) {
+        pGetEventQueue()->cancel(gSampleEventId);
+        gSampleEventId = 0;
+    }
+    // Put back the default idle hook
+    Thread::attach_idle_hook(NULL);
+
+    delete gpM2mObject;
+    gpM2mObject = NULL;
+
+    pBuf = new char[SYSTEM_MONITOR_HANDLERS_MAX_LEN_STRING];
+    printf("Worst case CPU load %d%%.\n", gCpuLoadMax);
+    printf("Slowest event queue handlers (name:run/latency ms): %s.\n",
+           pEventQueueSlowestHandlersString(pBuf, SYSTEM_MONITOR_HANDLERS_MAX_LEN_STRING,
+                                            SYSTEM_MONITOR_NUM_SLOWEST_HANDLERS));
+    printf("Event queue full %u time(s).\n", getEventQueueNumFull());
+    delete[] pBuf;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC: SYSTEM MONITOR M2M C++ OBJECT
+ * -------------------------------------------------------------- */
+
+/** The definition of the object (C++ pre C11 won't let this const
+ * initialisation be done in the class definition).
+ */
+const M2MObjectHelper::DefObject IocM2mSystemMonitor::_defObject =
+    {0, "32773", 6,
+        RESOURCE_INSTANCE_CPU_LOAD, RESOURCE_NUMBER_CPU_LOAD, "percent", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        RESOURCE_INSTANCE_CPU_LOAD_MAX, RESOURCE_NUMBER_CPU_LOAD, "percent", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_THREAD_STACKS, "string", M2MResourceBase::STRING, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_MIN_STACK_HEADROOM, "down counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_SLOWEST_HANDLERS, "string", M2MResourceBase::STRING, true, M2MBase::GET_ALLOWED, NULL,
+        -1, RESOURCE_NUMBER_EVENT_QUEUE_NUM_FULL, "up counter", M2MResourceBase::INTEGER, true, M2MBase::GET_ALLOWED, NULL
+    };
+
+// Constructor.
+IocM2mSystemMonitor::IocM2mSystemMonitor(Callback<bool(SystemMonitor *)> getCallback,
+                                         bool debugOn)
+                    :M2MObjectHelper(&_defObject, NULL, NULL, debugOn)
+{
+    _getCallback = getCallback;
+
+    // Make the object and its resources
+    MBED_ASSERT(makeObject());
+
+    // Update the values held in the resources
+    updateObservableResources();
+
+    printf("IocM2mSystemMonitor: object initialised.\n");
+}
+
+// Destructor.
+IocM2mSystemMonitor::~IocM2mSystemMonitor()
+{
+}
+
+// Update the observable data for this object.
+void IocM2mSystemMonitor::updateObservableResources()
+{
+    SystemMonitor data;
+
+    // Update the data
+    if (_getCallback) {
+        if (_getCallback(&data)) {
+            // Set the values in the resources based on the new data
+            MBED_ASSERT(setResourceValue(data.cpuLoad, RESOURCE_NUMBER_CPU_LOAD, RESOURCE_INSTANCE_CPU_LOAD));
+            MBED_ASSERT(setResourceValue(data.cpuLoadMax, RESOURCE_NUMBER_CPU_LOAD, RESOURCE_INSTANCE_CPU_LOAD_MAX));
+            MBED_ASSERT(setResourceValue(data.threadStacks, RESOURCE_NUMBER_THREAD_STACKS));
+            MBED_ASSERT(setResourceValue(data.minStackHeadroom, RESOURCE_NUMBER_MIN_STACK_HEADROOM));
+            MBED_ASSERT(setResourceValue(data.slowestHandlers, RESOURCE_NUMBER_SLOWEST_HANDLERS));
+            MBED_ASSERT(setResourceValue(data.eventQueueNumFull, RESOURCE_NUMBER_EVENT_QUEUE_NUM_FULL));
+        }
+    }
+}
+
+// End of file
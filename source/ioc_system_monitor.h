@@ -0,0 +1,153 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+#include "MbedCloudClient.h"
+#include "m2m_object_helper.h"
+#include "ioc_utils.h"
+
+#ifndef _IOC_SYSTEM_MONITOR_
+#define _IOC_SYSTEM_MONITOR_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The interval at which CPU load and thread stacks are sampled.
+#define SYSTEM_MONITOR_INTERVAL_SECONDS 10
+
+// The maximum number of threads that are monitored.
+#define SYSTEM_MONITOR_MAX_NUM_THREADS 12
+
+// The maximum length of a thread name in the string form of
+// the thread stack watermarks.
+#define SYSTEM_MONITOR_MAX_LEN_THREAD_NAME 12
+
+// The maximum length of the string form of the thread stack
+// watermarks (including terminator): "name:used/size," per thread.
+#define SYSTEM_MONITOR_STACKS_MAX_LEN_STRING (SYSTEM_MONITOR_MAX_NUM_THREADS * \
+                                              (SYSTEM_MONITOR_MAX_LEN_THREAD_NAME + 14))
+
+// The number of event queue handlers reported, slowest first.
+#define SYSTEM_MONITOR_NUM_SLOWEST_HANDLERS 3
+
+// The maximum length of the string form of the slowest
+// event queue handlers (including terminator).
+#define SYSTEM_MONITOR_HANDLERS_MAX_LEN_STRING (SYSTEM_MONITOR_NUM_SLOWEST_HANDLERS * \
+                                                EVENT_QUEUE_HANDLER_MAX_LEN_STRING)
+
+/* ----------------------------------------------------------------
+ * SYSTEM MONITOR M2M C++ OBJECT DEFINITION
+ * -------------------------------------------------------------- */
+
+/** CPU load and thread stack usage reporting.
+ * Implementation is as a custom object, I have chosen ID
+ * urn:oma:lwm2m:x:32773.
+ */
+class IocM2mSystemMonitor : public M2MObjectHelper {
+public:
+
+    /** The system monitor information (with types that match
+     * the LWM2M types).
+     */
+    typedef struct {
+        int64_t cpuLoad;           ///< Over the last interval, -1 if not known.
+        int64_t cpuLoadMax;        ///< -1 if not known.
+        String threadStacks;       ///< "name:used/size" for each thread,
+                                   /// comma separated, in bytes.
+        int64_t minStackHeadroom;  ///< In bytes, -1 if not known.
+        String slowestHandlers;    ///< See pEventQueueSlowestHandlersString()
+                                   /// in ioc_utils.h.
+        int64_t eventQueueNumFull; ///< Times an event could not be queued.
+    } SystemMonitor;
+
+    /** Constructor.
+     *
+     * @param getCallback callback to get system monitor information.
+     * @param debugOn     true if you want debug prints, otherwise false.
+     */
+    IocM2mSystemMonitor(Callback<bool(SystemMonitor *)> getCallback,
+                        bool debugOn = false);
+
+    /** Destructor.
+     */
+    ~IocM2mSystemMonitor();
+
+    /** Update the observable resources (using getCallback()).
+     */
+    void updateObservableResources();
+
+protected:
+
+    /** The resource number for cpuLoad and cpuLoadMax,
+     * a Percent resource.
+     */
+#   define RESOURCE_NUMBER_CPU_LOAD "3320"
+
+    /** The resource instance for cpuLoad.
+     */
+#   define RESOURCE_INSTANCE_CPU_LOAD 0
+
+    /** The resource instance for cpuLoadMax.
+     */
+#   define RESOURCE_INSTANCE_CPU_LOAD_MAX 1
+
+    /** The resource number for threadStacks, a Text
+     * resource.
+     */
+#   define RESOURCE_NUMBER_THREAD_STACKS "5527"
+
+    /** The resource number for minStackHeadroom, a
+     * Down Counter resource.
+     */
+#   define RESOURCE_NUMBER_MIN_STACK_HEADROOM "5542"
+
+    /** The resource number for slowestHandlers, an
+     * Application Type resource.
+     */
+#   define RESOURCE_NUMBER_SLOWEST_HANDLERS "5750"
+
+    /** The resource number for eventQueueNumFull, an
+     * Up Counter resource.
+     */
+#   define RESOURCE_NUMBER_EVENT_QUEUE_NUM_FULL "5541"
+
+    /** Definition of this object.
+     */
+    static const DefObject _defObject;
+
+    /** Callback to get system monitor values.
+     */
+    Callback<bool(SystemMonitor *)> _getCallback;
+};
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Initialise the system monitor object and start sampling
+ * on the event queue, which must be running.
+ *
+ * @return  a pointer to the IocM2mSystemMonitor object.
+ */
+IocM2mSystemMonitor *pInitSystemMonitor();
+
+/** Stop sampling and shut down the system monitor object.
+ */
+void deinitSystemMonitor();
+
+#endif // _IOC_SYSTEM_MONITOR_
+
+// End of file
@@ -264,6 +264,18 @@ bool getBatteryCurrent(int32_t *pCurrentMA)
     return success;
 }
 
+// Return the remaining battery capacity.
+bool getBatteryRemainingCapacity(int32_t *pCapacityMAh)
+{
+    bool success = false;
+    
+    if (gpBatteryGauge != NULL) {
+        success = gpBatteryGauge->getRemainingCapacity(pCapacityMAh);
+    }
+    
+    return success;
+}
+
 // Return the battery level as a percentage.
 bool getBatteryRemainingPercentage(int32_t *pBatteryLevelPercent)
 {
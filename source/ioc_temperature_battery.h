@@ -181,6 +181,13 @@ bool getBatteryVoltage(int32_t *pVoltageMV);
  */
 bool getBatteryCurrent(int32_t *pCurrentMA);
 
+/** Get the remaining battery capacity.
+ * @param pCapacityMAh  a place to put the capacity.
+ * @return              true if the capacity was read,
+ *                      otherwise false.
+ */
+bool getBatteryRemainingCapacity(int32_t *pCapacityMAh);
+
 /** Get the remaining battery percentage.
  * @param pBatteryLevelPercent  a place to put the percentage.
  * @return                      true if the percentage was read,
@@ -0,0 +1,487 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "low_power.h"
+#include "log.h"
+
+#include "ioc_utils.h"
+#include "ioc_tls.h"
+
+/* This file implements a TLS/DTLS session, using the mbedTLS
+ * that is already linked for Mbed Cloud Client, for securing the
+ * audio streaming socket.  The session parameters are cached in
+ * back-up SRAM so that a reconnect, e.g. after a cellular handover
+ * or a period in standby, can use an abbreviated handshake rather
+ * than paying for a full (ECDHE/ECDSA) handshake again.
+ */
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Marker indicating that the session cache in back-up SRAM
+// is valid (on a power-on reset it will contain garbage).
+#define TLS_SESSION_CACHE_MARKER 0x7E55C0DE
+
+// Personalisation string for the random number generator.
+#define TLS_DRBG_PERSONALISATION "ioc-audio-tls"
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// The session parameters that need to be kept in order to
+// resume a session.  This is a flattened version of
+// mbedtls_ssl_session, which contains pointers and so
+// cannot itself be kept in back-up SRAM.
+typedef struct {
+    unsigned int marker;
+    char serverIpAddress[TLS_SESSION_MAX_LEN_IP_ADDRESS];
+    int serverPort;
+    bool datagramNotStream;
+    int ciphersuite;
+    int compression;
+    unsigned int idLen;
+    unsigned char id[32];
+    unsigned char master[48];
+    unsigned int ticketLen;
+    unsigned char ticket[TLS_SESSION_TICKET_MAX_SIZE];
+    unsigned int ticketLifetime;
+} TlsSessionCache;
+
+// The TLS/DTLS context for the current session.
+typedef struct {
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctrDrbg;
+    mbedtls_ssl_config config;
+    mbedtls_ssl_context ssl;
+#ifdef MBED_CONF_APP_AUDIO_SERVER_CA_PEM
+    mbedtls_x509_crt caCert;
+#endif
+    Socket *pSocket;
+    SocketAddress server;
+    bool datagramNotStream;
+    Timer dtlsTimer;
+    uint32_t dtlsIntermediateMs;
+    uint32_t dtlsFinalMs;
+} TlsContext;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The session cache.
+BACKUP_SRAM
+static TlsSessionCache gSessionCache;
+
+// The current session, NULL if there isn't one.
+static TlsContext *gpTls = NULL;
+
+// The duration of the most recent handshake of each type,
+// indexed by TlsHandshakeType.
+static int gHandshakeDurationMs[] = {-1, -1, -1};
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: MBEDTLS CALLBACKS
+ * -------------------------------------------------------------- */
+
+// Send callback for mbedTLS.  NSAPI errors (which are all
+// negative) are passed straight back so that the caller
+// can tell when the connection has gone.
+static int bioSend(void *pCtx, const unsigned char *pBuf, size_t len)
+{
+    TlsContext *pTls = (TlsContext *) pCtx;
+    nsapi_size_or_error_t x;
+
+    if (pTls->datagramNotStream) {
+        x = ((UDPSocket *) pTls->pSocket)->sendto(pTls->server, pBuf, len);
+    } else {
+        x = ((TCPSocket *) pTls->pSocket)->send(pBuf, len);
+    }
+
+    if (x == NSAPI_ERROR_WOULD_BLOCK) {
+        x = MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+
+    return x;
+}
+
+// Receive callback for mbedTLS.
+static int bioRecv(void *pCtx, unsigned char *pBuf, size_t len)
+{
+    TlsContext *pTls = (TlsContext *) pCtx;
+    nsapi_size_or_error_t x;
+
+    if (pTls->datagramNotStream) {
+        x = ((UDPSocket *) pTls->pSocket)->recvfrom(NULL, pBuf, len);
+    } else {
+        x = ((TCPSocket *) pTls->pSocket)->recv(pBuf, len);
+    }
+
+    if (x == NSAPI_ERROR_WOULD_BLOCK) {
+        x = MBEDTLS_ERR_SSL_WANT_READ;
+    } else if (x == 0) {
+        x = MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+    }
+
+    return x;
+}
+
+// Set the DTLS retransmission timer.
+static void dtlsTimerSet(void *pCtx, uint32_t intermediateMs, uint32_t finalMs)
+{
+    TlsContext *pTls = (TlsContext *) pCtx;
+
+    pTls->dtlsIntermediateMs = intermediateMs;
+    pTls->dtlsFinalMs = finalMs;
+    pTls->dtlsTimer.stop();
+    pTls->dtlsTimer.reset();
+    if (finalMs > 0) {
+        pTls->dtlsTimer.start();
+    }
+}
+
+// Get the state of the DTLS retransmission timer, as
+// required by mbedtls_ssl_set_timer_cb().
+static int dtlsTimerGet(void *pCtx)
+{
+    TlsContext *pTls = (TlsContext *) pCtx;
+    uint32_t elapsedMs;
+
+    if (pTls->dtlsFinalMs == 0) {
+        return -1;
+    }
+
+    elapsedMs = pTls->dtlsTimer.read_ms();
+    if (elapsedMs >= pTls->dtlsFinalMs) {
+        return 2;
+    }
+    if (elapsedMs >= pTls->dtlsIntermediateMs) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: SESSION CACHE
+ * -------------------------------------------------------------- */
+
+// Return true if the session cache holds a session for the given server.
+static bool isSessionCached(const SocketAddress *pServer, bool datagramNotStream)
+{
+    return (gSessionCache.marker == TLS_SESSION_CACHE_MARKER) &&
+           (gSessionCache.datagramNotStream == datagramNotStream) &&
+           (gSessionCache.serverPort == pServer->get_port()) &&
+           (strncmp(gSessionCache.serverIpAddress, pServer->get_ip_address(),
+                    sizeof (gSessionCache.serverIpAddress)) == 0);
+}
+
+// Save the session of the current context to the cache.
+static void saveSession(TlsContext *pTls)
+{
+    mbedtls_ssl_session session;
+
+    mbedtls_ssl_session_init(&session);
+    if ((mbedtls_ssl_get_session(&pTls->ssl, &session) == 0) &&
+        (session.id_len <= sizeof (gSessionCache.id))) {
+        gSessionCache.marker = 0;
+        strncpy(gSessionCache.serverIpAddress, pTls->server.get_ip_address(),
+                sizeof (gSessionCache.serverIpAddress));
+        gSessionCache.serverIpAddress[sizeof (gSessionCache.serverIpAddress) - 1] = 0;
+        gSessionCache.serverPort = pTls->server.get_port();
+        gSessionCache.datagramNotStream = pTls->datagramNotStream;
+        gSessionCache.ciphersuite = session.ciphersuite;
+        gSessionCache.compression = session.compression;
+        gSessionCache.idLen = session.id_len;
+        memcpy(gSessionCache.id, session.id, session.id_len);
+        memcpy(gSessionCache.master, session.master, sizeof (gSessionCache.master));
+        gSessionCache.ticketLen = 0;
+        gSessionCache.ticketLifetime = 0;
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        if ((session.ticket != NULL) && (session.ticket_len <= sizeof (gSessionCache.ticket))) {
+            memcpy(gSessionCache.ticket, session.ticket, session.ticket_len);
+            gSessionCache.ticketLen = session.ticket_len;
+            gSessionCache.ticketLifetime = session.ticket_lifetime;
+        }
+#endif
+        gSessionCache.marker = TLS_SESSION_CACHE_MARKER;
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+// Apply the cached session to the current context so that
+// the handshake will attempt to resume it.
+static bool restoreSession(TlsContext *pTls)
+{
+    bool success = false;
+    mbedtls_ssl_session session;
+
+    mbedtls_ssl_session_init(&session);
+    session.ciphersuite = gSessionCache.ciphersuite;
+    session.compression = gSessionCache.compression;
+    session.id_len = gSessionCache.idLen;
+    memcpy(session.id, gSessionCache.id, gSessionCache.idLen);
+    memcpy(session.master, gSessionCache.master, sizeof (session.master));
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (gSessionCache.ticketLen > 0) {
+        // mbedtls_ssl_session_free() will free() the ticket
+        session.ticket = (unsigned char *) malloc(gSessionCache.ticketLen);
+        if (session.ticket != NULL) {
+            memcpy(session.ticket, gSessionCache.ticket, gSessionCache.ticketLen);
+            session.ticket_len = gSessionCache.ticketLen;
+            session.ticket_lifetime = gSessionCache.ticketLifetime;
+        }
+    }
+#endif
+    success = (mbedtls_ssl_set_session(&pTls->ssl, &session) == 0);
+    mbedtls_ssl_session_free(&session);
+
+    return success;
+}
+
+// Determine whether the session just established was
+// a resumption of the cached one: only a resumption, by
+// session ID or by ticket, keeps the master secret, a full
+// handshake deriving a new one.  The session ID can't be
+// used since, when resuming with a ticket, the client
+// offers a fresh random one which the server echoes.
+static bool wasSessionResumed(TlsContext *pTls)
+{
+    bool resumed = false;
+    mbedtls_ssl_session session;
+
+    mbedtls_ssl_session_init(&session);
+    if ((mbedtls_ssl_get_session(&pTls->ssl, &session) == 0) &&
+        (memcmp(session.master, gSessionCache.master, sizeof (session.master)) == 0)) {
+        resumed = true;
+    }
+    mbedtls_ssl_session_free(&session);
+
+    return resumed;
+}
+
+// Free the current context.
+static void freeContext()
+{
+    if (gpTls != NULL) {
+        mbedtls_ssl_free(&gpTls->ssl);
+        mbedtls_ssl_config_free(&gpTls->config);
+#ifdef MBED_CONF_APP_AUDIO_SERVER_CA_PEM
+        mbedtls_x509_crt_free(&gpTls->caCert);
+#endif
+        mbedtls_ctr_drbg_free(&gpTls->ctrDrbg);
+        mbedtls_entropy_free(&gpTls->entropy);
+        delete gpTls;
+        gpTls = NULL;
+    }
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Perform a TLS/DTLS handshake on an open socket.
+// Note: here be multiple return statements.
+TlsHandshakeType tlsConnect(Socket *pSocket, const SocketAddress *pServer,
+                            bool datagramNotStream)
+{
+    TlsHandshakeType handshakeType = TLS_HANDSHAKE_FULL;
+    bool resumeAttempted = false;
+    Timer timer;
+    int x;
+
+    tlsDisconnect();
+
+    LOG(EVENT_AUDIO_TLS_HANDSHAKE_START, datagramNotStream);
+    printf("Starting %s handshake with %s:%d...\n", datagramNotStream ? "DTLS" : "TLS",
+           pServer->get_ip_address(), pServer->get_port());
+    gpTls = new TlsContext;
+    gpTls->pSocket = pSocket;
+    gpTls->server = *pServer;
+    gpTls->datagramNotStream = datagramNotStream;
+    gpTls->dtlsIntermediateMs = 0;
+    gpTls->dtlsFinalMs = 0;
+    mbedtls_entropy_init(&gpTls->entropy);
+    mbedtls_ctr_drbg_init(&gpTls->ctrDrbg);
+    mbedtls_ssl_config_init(&gpTls->config);
+    mbedtls_ssl_init(&gpTls->ssl);
+#ifdef MBED_CONF_APP_AUDIO_SERVER_CA_PEM
+    mbedtls_x509_crt_init(&gpTls->caCert);
+#endif
+
+    x = mbedtls_ctr_drbg_seed(&gpTls->ctrDrbg, mbedtls_entropy_func, &gpTls->entropy,
+                              (const unsigned char *) TLS_DRBG_PERSONALISATION,
+                              sizeof (TLS_DRBG_PERSONALISATION) - 1);
+    if (x == 0) {
+        x = mbedtls_ssl_config_defaults(&gpTls->config, MBEDTLS_SSL_IS_CLIENT,
+                                        datagramNotStream ? MBEDTLS_SSL_TRANSPORT_DATAGRAM :
+                                                            MBEDTLS_SSL_TRANSPORT_STREAM,
+                                        MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (x != 0) {
+        bad();
+        LOG(EVENT_AUDIO_TLS_HANDSHAKE_FAILURE, x);
+        printf("Unable to configure TLS (error -0x%04x).\n", -x);
+        freeContext();
+        return TLS_HANDSHAKE_NONE;
+    }
+
+    mbedtls_ssl_conf_rng(&gpTls->config, mbedtls_ctr_drbg_random, &gpTls->ctrDrbg);
+#ifdef MBED_CONF_APP_AUDIO_SERVER_CA_PEM
+    x = mbedtls_x509_crt_parse(&gpTls->caCert, (const unsigned char *) MBED_CONF_APP_AUDIO_SERVER_CA_PEM,
+                               sizeof (MBED_CONF_APP_AUDIO_SERVER_CA_PEM));
+    if (x != 0) {
+        bad();
+        LOG(EVENT_AUDIO_TLS_HANDSHAKE_FAILURE, x);
+        printf("Unable to parse audio server CA certificate (error -0x%04x).\n", -x);
+        freeContext();
+        return TLS_HANDSHAKE_NONE;
+    }
+    mbedtls_ssl_conf_ca_chain(&gpTls->config, &gpTls->caCert, NULL);
+    mbedtls_ssl_conf_authmode(&gpTls->config, MBEDTLS_SSL_VERIFY_REQUIRED);
+#else
+    printf("WARNING: no CA certificate for the audio server, its identity will NOT be verified.\n");
+    mbedtls_ssl_conf_authmode(&gpTls->config, MBEDTLS_SSL_VERIFY_NONE);
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&gpTls->config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+    if (datagramNotStream) {
+        mbedtls_ssl_conf_handshake_timeout(&gpTls->config, DTLS_HANDSHAKE_TIMEOUT_MIN_MS,
+                                           DTLS_HANDSHAKE_TIMEOUT_MAX_MS);
+    }
+
+    x = mbedtls_ssl_setup(&gpTls->ssl, &gpTls->config);
+    if (x != 0) {
+        bad();
+        LOG(EVENT_AUDIO_TLS_HANDSHAKE_FAILURE, x);
+        printf("Unable to set up TLS (error -0x%04x).\n", -x);
+        freeContext();
+        return TLS_HANDSHAKE_NONE;
+    }
+    mbedtls_ssl_set_bio(&gpTls->ssl, gpTls, bioSend, bioRecv, NULL);
+    if (datagramNotStream) {
+        mbedtls_ssl_set_timer_cb(&gpTls->ssl, gpTls, dtlsTimerSet, dtlsTimerGet);
+    }
+
+    if (isSessionCached(pServer, datagramNotStream)) {
+        resumeAttempted = restoreSession(gpTls);
+        printf("Attempting to resume previous session (%s).\n",
+               gSessionCache.ticketLen > 0 ? "session ticket" : "session ID");
+    }
+
+    timer.start();
+    do {
+        x = mbedtls_ssl_handshake(&gpTls->ssl);
+        feedWatchdog();
+    } while (((x == MBEDTLS_ERR_SSL_WANT_READ) || (x == MBEDTLS_ERR_SSL_WANT_WRITE)) &&
+             (timer.read_ms() < TLS_HANDSHAKE_TIMEOUT_MS));
+    timer.stop();
+
+    if (x != 0) {
+        bad();
+        LOG(EVENT_AUDIO_TLS_HANDSHAKE_FAILURE, x);
+        printf("TLS handshake failed after %d ms (error -0x%04x).\n", timer.read_ms(), -x);
+        // Don't try to resume a session that may be the cause of the problem
+        if (resumeAttempted) {
+            tlsClearSessionCache();
+        }
+        freeContext();
+        return TLS_HANDSHAKE_NONE;
+    }
+
+    if (resumeAttempted && wasSessionResumed(gpTls)) {
+        handshakeType = TLS_HANDSHAKE_RESUMED;
+        LOG(EVENT_AUDIO_TLS_HANDSHAKE_RESUMED, timer.read_ms());
+    } else {
+        LOG(EVENT_AUDIO_TLS_HANDSHAKE_FULL, timer.read_ms());
+    }
+    gHandshakeDurationMs[handshakeType] = timer.read_ms();
+    printf("%s handshake (%s) completed in %d ms, ciphersuite %s.\n",
+           datagramNotStream ? "DTLS" : "TLS",
+           handshakeType == TLS_HANDSHAKE_RESUMED ? "resumed" : "full",
+           timer.read_ms(), mbedtls_ssl_get_ciphersuite(&gpTls->ssl));
+
+    saveSession(gpTls);
+
+    return handshakeType;
+}
+
+// Send data over the current session.
+int tlsSend(const char *pData, int size, int timeoutMs)
+{
+    int x = NSAPI_ERROR_NO_SOCKET;
+    int count = 0;
+    Timer timer;
+
+    if (gpTls != NULL) {
+        timer.start();
+        while ((count < size) && (timer.read_ms() < timeoutMs)) {
+            x = mbedtls_ssl_write(&gpTls->ssl, (const unsigned char *) pData + count, size - count);
+            if (x > 0) {
+                count += x;
+            } else if ((x != MBEDTLS_ERR_SSL_WANT_READ) && (x != MBEDTLS_ERR_SSL_WANT_WRITE)) {
+                break;
+            }
+        }
+        timer.stop();
+
+        if ((x == MBEDTLS_ERR_SSL_WANT_READ) || (x == MBEDTLS_ERR_SSL_WANT_WRITE)) {
+            x = 0;
+        }
+    }
+
+    if (x < 0) {
+        count = x;
+    }
+
+    return count;
+}
+
+// Close the current session.
+void tlsDisconnect()
+{
+    if (gpTls != NULL) {
+        mbedtls_ssl_close_notify(&gpTls->ssl);
+        freeContext();
+    }
+}
+
+// Discard the cached session.
+void tlsClearSessionCache()
+{
+    memset(&gSessionCache, 0, sizeof (gSessionCache));
+}
+
+// Get the duration of the most recent handshake of the given type.
+int getTlsHandshakeDurationMs(TlsHandshakeType type)
+{
+    int durationMs = -1;
+
+    if ((type >= 0) && (type < (int) (sizeof (gHandshakeDurationMs) / sizeof (gHandshakeDurationMs[0])))) {
+        durationMs = gHandshakeDurationMs[type];
+    }
+
+    return durationMs;
+}
+
+// End of file
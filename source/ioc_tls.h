@@ -0,0 +1,107 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mbed.h"
+
+#ifndef _IOC_TLS_
+#define _IOC_TLS_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The maximum time allowed for a TLS/DTLS handshake.
+#define TLS_HANDSHAKE_TIMEOUT_MS 20000
+
+// The minimum and maximum DTLS handshake retransmission
+// timeouts (see mbedtls_ssl_conf_handshake_timeout()).
+#define DTLS_HANDSHAKE_TIMEOUT_MIN_MS 1000
+#define DTLS_HANDSHAKE_TIMEOUT_MAX_MS 8000
+
+// The maximum size of session ticket that will be cached
+// in back-up SRAM; a larger ticket is not cached, in which
+// case resumption falls back to the session ID alone.
+#define TLS_SESSION_TICKET_MAX_SIZE 192
+
+// The maximum length of an IP address string held in the
+// session cache (including terminator).
+#define TLS_SESSION_MAX_LEN_IP_ADDRESS 40
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+/** The ways a TLS/DTLS session can be established.
+ */
+typedef enum {
+    TLS_HANDSHAKE_NONE,
+    TLS_HANDSHAKE_FULL,
+    TLS_HANDSHAKE_RESUMED
+} TlsHandshakeType;
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Perform a TLS (over TCP) or DTLS (over UDP) handshake on an
+ * already opened (and, for TCP, connected) socket, resuming the
+ * cached session with this server if there is one.  On success
+ * the session is cached, in back-up SRAM, so that it may be
+ * resumed after a reconnect or a period in standby.
+ *
+ * @param pSocket           the open socket.
+ * @param pServer           the address of the server.
+ * @param datagramNotStream true if pSocket is a UDPSocket (DTLS),
+ *                          false if it is a TCPSocket (TLS).
+ * @return                  the type of handshake that was performed,
+ *                          TLS_HANDSHAKE_NONE on failure.
+ */
+TlsHandshakeType tlsConnect(Socket *pSocket, const SocketAddress *pServer,
+                            bool datagramNotStream);
+
+/** Send data over the current TLS/DTLS session.  For DTLS
+ * the data is sent as a single datagram.
+ *
+ * @param pData     the data to send.
+ * @param size      the amount of data to send.
+ * @param timeoutMs the maximum time to spend sending.
+ * @return          the number of bytes sent or negative
+ *                  error code.
+ */
+int tlsSend(const char *pData, int size, int timeoutMs);
+
+/** Close the current TLS/DTLS session, freeing its resources;
+ * the session cache is retained.  The underlying socket
+ * must be closed separately, by the caller.
+ */
+void tlsDisconnect();
+
+/** Discard the cached session so that the next
+ * tlsConnect() performs a full handshake.
+ */
+void tlsClearSessionCache();
+
+/** Get the duration of the most recent handshake of the
+ * given type.
+ *
+ * @param type the handshake type.
+ * @return     the duration in milliseconds, -1 if there
+ *             has been no handshake of that type.
+ */
+int getTlsHandshakeDurationMs(TlsHandshakeType type);
+
+#endif // _IOC_TLS_
+
+// End of file
@@ -0,0 +1,262 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef __MBED__
+# include "mbed.h"
+# include "us_ticker_api.h"
+#else
+# include <time.h>
+# include <pthread.h>
+#endif
+
+#include "ioc_trace.h"
+
+/* This file implements tracing of the hot paths: a span is the
+ * time between traceSpanStart() and traceSpanEnd(), measured with
+ * the microsecond ticker, so it costs a couple of register reads
+ * rather than a Timer or a LOG() call, and is cheap enough to leave
+ * in the I2S interrupt.  The I2S span, which never blocks, is
+ * measured with the Cortex-M DWT cycle counter to get sub-microsecond
+ * resolution; the cycle counter stops while the core sleeps, so it
+ * can't be used for spans that block (e.g. a socket send), during
+ * which the idle thread may put the core to sleep.  Spans are
+ * written to a ring which any thread or interrupt may write to
+ * without locking: a writer claims a slot by atomically incrementing
+ * the write index and marks the slot valid, once written, by setting
+ * its sequence number.  printTrace() writes the ring out as Chrome
+ * trace JSON.
+ *
+ * When built for a host (i.e. not under mbed) the cycle counter
+ * is replaced by clock_gettime(), ticks being nanoseconds.
+ */
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+#ifndef __MBED__
+// Host ticks are nanoseconds.
+# define TRACE_HOST_TICKS_PER_US 1000
+#endif
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A span as stored in the ring.
+typedef struct {
+    volatile uint32_t sequence; // Index in the ring + 1, 0 while being written.
+    uint32_t startUs;
+    uint32_t durationUs;
+    uint32_t threadId;          // 0 for interrupt context.
+    uint16_t name;              // A TraceSpanName.
+    uint16_t durationNs;        // Nanoseconds to add to durationUs.
+} TraceRecord;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The ring of spans.
+// Note: not in CCMRAM, which the datagram storage and the
+// log buffer all but fill.
+static TraceRecord gTraceRing[TRACE_NUM_SPANS];
+
+// The number of spans ever written; the next is written
+// at gTraceNext % TRACE_NUM_SPANS.
+static volatile uint32_t gTraceNext = 0;
+
+// The names of the spans, matching TraceSpanName.
+static const char *gTraceSpanName[] = {"i2sEventCallback",
+                                       "sendAudioData",
+                                       "tcpSend",
+                                       "gnssUpdate",
+                                       "cloudClientObjectUpdate"};
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Read the cycle counter.
+static inline uint32_t traceTicks()
+{
+#ifdef __MBED__
+    return DWT->CYCCNT;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) ((uint64_t) now.tv_sec * 1000000000 + now.tv_nsec);
+#endif
+}
+
+// Read the microsecond time stamp.
+static inline uint32_t traceTimeUs()
+{
+#ifdef __MBED__
+    return us_ticker_read();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) ((uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000);
+#endif
+}
+
+// The number of cycle counter ticks in a microsecond.
+static inline uint32_t traceTicksPerUs()
+{
+#ifdef __MBED__
+    return SystemCoreClock / 1000000;
+#else
+    return TRACE_HOST_TICKS_PER_US;
+#endif
+}
+
+// Identify the current thread, 0 if in interrupt context.
+static inline uint32_t traceThreadId()
+{
+#ifdef __MBED__
+    if (__get_IPSR() != 0) {
+        return 0;
+    }
+    return (uint32_t) osThreadGetId();
+#else
+    return (uint32_t) (uintptr_t) pthread_self();
+#endif
+}
+
+// Claim the next slot in the ring, returning its index.
+static inline uint32_t traceClaim()
+{
+#ifdef __MBED__
+    return core_util_atomic_incr_u32(&gTraceNext, 1) - 1;
+#else
+    return __atomic_fetch_add(&gTraceNext, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+// Make sure that all preceding writes are visible
+// before any that follow.
+static inline void traceBarrier()
+{
+#ifdef __MBED__
+    __DMB();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Initialise tracing.
+void initTrace()
+{
+#ifdef __MBED__
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    for (unsigned int x = 0; x < sizeof (gTraceRing) / sizeof (gTraceRing[0]); x++) {
+        gTraceRing[x].sequence = 0;
+    }
+    gTraceNext = 0;
+}
+
+// Start a span.
+void traceSpanStart(TraceSpan *pSpan)
+{
+    pSpan->startUs = traceTimeUs();
+    pSpan->startTicks = traceTicks();
+}
+
+// End a span.
+unsigned int traceSpanEnd(const TraceSpan *pSpan, TraceSpanName name)
+{
+    uint32_t durationTicks = traceTicks() - pSpan->startTicks;
+    uint32_t durationUs = traceTimeUs() - pSpan->startUs;
+    uint32_t durationNs = 0;
+    uint32_t index;
+    TraceRecord *pRecord;
+
+    // Only the I2S span is timed with the cycle counter
+    // since it never blocks (see above)
+    if (name == TRACE_SPAN_I2S_EVENT_CALLBACK) {
+        durationUs = durationTicks / traceTicksPerUs();
+        durationNs = ((durationTicks % traceTicksPerUs()) * 1000) / traceTicksPerUs();
+    }
+
+    index = traceClaim();
+    pRecord = &gTraceRing[index % TRACE_NUM_SPANS];
+    pRecord->sequence = 0;
+    traceBarrier();
+    pRecord->startUs = pSpan->startUs;
+    pRecord->durationUs = durationUs;
+    pRecord->threadId = traceThreadId();
+    pRecord->name = (uint16_t) name;
+    pRecord->durationNs = (uint16_t) durationNs;
+    traceBarrier();
+    pRecord->sequence = index + 1;
+
+    return durationUs;
+}
+
+// Write the ring out as Chrome trace JSON.
+int printTrace(FILE *pStream)
+{
+    uint32_t next = gTraceNext;
+    uint32_t first = 0;
+    uint32_t baseUs = 0;
+    TraceRecord record;
+    const TraceRecord *pRecord;
+    const char *pName;
+    int numSpans = 0;
+
+    if (next > TRACE_NUM_SPANS) {
+        first = next - TRACE_NUM_SPANS;
+    }
+
+    fprintf(pStream, "{\"traceEvents\":[\n");
+    fprintf(pStream, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+            "\"args\":{\"name\":\"interrupt\"}}");
+    for (uint32_t x = first; x < next; x++) {
+        pRecord = &gTraceRing[x % TRACE_NUM_SPANS];
+        record = *pRecord;
+        traceBarrier();
+        // Skip spans being written, or overwritten, as we read
+        if ((record.sequence == x + 1) && (pRecord->sequence == x + 1)) {
+            if (numSpans == 0) {
+                baseUs = record.startUs;
+            }
+            pName = "?";
+            if (record.name < sizeof (gTraceSpanName) / sizeof (gTraceSpanName[0])) {
+                pName = gTraceSpanName[record.name];
+            }
+            fprintf(pStream, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%d,\"dur\":%u.%03u}", pName, (unsigned int) record.threadId,
+                    (int) (record.startUs - baseUs), (unsigned int) record.durationUs,
+                    (unsigned int) record.durationNs);
+            numSpans++;
+        }
+    }
+    fprintf(pStream, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    return numSpans;
+}
+
+// End of file
@@ -0,0 +1,82 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef _IOC_TRACE_
+#define _IOC_TRACE_
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of spans kept, the oldest being overwritten
+// when the ring is full.
+#define TRACE_NUM_SPANS 256
+
+/* ----------------------------------------------------------------
+ * GENERAL TYPES
+ * -------------------------------------------------------------- */
+
+// The things that are traced; if you add to this, add a
+// name to gTraceSpanName[] in ioc_trace.cpp.
+typedef enum {
+    TRACE_SPAN_I2S_EVENT_CALLBACK,
+    TRACE_SPAN_SEND_AUDIO_DATA,
+    TRACE_SPAN_TCP_SEND,
+    TRACE_SPAN_GNSS_UPDATE,
+    TRACE_SPAN_CLOUD_CLIENT_OBJECT_UPDATE,
+    MAX_NUM_TRACE_SPANS
+} TraceSpanName;
+
+// A span in progress, filled in by traceSpanStart().
+typedef struct {
+    uint32_t startUs;    ///< Microsecond time stamp.
+    uint32_t startTicks; ///< Cycle counter, used only for the I2S span.
+} TraceSpan;
+
+/* ----------------------------------------------------------------
+ * FUNCTION PROTOTYPES
+ * -------------------------------------------------------------- */
+
+/** Initialise tracing: start the cycle counter, used to time
+ * the I2S span, and empty the ring of spans.
+ */
+void initTrace();
+
+/** Start a span; may be called from interrupt context.
+ * @param pSpan the span to start.
+ */
+void traceSpanStart(TraceSpan *pSpan);
+
+/** End a span, recording it in the ring; may be called from
+ * interrupt context.
+ * @param pSpan the span, as started by traceSpanStart().
+ * @param name  what the span was.
+ * @return      the duration of the span in microseconds.
+ */
+unsigned int traceSpanEnd(const TraceSpan *pSpan, TraceSpanName name);
+
+/** Write the spans in the ring to a stream as Chrome trace
+ * JSON (load it into chrome://tracing), oldest first.
+ * @param pStream the stream, e.g. stdout.
+ * @return        the number of spans written.
+ */
+int printTrace(FILE *pStream);
+
+#endif // _IOC_TRACE_
+
+// End of file
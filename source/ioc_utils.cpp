@@ -21,6 +21,7 @@
 #include "mbed-trace-helper.h"
 #endif
 #include "stm32f4xx_hal_iwdg.h"
+#include "us_ticker_api.h"
 #include "low_power.h"
 #include "log.h"
 
@@ -30,6 +31,19 @@
  * system reset reason and includes some LED control for debugging.
  */
 
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// Instrumentation for an event queue handler.
+typedef struct {
+    const char *pName;
+    unsigned int numRuns;
+    unsigned int worstCaseRunUs;
+    unsigned int worstCaseLatencyUs;
+    uint32_t nextDueUs; // For a periodic handler.
+} EventQueueHandler;
+
 /* ----------------------------------------------------------------
  * VARIABLES
  * -------------------------------------------------------------- */
@@ -51,9 +65,149 @@ static DigitalOut gLedRed(LED1, 1);
 static DigitalOut gLedGreen(LED2, 1);
 static DigitalOut gLedBlue(LED3, 1);
 
-// The event loop and event queue.
+// The event loop and event queue; each event carries
+// the instrumentation arguments of dispatchHandler() in
+// addition to the usual two words.
 static Thread *gpEventThread = NULL;
-static EventQueue gEventQueue (32 * EVENTS_EVENT_SIZE);
+static EventQueue gEventQueue (EVENT_QUEUE_NUM_EVENTS * (EVENTS_EVENT_SIZE +
+                                                         sizeof (Callback<void()>) +
+                                                         sizeof (EventQueueHandler *) +
+                                                         sizeof (uint32_t) + sizeof (int)));
+
+// Instrumentation for the event queue handlers.
+static EventQueueHandler gEventQueueHandler[EVENT_QUEUE_MAX_NUM_HANDLERS];
+static int gNumEventQueueHandlers = 0;
+static volatile uint32_t gEventQueueNumFull = 0;
+
+// Heap use attributed to each HeapTag, the tag in force, the
+// heap stats when it came into force and the names of the tags.
+static int gHeapTagCurrent[MAX_NUM_HEAP_TAGS];
+static int gHeapTagPeak[MAX_NUM_HEAP_TAGS];
+static HeapTag gHeapTag = HEAP_TAG_OTHER;
+static uint32_t gHeapTagBaseSize = 0;
+static uint32_t gHeapTagBaseMaxSize = 0;
+static Mutex gHeapTagMutex;
+static const char *gHeapTagName[] = {"other", "audio", "cloud client",
+                                     "network", "gnss", "logging"};
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: EVENT QUEUE INSTRUMENTATION
+ * -------------------------------------------------------------- */
+
+// Find the instrumentation for a handler, adding it if necessary.
+// This may be called from any thread.
+static EventQueueHandler *pGetEventQueueHandler(const char *pName)
+{
+    EventQueueHandler *pHandler = NULL;
+
+    core_util_critical_section_enter();
+    for (int x = 0; (x < gNumEventQueueHandlers) && (pHandler == NULL); x++) {
+        if (strcmp(gEventQueueHandler[x].pName, pName) == 0) {
+            pHandler = &gEventQueueHandler[x];
+        }
+    }
+    if (pHandler == NULL) {
+        if (gNumEventQueueHandlers < EVENT_QUEUE_MAX_NUM_HANDLERS) {
+            gNumEventQueueHandlers++;
+            pHandler = &gEventQueueHandler[gNumEventQueueHandlers - 1];
+            memset(pHandler, 0, sizeof (*pHandler));
+            pHandler->pName = pName;
+        } else {
+            pHandler = &gEventQueueHandler[EVENT_QUEUE_MAX_NUM_HANDLERS - 1];
+        }
+    }
+    core_util_critical_section_exit();
+
+    return pHandler;
+}
+
+// Run a handler, measuring when it was run compared with
+// when it was due, and how long it took; this is what is
+// actually queued on the event queue.
+static void dispatchHandler(EventQueueHandler *pHandler, uint32_t dueUs,
+                            int periodMs, Callback<void()> handler)
+{
+    uint32_t startUs = us_ticker_read();
+    int32_t latencyUs;
+    unsigned int runUs;
+    int handlerIndex = pHandler - gEventQueueHandler;
+
+    if (periodMs > 0) {
+        dueUs = pHandler->nextDueUs;
+        pHandler->nextDueUs += periodMs * 1000;
+    }
+    latencyUs = (int32_t) (startUs - dueUs);
+    if (latencyUs < 0) {
+        latencyUs = 0;
+    }
+
+    handler();
+
+    runUs = us_ticker_read() - startUs;
+    pHandler->numRuns++;
+    if (runUs > pHandler->worstCaseRunUs) {
+        pHandler->worstCaseRunUs = runUs;
+        if (runUs > EVENT_QUEUE_HANDLER_SLOW_US) {
+            LOG(EVENT_EVENT_QUEUE_HANDLER_ID, handlerIndex);
+            LOG(EVENT_EVENT_QUEUE_HANDLER_RUN_MAX, runUs);
+        }
+    }
+    if ((unsigned int) latencyUs > pHandler->worstCaseLatencyUs) {
+        pHandler->worstCaseLatencyUs = latencyUs;
+        if (latencyUs > EVENT_QUEUE_HANDLER_SLOW_US) {
+            LOG(EVENT_EVENT_QUEUE_HANDLER_ID, handlerIndex);
+            LOG(EVENT_EVENT_QUEUE_LATENCY_MAX, latencyUs);
+        }
+    }
+}
+
+// Note that the event queue was full.
+static void eventQueueFull(const char *pName)
+{
+    core_util_atomic_incr_u32(&gEventQueueNumFull, 1);
+    LOG(EVENT_EVENT_QUEUE_FULL, pGetEventQueueHandler(pName) - gEventQueueHandler);
+}
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS: HEAP ACCOUNTING
+ * -------------------------------------------------------------- */
+
+// Attribute the change in heap use since the tag in force came
+// into force to that tag; gHeapTagMutex must be locked.
+// Returns true if the tag has a new peak.
+static bool heapTagUpdate()
+{
+    bool newPeak = false;
+#ifdef MBED_HEAP_STATS_ENABLED
+    mbed_stats_heap_t stats;
+    int peak;
+
+    mbed_stats_heap_get(&stats);
+    // If the heap reached a new high while this tag was
+    // in force then that is when this tag peaked
+    peak = gHeapTagCurrent[gHeapTag] + (int) (stats.max_size - gHeapTagBaseSize);
+    gHeapTagCurrent[gHeapTag] += (int) (stats.current_size - gHeapTagBaseSize);
+    if (stats.max_size <= gHeapTagBaseMaxSize) {
+        peak = gHeapTagCurrent[gHeapTag];
+    }
+    if (peak > gHeapTagPeak[gHeapTag]) {
+        gHeapTagPeak[gHeapTag] = peak;
+        newPeak = true;
+    }
+    gHeapTagBaseSize = stats.current_size;
+    gHeapTagBaseMaxSize = stats.max_size;
+#endif
+
+    return newPeak;
+}
+
+// Log the heap use of a tag.
+static void heapTagLog(HeapTag tag)
+{
+    LOG(EVENT_HEAP_TAG, tag);
+    LOG(EVENT_HEAP_TAG_CURRENT, gHeapTagCurrent[tag]);
+    LOG(EVENT_HEAP_TAG_PEAK, gHeapTagPeak[tag]);
+}
 
 /* ----------------------------------------------------------------
  * FUNCTIONS: DEBUG
@@ -77,7 +231,7 @@ void bad() {
     gLedGreen = 1;
     gLedBlue = 1;
     if (gpEventThread != NULL) {
-        gEventQueue.call_in(BAD_OFF_PERIOD_MS, notBad);
+        eventQueueCallIn("not bad", BAD_OFF_PERIOD_MS, callback(notBad));
     }
 }
 
@@ -119,9 +273,86 @@ void heapStats()
 
     printf("HEAP size:     %" PRIu32 ".\n", stats.current_size);
     printf("HEAP maxsize:  %" PRIu32 ".\n", stats.max_size);
+
+    gHeapTagMutex.lock();
+    heapTagUpdate();
+    for (int x = 0; x < MAX_NUM_HEAP_TAGS; x++) {
+        printf("HEAP %-13s %d (peak %d).\n", gHeapTagName[x],
+               gHeapTagCurrent[x], gHeapTagPeak[x]);
+    }
+    gHeapTagMutex.unlock();
 #endif
 }
 
+// Start attributing heap use to a tag.
+HeapTag heapTagStart(HeapTag tag)
+{
+    HeapTag previousTag;
+    bool newPeak;
+
+    gHeapTagMutex.lock();
+    previousTag = gHeapTag;
+    newPeak = heapTagUpdate();
+    gHeapTag = tag;
+    gHeapTagMutex.unlock();
+
+    if (newPeak) {
+        heapTagLog(previousTag);
+    }
+
+    return previousTag;
+}
+
+// Stop attributing heap use to a tag.
+void heapTagStop(HeapTag previousTag)
+{
+    HeapTag tag;
+    bool newPeak;
+
+    gHeapTagMutex.lock();
+    tag = gHeapTag;
+    newPeak = heapTagUpdate();
+    gHeapTag = previousTag;
+    gHeapTagMutex.unlock();
+
+    if (newPeak) {
+        heapTagLog(tag);
+    }
+}
+
+// Get the heap use attributed to a tag.
+void getHeapTagUse(HeapTag tag, int *pCurrent, int *pPeak)
+{
+    gHeapTagMutex.lock();
+    heapTagUpdate();
+    if (pCurrent != NULL) {
+        *pCurrent = gHeapTagCurrent[tag];
+    }
+    if (pPeak != NULL) {
+        *pPeak = gHeapTagPeak[tag];
+    }
+    gHeapTagMutex.unlock();
+}
+
+// Write a string describing the heap use by tag.
+char *pHeapTagString(char *pBuf, int lenBuf)
+{
+    int x = 0;
+
+    MBED_STATIC_ASSERT(sizeof (gHeapTagName) / sizeof (gHeapTagName[0]) == MAX_NUM_HEAP_TAGS,
+                       "gHeapTagName must have an entry for each HeapTag");
+    *pBuf = 0;
+    gHeapTagMutex.lock();
+    heapTagUpdate();
+    for (int y = 0; (y < MAX_NUM_HEAP_TAGS) && (x < lenBuf); y++) {
+        x += snprintf(pBuf + x, lenBuf - x, "%s%s:%d/%d", y > 0 ? "," : "",
+                      gHeapTagName[y], gHeapTagCurrent[y], gHeapTagPeak[y]);
+    }
+    gHeapTagMutex.unlock();
+
+    return pBuf;
+}
+
 /* ----------------------------------------------------------------
  * FUNCTIONS: MISC
  * -------------------------------------------------------------- */
@@ -174,7 +405,7 @@ void feedWatchdog()
 // Initialise the event queue in its own thread.
 void initEventQueue()
 {
-    gpEventThread = new Thread();
+    gpEventThread = new Thread(osPriorityNormal, OS_STACK_SIZE, NULL, "event");
     gpEventThread->start(callback(&gEventQueue, &EventQueue::dispatch_forever));
 }
 
@@ -193,4 +424,143 @@ EventQueue *pGetEventQueue()
     return &gEventQueue;
 }
 
+// Queue an instrumented handler to run as soon as possible.
+int eventQueueCall(const char *pName, Callback<void()> handler)
+{
+    int id;
+
+    id = gEventQueue.call(&dispatchHandler, pGetEventQueueHandler(pName),
+                          us_ticker_read(), 0, handler);
+    if (id == 0) {
+        eventQueueFull(pName);
+    }
+
+    return id;
+}
+
+// Queue an instrumented handler to run after a delay.
+int eventQueueCallIn(const char *pName, int delayMs, Callback<void()> handler)
+{
+    int id;
+
+    id = gEventQueue.call_in(delayMs, &dispatchHandler, pGetEventQueueHandler(pName),
+                             (uint32_t) (us_ticker_read() + delayMs * 1000), 0, handler);
+    if (id == 0) {
+        eventQueueFull(pName);
+    }
+
+    return id;
+}
+
+// Queue an instrumented handler to run periodically.
+int eventQueueCallEvery(const char *pName, int periodMs, Callback<void()> handler)
+{
+    EventQueueHandler *pHandler = pGetEventQueueHandler(pName);
+    int id;
+
+    pHandler->nextDueUs = us_ticker_read() + periodMs * 1000;
+    id = gEventQueue.call_every(periodMs, &dispatchHandler, pHandler,
+                                (uint32_t) 0, periodMs, handler);
+    if (id == 0) {
+        eventQueueFull(pName);
+    }
+
+    return id;
+}
+
+// Get the number of times the event queue was full.
+unsigned int getEventQueueNumFull()
+{
+    return gEventQueueNumFull;
+}
+
+// Write a string describing the slowest event queue handlers.
+char *pEventQueueSlowestHandlersString(char *pBuf, int lenBuf, int numHandlers)
+{
+    bool done[EVENT_QUEUE_MAX_NUM_HANDLERS] = {false};
+    const EventQueueHandler *pHandler;
+    int slowest;
+    int x = 0;
+
+    *pBuf = 0;
+    for (int y = 0; (y < numHandlers) && (y < gNumEventQueueHandlers) && (x < lenBuf); y++) {
+        // Find the slowest handler not yet written
+        slowest = -1;
+        for (int z = 0; z < gNumEventQueueHandlers; z++) {
+            if (!done[z] && (gEventQueueHandler[z].numRuns > 0) &&
+                ((slowest < 0) ||
+                 (gEventQueueHandler[z].worstCaseRunUs > gEventQueueHandler[slowest].worstCaseRunUs))) {
+                slowest = z;
+            }
+        }
+        if (slowest >= 0) {
+            done[slowest] = true;
+            pHandler = &gEventQueueHandler[slowest];
+            x += snprintf(pBuf + x, lenBuf - x, "%s%s:%u/%u", y > 0 ? "," : "",
+                          pHandler->pName, pHandler->worstCaseRunUs / 1000,
+                          pHandler->worstCaseLatencyUs / 1000);
+        }
+    }
+
+    return pBuf;
+}
+
+// Get the address portion of a URL, leaving off the port number etc.
+void getAddressFromUrl(const char * pUrl, char * pAddressBuf, int lenBuf)
+{
+    const char * pPortPos;
+    int lenUrl;
+
+    if (lenBuf > 0) {
+        // Check for the presence of a port number
+        pPortPos = strchr(pUrl, ':');
+        if (pPortPos != NULL) {
+            // Length wanted is up to and including the ':'
+            // (which will be overwritten with the terminator)
+            if (lenBuf > pPortPos - pUrl + 1) {
+                lenBuf = pPortPos - pUrl + 1;
+            }
+        } else {
+            // No port number, take the whole thing
+            // including the terminator
+            lenUrl = strlen (pUrl);
+            if (lenBuf > lenUrl + 1) {
+                lenBuf = lenUrl + 1;
+            }
+        }
+        memcpy (pAddressBuf, pUrl, lenBuf);
+        *(pAddressBuf + lenBuf - 1) = 0;
+    }
+}
+
+// Get the port number from the end of a URL.
+bool getPortFromUrl(const char * pUrl, int *port)
+{
+    bool success = false;
+    const char * pPortPos = strchr(pUrl, ':');
+
+    if (pPortPos != NULL) {
+        *port = atoi(pPortPos + 1);
+        success = true;
+    }
+
+    return success;
+}
+
+// Calculate a CRC32 (the IEEE 802.3 one) over a block of data.
+uint32_t crc32(const void *pData, unsigned int length)
+{
+    const uint8_t *pByte = (const uint8_t *) pData;
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (unsigned int x = 0; x < length; x++) {
+        crc ^= *pByte++;
+        for (int y = 0; y < 8; y++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
 // End of file
@@ -28,6 +28,26 @@
 // The period after which the "bad" status LED is tidied up.
 #define BAD_OFF_PERIOD_MS 10000
 
+// The number of events the event queue can hold.
+#define EVENT_QUEUE_NUM_EVENTS 32
+
+// The maximum number of distinct event queue handlers that
+// are instrumented; any more are lumped in with the last.
+#define EVENT_QUEUE_MAX_NUM_HANDLERS 16
+
+// An event queue handler that runs for longer than this,
+// or is dispatched later than this, is logged each time it
+// sets a new worst case.
+#define EVENT_QUEUE_HANDLER_SLOW_US 50000
+
+// The maximum length of the string form of the slowest
+// event queue handlers, per handler (including separator).
+#define EVENT_QUEUE_HANDLER_MAX_LEN_STRING 32
+
+// The maximum length of the string form of the heap use
+// by tag (including terminator): "name:current/peak," per tag.
+#define HEAP_TAG_MAX_LEN_STRING (MAX_NUM_HEAP_TAGS * 32)
+
 /* ----------------------------------------------------------------
  * TYPES
  * -------------------------------------------------------------- */
@@ -43,6 +63,18 @@ typedef enum {
   NUM_RESET_REASONS
 } ResetReason;
 
+// The subsystems that heap use is attributed to; if you
+// add to this, add a name to gHeapTagName[] in ioc_utils.cpp.
+typedef enum {
+  HEAP_TAG_OTHER,
+  HEAP_TAG_AUDIO,
+  HEAP_TAG_CLOUD_CLIENT,
+  HEAP_TAG_NETWORK,
+  HEAP_TAG_GNSS,
+  HEAP_TAG_LOGGING,
+  MAX_NUM_HEAP_TAGS
+} HeapTag;
+
 /* ----------------------------------------------------------------
  * FUNCTION PROTOTYPES
  * -------------------------------------------------------------- */
@@ -79,10 +111,46 @@ void flash();
  */
 void ledOff();
 
-/** Print heap stats.
+/** Print heap stats, including the heap use by tag.
  */
 void heapStats();
 
+/** Attribute changes in heap use from now on to a subsystem,
+ * until heapTagStop() is called; anything not otherwise tagged
+ * is attributed to HEAP_TAG_OTHER.  The attribution is by
+ * difference in the total heap use, hence any allocations made
+ * by other threads while a tag is in force are included in it.
+ * Tags may be nested.  Must not be called from interrupt context.
+ * Note: requires MBED_HEAP_STATS_ENABLED, otherwise heap use is
+ * not measured.
+ * @param tag the subsystem.
+ * @return    the tag that was in force, to be passed to
+ *            heapTagStop().
+ */
+HeapTag heapTagStart(HeapTag tag);
+
+/** Stop attributing changes in heap use to the tag given
+ * to heapTagStart().
+ * @param previousTag the tag returned by heapTagStart().
+ */
+void heapTagStop(HeapTag previousTag);
+
+/** Get the heap use attributed to a subsystem.
+ * @param tag      the subsystem.
+ * @param pCurrent a place to put the current heap use, in bytes.
+ * @param pPeak    a place to put the peak heap use, in bytes.
+ */
+void getHeapTagUse(HeapTag tag, int *pCurrent, int *pPeak);
+
+/** Write a string describing the heap use by subsystem,
+ * each of the form "name:current/peak", in bytes, comma
+ * separated.
+ * @param pBuf   the buffer to write to.
+ * @param lenBuf the length of pBuf.
+ * @return       pBuf.
+ */
+char *pHeapTagString(char *pBuf, int lenBuf);
+
 /** Find out what woke us up.   Use
  * this at power on.
  * @return the reason we woke up.
@@ -114,10 +182,90 @@ void initEventQueue();
 void deinitEventQueue();
 
 /** Get a pointer to the event queue.
+ * Note: to have a handler instrumented, queue it using
+ * eventQueueCall(), eventQueueCallIn() or eventQueueCallEvery()
+ * rather than calling the event queue directly; the ID returned
+ * by these may be passed to the event queue's cancel() function
+ * as normal.
  * @return a pointer to the event queue.
  */
 EventQueue *pGetEventQueue();
 
+/** Queue a handler to run on the event queue as soon as possible,
+ * measuring the time from now until it is run and how long it runs.
+ * @param pName    the name of the handler, which must be a string
+ *                 constant as only the pointer is kept.
+ * @param handler  the handler.
+ * @return         the event ID, 0 if the event queue is full.
+ */
+int eventQueueCall(const char *pName, Callback<void()> handler);
+
+/** As eventQueueCall() but after a delay, the latency
+ * being measured from the end of the delay.
+ * @param pName    the name of the handler, which must be a string
+ *                 constant as only the pointer is kept.
+ * @param delayMs  the delay.
+ * @param handler  the handler.
+ * @return         the event ID, 0 if the event queue is full.
+ */
+int eventQueueCallIn(const char *pName, int delayMs, Callback<void()> handler);
+
+/** As eventQueueCall() but periodically, the latency being
+ * measured from the time each period is due.  Handlers queued
+ * with the same name share their instrumentation, hence only
+ * one periodic handler of a given name should be queued at
+ * any one time.
+ * @param pName    the name of the handler, which must be a string
+ *                 constant as only the pointer is kept.
+ * @param periodMs the period.
+ * @param handler  the handler.
+ * @return         the event ID, 0 if the event queue is full.
+ */
+int eventQueueCallEvery(const char *pName, int periodMs, Callback<void()> handler);
+
+/** Get the number of times an event could not be queued
+ * because the event queue was full.
+ * @return the number of times.
+ */
+unsigned int getEventQueueNumFull();
+
+/** Write a string describing the event queue handlers that
+ * have taken longest to run, slowest first, each of the form
+ * "name:run/latency", where run is the worst case run time
+ * and latency the worst case time from when the handler was
+ * due to when it was run, both in milliseconds, comma
+ * separated.
+ * @param pBuf        the buffer to write to.
+ * @param lenBuf      the length of pBuf.
+ * @param numHandlers the maximum number of handlers to include.
+ * @return            pBuf.
+ */
+char *pEventQueueSlowestHandlersString(char *pBuf, int lenBuf, int numHandlers);
+
+/** Get the address portion of a URL of the form
+ * "address:port", leaving off the port number.
+ * @param pUrl        the URL.
+ * @param pAddressBuf a buffer for the address.
+ * @param lenBuf      the length of pAddressBuf.
+ */
+void getAddressFromUrl(const char * pUrl, char * pAddressBuf, int lenBuf);
+
+/** Get the port number from the end of a URL of the
+ * form "address:port".
+ * @param pUrl the URL.
+ * @param port a place to put the port number.
+ * @return     true if there was a port number, otherwise false.
+ */
+bool getPortFromUrl(const char * pUrl, int *port);
+
+/** Calculate a CRC32 (the IEEE 802.3 one) over a block of data,
+ * e.g. to check that what is in backup SRAM is valid.
+ * @param pData  the data.
+ * @param length the length of the data in bytes.
+ * @return       the CRC.
+ */
+uint32_t crc32(const void *pData, unsigned int length);
+
 #endif // _IOC_UTILS_
 
 // End of file
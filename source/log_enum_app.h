@@ -152,6 +152,81 @@
     EVENT_TCP_CWND,
     EVENT_TCP_WND,
     EVENT_TCP_EFFWND,
-    EVENT_TCP_ACK
+    EVENT_TCP_ACK,
+    EVENT_AUDIO_TLS_HANDSHAKE_START,
+    EVENT_AUDIO_TLS_HANDSHAKE_FAILURE,
+    EVENT_AUDIO_TLS_HANDSHAKE_FULL,
+    EVENT_AUDIO_TLS_HANDSHAKE_RESUMED,
+    EVENT_AUDIO_BLOCK_CODE_DURATION_MAX,
+    EVENT_SET_AUDIO_DATAGRAM_STORE_SIZE,
+    EVENT_DATAGRAM_OVERFLOW_ENDS,
+    EVENT_AUDIO_DATAGRAMS_DISCARDED,
+    EVENT_SET_AUDIO_SCHEDULE,
+    EVENT_AUDIO_SCHEDULE_INVALID,
+    EVENT_AUDIO_SCHEDULE_WINDOW_START,
+    EVENT_AUDIO_SCHEDULE_WINDOW_END,
+    EVENT_SLEEP_UNTIL_SCHEDULE_WINDOW,
+    EVENT_CPU_LOAD_PERCENT,
+    EVENT_THREAD_STACK_ID,
+    EVENT_THREAD_STACK_SIZE,
+    EVENT_THREAD_STACK_MAX_USED,
+    EVENT_EVENT_QUEUE_HANDLER_ID,
+    EVENT_EVENT_QUEUE_HANDLER_RUN_MAX,
+    EVENT_EVENT_QUEUE_LATENCY_MAX,
+    EVENT_EVENT_QUEUE_FULL,
+    EVENT_HEAP_TAG,
+    EVENT_HEAP_TAG_CURRENT,
+    EVENT_HEAP_TAG_PEAK,
+    EVENT_ENERGY_MODE,
+    EVENT_ENERGY_MODE_DAY_UAH,
+    EVENT_DIAGNOSTICS_LIFETIME_RESET,
+    EVENT_DIAGNOSTICS_LIFETIME_WAKE_UPS,
+    EVENT_NETWORK_STATS_TCP_RETRANSMISSIONS,
+    EVENT_NETWORK_STATS_PBUF_POOL_EXHAUSTED,
+    EVENT_NETWORK_STATS_TCP_SEG_EXHAUSTED,
+    EVENT_NETWORK_STATS_TCP_SEGS_MAX_USED,
+    EVENT_NETWORK_STATS_PPP_FRAME_ERRORS,
+    EVENT_NETWORK_STATS_PPP_FRAMES_DROPPED,
+    EVENT_NETWORK_STATS_SESSION_SECONDS,
+    EVENT_AUDIO_LINK_RTT_MS,
+    EVENT_AUDIO_LINK_PROBE_START,
+    EVENT_AUDIO_LINK_PROBE_START_FAILURE,
+    EVENT_AUDIO_LINK_PROBE_SEND_FAILURE,
+    EVENT_AUDIO_LINK_PROBE_STOP,
+    EVENT_LOG_WRITER_START_FAILURE,
+    EVENT_LOG_FLUSH_TIMEOUT,
+    EVENT_LOG_COMPACT_RAW_SIZE,
+    EVENT_LOG_COMPACT_SIZE,
+    EVENT_LOG_COMPACT_FAILURE,
+    EVENT_LOG_UPLOAD_START,
+    EVENT_LOG_UPLOAD_START_FAILURE,
+    EVENT_LOG_UPLOAD_CONNECT_FAILURE,
+    EVENT_LOG_UPLOAD_FILE,
+    EVENT_LOG_UPLOAD_RESUME_OFFSET,
+    EVENT_LOG_UPLOAD_OFFSET_MISMATCH,
+    EVENT_LOG_UPLOAD_FILE_COMPLETE,
+    EVENT_LOG_UPLOAD_FAILURE,
+    EVENT_LOG_UPLOAD_SAVE_OFFSETS_FAILURE,
+    EVENT_LOG_UPLOAD_STOP,
+    EVENT_SET_LOG_UPLOAD_BUDGET_BYTES,
+    EVENT_LOG_UPLOAD_PAUSED_LINK_BUSY,
+    EVENT_LOG_UPLOAD_PAUSED_BUDGET_SPENT,
+    EVENT_LOG_UPLOAD_RESUMED,
+    EVENT_LOG_UPLOAD_BUDGET_RESET,
+    EVENT_SET_LOG_FILTER,
+    EVENT_LOG_FILTER_INVALID,
+    EVENT_LOG_RING_FILE_OPEN,
+    EVENT_LOG_RING_FILE_OPEN_FAILURE,
+    EVENT_LOG_RING_OVERFLOW,
+    EVENT_LOG_INDEX_LOADED,
+    EVENT_LOG_INDEX_BUILT,
+    EVENT_LOG_INDEX_SAVE_FAILURE,
+    EVENT_LOG_INDEX_SESSION_FILE,
+    EVENT_LOG_INDEX_FILE_DELETED,
+    EVENT_LOG_RING_FILE_ROTATE,
+    EVENT_LOG_UPLOAD_PROTOCOL,
+    EVENT_LOG_UPLOAD_FILE_BYTES_SENT,
+    EVENT_LOG_COMPACT_PART_ENTRY_DROPPED,
+    EVENT_ENERGY_RESET
 
 // End of file
@@ -152,6 +152,81 @@
     "  TCP_CWND",
     "  TCP_WND",
     "  TCP_EFFWND",
-    "  TCP_ACK"
+    "  TCP_ACK",
+    "  AUDIO_TLS_HANDSHAKE_START",
+    "* AUDIO_TLS_HANDSHAKE_FAILURE",
+    "  AUDIO_TLS_HANDSHAKE_FULL",
+    "  AUDIO_TLS_HANDSHAKE_RESUMED",
+    "  AUDIO_BLOCK_CODE_DURATION_MAX",
+    "  SET_AUDIO_DATAGRAM_STORE_SIZE",
+    "  DATAGRAM_OVERFLOW_ENDS",
+    "  AUDIO_DATAGRAMS_DISCARDED",
+    "  SET_AUDIO_SCHEDULE",
+    "* AUDIO_SCHEDULE_INVALID",
+    "  AUDIO_SCHEDULE_WINDOW_START",
+    "  AUDIO_SCHEDULE_WINDOW_END",
+    "  SLEEP_UNTIL_SCHEDULE_WINDOW",
+    "  CPU_LOAD_PERCENT",
+    "  THREAD_STACK_ID",
+    "  THREAD_STACK_SIZE",
+    "  THREAD_STACK_MAX_USED",
+    "  EVENT_QUEUE_HANDLER_ID",
+    "  EVENT_QUEUE_HANDLER_RUN_MAX",
+    "  EVENT_QUEUE_LATENCY_MAX",
+    "* EVENT_QUEUE_FULL",
+    "  HEAP_TAG",
+    "  HEAP_TAG_CURRENT",
+    "  HEAP_TAG_PEAK",
+    "  ENERGY_MODE",
+    "  ENERGY_MODE_DAY_UAH",
+    "* DIAGNOSTICS_LIFETIME_RESET",
+    "  DIAGNOSTICS_LIFETIME_WAKE_UPS",
+    "  NETWORK_STATS_TCP_RETRANSMISSIONS",
+    "* NETWORK_STATS_PBUF_POOL_EXHAUSTED",
+    "* NETWORK_STATS_TCP_SEG_EXHAUSTED",
+    "  NETWORK_STATS_TCP_SEGS_MAX_USED",
+    "* NETWORK_STATS_PPP_FRAME_ERRORS",
+    "  NETWORK_STATS_PPP_FRAMES_DROPPED",
+    "  NETWORK_STATS_SESSION_SECONDS",
+    "  AUDIO_LINK_RTT_MS",
+    "  AUDIO_LINK_PROBE_START",
+    "* AUDIO_LINK_PROBE_START_FAILURE",
+    "* AUDIO_LINK_PROBE_SEND_FAILURE",
+    "  AUDIO_LINK_PROBE_STOP",
+    "* LOG_WRITER_START_FAILURE",
+    "* LOG_FLUSH_TIMEOUT",
+    "  LOG_COMPACT_RAW_SIZE",
+    "  LOG_COMPACT_SIZE",
+    "* LOG_COMPACT_FAILURE",
+    "  LOG_UPLOAD_START",
+    "* LOG_UPLOAD_START_FAILURE",
+    "* LOG_UPLOAD_CONNECT_FAILURE",
+    "  LOG_UPLOAD_FILE",
+    "  LOG_UPLOAD_RESUME_OFFSET",
+    "* LOG_UPLOAD_OFFSET_MISMATCH",
+    "  LOG_UPLOAD_FILE_COMPLETE",
+    "* LOG_UPLOAD_FAILURE",
+    "* LOG_UPLOAD_SAVE_OFFSETS_FAILURE",
+    "  LOG_UPLOAD_STOP",
+    "  SET_LOG_UPLOAD_BUDGET_BYTES",
+    "  LOG_UPLOAD_PAUSED_LINK_BUSY",
+    "  LOG_UPLOAD_PAUSED_BUDGET_SPENT",
+    "  LOG_UPLOAD_RESUMED",
+    "  LOG_UPLOAD_BUDGET_RESET",
+    "  SET_LOG_FILTER",
+    "* LOG_FILTER_INVALID",
+    "  LOG_RING_FILE_OPEN",
+    "* LOG_RING_FILE_OPEN_FAILURE",
+    "* LOG_RING_OVERFLOW",
+    "  LOG_INDEX_LOADED",
+    "  LOG_INDEX_BUILT",
+    "* LOG_INDEX_SAVE_FAILURE",
+    "  LOG_INDEX_SESSION_FILE",
+    "  LOG_INDEX_FILE_DELETED",
+    "  LOG_RING_FILE_ROTATE",
+    "  LOG_UPLOAD_PROTOCOL",
+    "  LOG_UPLOAD_FILE_BYTES_SENT",
+    "  LOG_COMPACT_PART_ENTRY_DROPPED",
+    "  ENERGY_RESET"
 
 // End of file
@@ -28,7 +28,13 @@
 #include "ioc_temperature_battery.h"
 #include "ioc_power_control.h"
 #include "ioc_config.h"
+#include "ioc_diagnostics.h"
 #include "ioc_dynamics.h"
+#include "ioc_energy.h"
+#include "ioc_logging.h"
+#include "ioc_log_ring.h"
+#include "ioc_schedule.h"
+#include "ioc_trace.h"
 #include "ioc_utils.h"
 
 /* ----------------------------------------------------------------
@@ -74,6 +80,8 @@ int main()
 
     flash();
     initLog(gLogBuffer);
+    initLogRing();
+    initTrace();
 
     LOG(EVENT_SYSTEM_START, getResetReason());
     LOG(EVENT_BUILD_TIME_UNIX_FORMAT, __COMPILE_TIME_UNIX__);
@@ -109,6 +117,12 @@ int main()
         }
         printf("Awake from DEREGISTERED_SLEEP after %d second(s).\n",
                (int) (time(NULL) - getTimeEnterSleep()));
+        // Configuration, schedule and power control are
+        // retained through DEREGISTERED_SLEEP, that being the
+        // point of it, but the wake-up tick counter and sleep
+        // times start again, so that initialisation retries
+        // don't add up across sleeps
+        initDynamics();
     }
 
     // If we were not running normally, this must have been a power-on reset,
@@ -119,8 +133,18 @@ int main()
         initDynamics();
         resetPowerControl();
         resetConfig();
+        resetSchedule();
+        resetLogFilter();
     }
 
+    // Account for any battery charge used while we were asleep
+    // (the energy records are kept, if valid, even after OFF)
+    initEnergy();
+
+    // Count this wake-up in the diagnostics retained
+    // through standby
+    initDiagnosticsLifetime();
+
 #if defined(MBED_CONF_MBED_TRACE_ENABLE) && MBED_CONF_MBED_TRACE_ENABLE
     // NOTE: the mutex causes output to stop under heavy load, hence
     // it is commented out here.
@@ -154,9 +178,12 @@ int main()
     pSecondTicker = new Ticker();
     pSecondTicker->attach_us(callback(&feedWatchdog), 1000000);
     printLog();
+    printf("Printing the trace (Chrome trace JSON)...\n");
+    printTrace(stdout);
     pSecondTicker->detach();
     delete pSecondTicker;
     printf("Stopping logging...\n");
+    stopLogWriter();
     deinitLog();
     deinitFileSystem();
 
@@ -0,0 +1,45 @@
+#!/usr/bin/env python
+
+'''
+Echo the round trip time probes of source/ioc_audio_link.h: run this on
+the audio server's host and set "audio-link-probe-port" in mbed_app.json
+to the port it listens on.  Probes are sent only while streaming, one a
+second, and each is echoed back unchanged; anything that isn't a probe
+is ignored, so this never answers anything else.
+'''
+
+import argparse
+import socket
+import struct
+import sys
+
+PROBE_MAGIC = 0x494f4350
+PROBE_SIZE = 12
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Echo IOC audio link probes.')
+    parser.add_argument('--port', type=int, default=5066, help='UDP port (default %(default)s)')
+    parser.add_argument('--verbose', action='store_true', help='print each probe echoed')
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(('', args.port))
+    print('Echoing audio link probes on UDP port {}.'.format(args.port))
+    try:
+        while True:
+            data, address = sock.recvfrom(64)
+            # The probe is written in the device's byte order,
+            # which is little-endian
+            if len(data) == PROBE_SIZE and struct.unpack('<I', data[:4])[0] == PROBE_MAGIC:
+                sock.sendto(data, address)
+                if args.verbose:
+                    print('{}:{} probe {}.'.format(address[0], address[1],
+                                                   struct.unpack('<I', data[4:8])[0]))
+    except KeyboardInterrupt:
+        pass
+    sock.close()
+
+
+if __name__ == '__main__':
+    sys.exit(main())
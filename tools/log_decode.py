@@ -0,0 +1,177 @@
+#!/usr/bin/env python
+
+'''
+Decode IOC client log files, raw or compact (see source/ioc_log_compact.h),
+into the text form printed by printLog() on the target, one entry per line:
+
+    <timestamp in ms>: <event string> <parameter> (<parameter in hex>)
+
+Event strings for the application's events are taken from
+source/log_strings_app.h.  The log-client library's own events come
+before them; give the library's log_strings.h with --library-strings
+to name those too, otherwise they are printed as numbers.  A compact
+log file records the value of the first application event; for a raw
+log file it is taken from the library strings, if given, or from
+--first-app-event.
+'''
+
+from os import path
+import argparse
+import re
+import struct
+import sys
+
+LOG_COMPACT_MAGIC = b'IOCL'
+LOG_COMPACT_VERSION = 1
+LOG_COMPACT_HEADER_SIZE = 12
+LOG_ENTRY_FORMAT = '<iii'  # timestamp, event, parameter
+LOG_ENTRY_SIZE = struct.calcsize(LOG_ENTRY_FORMAT)
+
+DEFAULT_APP_STRINGS = path.join(path.dirname(path.abspath(__file__)),
+                                '..', 'source', 'log_strings_app.h')
+
+
+def to_int32(value):
+    value &= 0xffffffff
+    return value - 0x100000000 if value & 0x80000000 else value
+
+
+def read_varint(data, offset):
+    value = 0
+    shift = 0
+    while True:
+        if offset >= len(data):
+            raise ValueError('truncated varint at offset {}'.format(offset))
+        byte = bytearray(data[offset:offset + 1])[0]
+        offset += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value & 0xffffffff, offset
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def is_compact(data):
+    return data[:len(LOG_COMPACT_MAGIC)] == LOG_COMPACT_MAGIC
+
+
+def decode_raw(data):
+    '''Return the (timestamp, event, parameter) tuples in a raw log file.'''
+    return [struct.unpack_from(LOG_ENTRY_FORMAT, data, offset)
+            for offset in range(0, len(data) - LOG_ENTRY_SIZE + 1, LOG_ENTRY_SIZE)]
+
+
+def decode_compact(data):
+    '''Return (first application event, (timestamp, event, parameter) tuples)
+    for a compact log file.'''
+    if data[4:5] != bytearray([LOG_COMPACT_VERSION]):
+        raise ValueError('unsupported compact log version {}'.format(bytearray(data[4:5])[0]))
+    first_app_event = struct.unpack_from('<I', data, 8)[0]
+    entries = []
+    events = []
+    last_parameter = []
+    history = []  # (index, parameter delta), most recent last
+    timestamp = 0
+    offset = LOG_COMPACT_HEADER_SIZE
+
+    def add(index, timestamp_delta, parameter_delta):
+        last_parameter[index] = (last_parameter[index] + parameter_delta) & 0xffffffff
+        entries.append((to_int32(timestamp + timestamp_delta), events[index],
+                        to_int32(last_parameter[index])))
+        history.append((index, parameter_delta))
+        del history[:-4]
+        return (timestamp + timestamp_delta) & 0xffffffff
+
+    while offset < len(data):
+        head, offset = read_varint(data, offset)
+        kind = head & 3
+        if kind == 0:
+            index = head >> 2
+            timestamp_delta, offset = read_varint(data, offset)
+            parameter_delta, offset = read_varint(data, offset)
+            timestamp = add(index, unzigzag(timestamp_delta), unzigzag(parameter_delta))
+        elif kind == 1:
+            events.append(head >> 2)
+            last_parameter.append(0)
+        elif kind == 2:
+            pattern_length = head >> 2
+            if pattern_length < 1 or pattern_length > len(history):
+                raise ValueError('bad run at offset {}'.format(offset))
+            num_repeats, offset = read_varint(data, offset)
+            for _ in range(num_repeats * pattern_length):
+                index, parameter_delta = history[-pattern_length]
+                timestamp_delta, offset = read_varint(data, offset)
+                timestamp = add(index, unzigzag(timestamp_delta), parameter_delta)
+        else:
+            raise ValueError('unknown record type at offset {}'.format(offset))
+
+    return first_app_event, entries
+
+
+def read_strings(file_name):
+    '''Return the string literals in a log strings header, in order.'''
+    with open(file_name) as strings_file:
+        text = re.sub(r'//[^\n]*', '', strings_file.read())
+    return re.findall(r'"((?:[^"\\]|\\.)*)"', text)
+
+
+def event_string(event, first_app_event, app_strings, library_strings):
+    if first_app_event is not None and 0 <= event - first_app_event < len(app_strings):
+        return app_strings[event - first_app_event]
+    if 0 <= event < len(library_strings):
+        return library_strings[event]
+    return '  EVENT_{}'.format(event)
+
+
+def format_entry(entry, first_app_event, app_strings, library_strings):
+    '''Format an entry as printLog() does.'''
+    timestamp, event, parameter = entry
+    hex_parameter = parameter & 0xffffffff
+    return '{:6.3f}: {} {} ({})'.format(timestamp / 1000.0,
+                                        event_string(event, first_app_event,
+                                                     app_strings, library_strings),
+                                        parameter,
+                                        '{:#x}'.format(hex_parameter) if hex_parameter else '0')
+
+
+def read_log_file(file_name, first_app_event=None):
+    '''Return (first application event, entries) for a raw or compact log file.'''
+    with open(file_name, 'rb') as log_file:
+        data = log_file.read()
+    if is_compact(data):
+        return decode_compact(data)
+    return first_app_event, decode_raw(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode IOC client log files into text.')
+    parser.add_argument('files', nargs='+', help='log files, raw or compact')
+    parser.add_argument('--app-strings', default=DEFAULT_APP_STRINGS,
+                        help='the application log strings (default %(default)s)')
+    parser.add_argument('--library-strings',
+                        help='the log-client library log strings, log_strings.h')
+    parser.add_argument('--first-app-event', type=int,
+                        help='the value of the first application event, for raw log files')
+    args = parser.parse_args()
+
+    app_strings = read_strings(args.app_strings)
+    library_strings = []
+    first_app_event = args.first_app_event
+    if args.library_strings:
+        library_strings = read_strings(args.library_strings)
+        if first_app_event is None:
+            first_app_event = len(library_strings)
+
+    for file_name in args.files:
+        file_first_app_event, entries = read_log_file(file_name, first_app_event)
+        if len(args.files) > 1:
+            print('{}:'.format(file_name))
+        for entry in entries:
+            print(format_entry(entry, file_first_app_event, app_strings, library_strings))
+
+
+if __name__ == '__main__':
+    sys.exit(main())
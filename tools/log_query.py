@@ -0,0 +1,355 @@
+#!/usr/bin/env python
+
+'''
+Index and query the log files uploaded by a fleet of IOC clients, as
+stored by tools/log_server.py:
+
+    <directory>/<device ID>/<file name>
+
+"ingest" decodes the log files (with tools/log_decode.py) into an SQLite
+database, by default <directory>/index.db, indexed on event and time;
+only new or changed files are decoded, so it can be run as often as is
+convenient.  The queries then answer in milliseconds however many files
+there are:
+
+    log_query.py ingest
+    log_query.py find NETWORK_DISCONNECTED --device 0123...
+    log_query.py near SEND_FAILURE NETWORK_DISCONNECTED --within 5
+    log_query.py count
+    log_query.py export --output entries.csv
+
+Events are named as in the log strings, with or without "EVENT_"; events
+that can't be named (e.g. the log-client library's own, if
+--library-strings is not given to ingest) are EVENT_<value>.  Output is
+CSV with a header row, one row per result, so that it can go straight
+into a spreadsheet or, e.g., pandas.read_csv(...).to_parquet(...).
+
+Times are in microseconds since the device started, which is all a log
+entry records, so "near" only matches entries on the same timeline:
+the same device and the same boot.  The log files of one boot are the
+log ring files, r<sequence number>, written during it and the log file,
+l<sequence number>, which the logging library wrote during it and which
+is named at the start of the next boot (see source/ioc_log_index.h);
+the time stamps, which wrap every 2^32 microseconds, are unwrapped
+across them.  Any other file is a timeline of its own.
+'''
+
+import argparse
+import csv
+import os
+import re
+import sqlite3
+import sys
+
+import log_decode
+
+DEFAULT_DATABASE_NAME = 'index.db'
+TIMESTAMP_WRAP = 1 << 32
+FILE_NAME_PATTERN = re.compile(r'^([lr])(\d+)$')
+
+SCHEMA = '''
+CREATE TABLE IF NOT EXISTS files (
+    id INTEGER PRIMARY KEY,
+    device TEXT NOT NULL,
+    name TEXT NOT NULL,
+    size INTEGER NOT NULL,
+    mtime REAL NOT NULL,
+    num_entries INTEGER NOT NULL,
+    first_us INTEGER,
+    last_us INTEGER,
+    timeline TEXT,
+    offset_us INTEGER NOT NULL DEFAULT 0,
+    UNIQUE (device, name)
+);
+CREATE TABLE IF NOT EXISTS events (
+    id INTEGER PRIMARY KEY,
+    name TEXT NOT NULL UNIQUE
+);
+CREATE TABLE IF NOT EXISTS entries (
+    file_id INTEGER NOT NULL,
+    time_us INTEGER NOT NULL,
+    event_id INTEGER NOT NULL,
+    parameter INTEGER NOT NULL
+);
+CREATE INDEX IF NOT EXISTS entries_by_event ON entries (event_id, file_id, time_us);
+CREATE INDEX IF NOT EXISTS entries_by_file ON entries (file_id, time_us);
+CREATE INDEX IF NOT EXISTS files_by_timeline ON files (device, timeline);
+'''
+
+
+def event_name(name):
+    '''Return the name of an event as stored, from a log string or a
+    name given on the command line.'''
+    name = name.strip()
+    if name.startswith('* '):
+        name = name[2:]
+    if name.startswith('EVENT_') and not name[len('EVENT_'):].isdigit():
+        name = name[len('EVENT_'):]
+    return name
+
+
+def unwrap(timestamps):
+    '''Unwrap 32 bit microsecond time stamps, which are in order but for
+    small differences between tasks.'''
+    unwrapped = []
+    epoch = 0
+    last = None
+    for timestamp in timestamps:
+        timestamp &= TIMESTAMP_WRAP - 1
+        if last is not None and timestamp < last - TIMESTAMP_WRAP // 2:
+            epoch += TIMESTAMP_WRAP
+        last = timestamp
+        unwrapped.append(epoch + timestamp)
+    return unwrapped
+
+
+class LogIndex(object):
+
+    def __init__(self, file_name):
+        self.connection = sqlite3.connect(file_name)
+        self.connection.executescript(SCHEMA)
+        self.event_ids = dict(self.connection.execute('SELECT name, id FROM events'))
+
+    def event_id(self, name):
+        if name not in self.event_ids:
+            cursor = self.connection.execute('INSERT INTO events (name) VALUES (?)', (name,))
+            self.event_ids[name] = cursor.lastrowid
+        return self.event_ids[name]
+
+    def ingest_file(self, device, name, path, strings):
+        '''Decode a log file into the index, replacing what was there for
+        it, unless it hasn't changed; return True if it was decoded.'''
+        status = os.stat(path)
+        row = self.connection.execute('SELECT id, size, mtime FROM files WHERE device = ? AND name = ?',
+                                      (device, name)).fetchone()
+        if row and row[1] == status.st_size and row[2] == status.st_mtime:
+            return False
+        app_strings, library_strings, first_app_event = strings
+        try:
+            file_first_app_event, entries = log_decode.read_log_file(path, first_app_event)
+        except (ValueError, IndexError) as error:
+            # E.g. a compact file still being uploaded
+            print('{}/{}: skipped, {}'.format(device, name, error), file=sys.stderr)
+            return False
+        if row:
+            self.connection.execute('DELETE FROM entries WHERE file_id = ?', (row[0],))
+            self.connection.execute('DELETE FROM files WHERE id = ?', (row[0],))
+        times = unwrap([entry[0] for entry in entries])
+        cursor = self.connection.execute(
+            'INSERT INTO files (device, name, size, mtime, num_entries, first_us, last_us)'
+            ' VALUES (?, ?, ?, ?, ?, ?, ?)',
+            (device, name, status.st_size, status.st_mtime, len(entries),
+             times[0] if times else None, times[-1] if times else None))
+        file_id = cursor.lastrowid
+        self.connection.executemany(
+            'INSERT INTO entries (file_id, time_us, event_id, parameter) VALUES (?, ?, ?, ?)',
+            ((file_id, time_us,
+              self.event_id(event_name(log_decode.event_string(event, file_first_app_event,
+                                                               app_strings, library_strings))),
+              parameter)
+             for time_us, (_, event, parameter) in zip(times, entries)))
+        return True
+
+    def update_timelines(self, device):
+        '''Group the log files of a device into timelines and set the
+        offset that carries the time stamps of each log ring file on from
+        the one before it.'''
+        files = []
+        for file_id, name, first_us, last_us in self.connection.execute(
+                'SELECT id, name, first_us, last_us FROM files WHERE device = ?', (device,)):
+            match = FILE_NAME_PATTERN.match(name)
+            if match:
+                files.append((int(match.group(2)), match.group(1), file_id, first_us, last_us))
+            else:
+                self.connection.execute('UPDATE files SET timeline = ?, offset_us = 0 WHERE id = ?',
+                                        (name, file_id))
+        files.sort()
+        group = []
+        for sequence_number, kind, file_id, first_us, last_us in files:
+            group.append((kind, file_id, first_us, last_us))
+            if kind == 'l':
+                self.set_timeline(group, 'boot{}'.format(sequence_number))
+                group = []
+        if group:
+            # This boot's library log file hasn't arrived yet
+            self.set_timeline(group, 'boot-open{}'.format(files[-len(group)][0]))
+
+    def set_timeline(self, group, timeline):
+        end_us = None
+        for kind, file_id, first_us, last_us in group:
+            offset_us = 0
+            if kind == 'r' and end_us is not None and first_us is not None:
+                while first_us + offset_us < end_us - TIMESTAMP_WRAP // 2:
+                    offset_us += TIMESTAMP_WRAP
+            if kind == 'r' and last_us is not None:
+                end_us = last_us + offset_us
+            self.connection.execute('UPDATE files SET timeline = ?, offset_us = ? WHERE id = ?',
+                                    (timeline, offset_us, file_id))
+
+    def ingest(self, directory, strings):
+        num_files = 0
+        for device in sorted(os.listdir(directory)):
+            device_dir = os.path.join(directory, device)
+            if not os.path.isdir(device_dir):
+                continue
+            changed = False
+            for name in sorted(os.listdir(device_dir)):
+                path = os.path.join(device_dir, name)
+                if os.path.isfile(path) and self.ingest_file(device, name, path, strings):
+                    changed = True
+                    num_files += 1
+            if changed:
+                self.update_timelines(device)
+            self.connection.commit()
+        return num_files
+
+    def event_ids_for(self, names):
+        ids = []
+        for name in names:
+            name = event_name(name)
+            if name not in self.event_ids:
+                raise KeyError('no event "{}" in the index'.format(name))
+            ids.append(self.event_ids[name])
+        return ids
+
+
+def device_clause(args, alias):
+    if args.device:
+        return ' AND {}.device = ?'.format(alias), [args.device]
+    return '', []
+
+
+def write_rows(args, header, rows):
+    output = open(args.output, 'w', newline='') if args.output else sys.stdout
+    writer = csv.writer(output)
+    writer.writerow(header)
+    num_rows = 0
+    for row in rows:
+        writer.writerow(row)
+        num_rows += 1
+    if args.output:
+        output.close()
+    print('{} row(s).'.format(num_rows), file=sys.stderr)
+
+
+def command_ingest(index, args):
+    app_strings = log_decode.read_strings(args.app_strings)
+    library_strings = []
+    first_app_event = args.first_app_event
+    if args.library_strings:
+        library_strings = log_decode.read_strings(args.library_strings)
+        if first_app_event is None:
+            first_app_event = len(library_strings)
+    num_files = index.ingest(args.directory, (app_strings, library_strings, first_app_event))
+    print('{} log file(s) ingested.'.format(num_files), file=sys.stderr)
+
+
+def command_find(index, args):
+    event_ids = index.event_ids_for(args.events)
+    where, parameters = device_clause(args, 'f')
+    rows = index.connection.execute(
+        'SELECT f.device, f.timeline, f.name, e.time_us + f.offset_us, v.name, e.parameter'
+        ' FROM entries e JOIN files f ON f.id = e.file_id JOIN events v ON v.id = e.event_id'
+        ' WHERE e.event_id IN ({}){}'
+        ' ORDER BY f.device, f.timeline, e.time_us + f.offset_us'.format(
+            ', '.join('?' * len(event_ids)), where),
+        event_ids + parameters)
+    write_rows(args, ['device', 'timeline', 'file', 'time_us', 'event', 'parameter'], rows)
+
+
+def command_near(index, args):
+    event_id, other_event_id = index.event_ids_for([args.event, args.other_event])
+    within_us = int(args.within * 1000000)
+    where, parameters = device_clause(args, 'fa')
+    # For each entry of the event, look for the other event in each
+    # file of the same timeline, using the index on (event, file, time);
+    # CROSS JOIN stops SQLite choosing a different order
+    rows = index.connection.execute(
+        'SELECT fa.device, fa.timeline, fa.name, a.time_us + fa.offset_us, a.parameter,'
+        ' fb.name, b.time_us + fb.offset_us, b.parameter,'
+        ' (b.time_us + fb.offset_us) - (a.time_us + fa.offset_us)'
+        ' FROM entries a CROSS JOIN files fa ON fa.id = a.file_id'
+        ' CROSS JOIN files fb ON fb.device = fa.device AND fb.timeline = fa.timeline'
+        ' CROSS JOIN entries b ON b.event_id = ? AND b.file_id = fb.id'
+        ' AND b.time_us BETWEEN a.time_us + fa.offset_us - fb.offset_us - ?'
+        ' AND a.time_us + fa.offset_us - fb.offset_us + ?'
+        ' WHERE a.event_id = ?{}'
+        ' ORDER BY fa.device, fa.timeline, a.time_us + fa.offset_us'.format(where),
+        [other_event_id, within_us, within_us, event_id] + parameters)
+    write_rows(args, ['device', 'timeline', 'file', 'time_us', 'parameter',
+                      'other_file', 'other_time_us', 'other_parameter', 'delta_us'], rows)
+
+
+def command_count(index, args):
+    where, parameters = device_clause(args, 'f')
+    rows = index.connection.execute(
+        'SELECT f.device, v.name, COUNT(*) FROM entries e JOIN files f ON f.id = e.file_id'
+        ' JOIN events v ON v.id = e.event_id WHERE 1{}'
+        ' GROUP BY f.device, v.name ORDER BY f.device, COUNT(*) DESC'.format(where),
+        parameters)
+    write_rows(args, ['device', 'event', 'count'], rows)
+
+
+def command_export(index, args):
+    where, parameters = device_clause(args, 'f')
+    rows = index.connection.execute(
+        'SELECT f.device, f.timeline, f.name, e.time_us + f.offset_us, v.name, e.parameter'
+        ' FROM files f JOIN entries e ON e.file_id = f.id JOIN events v ON v.id = e.event_id'
+        ' WHERE 1{} ORDER BY f.device, f.timeline, e.time_us + f.offset_us'.format(where),
+        parameters)
+    write_rows(args, ['device', 'timeline', 'file', 'time_us', 'event', 'parameter'], rows)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Index and query uploaded IOC client log files.')
+    parser.add_argument('--directory', default='logs',
+                        help='where the logging server stores the log files (default %(default)s)')
+    parser.add_argument('--database',
+                        help='the index database (default <directory>/{})'.format(
+                            DEFAULT_DATABASE_NAME))
+    commands = parser.add_subparsers(dest='command')
+    commands.required = True
+
+    ingest = commands.add_parser('ingest', help='add new or changed log files to the index')
+    ingest.add_argument('--app-strings', default=log_decode.DEFAULT_APP_STRINGS,
+                        help='the application log strings (default %(default)s)')
+    ingest.add_argument('--library-strings',
+                        help='the log-client library log strings, log_strings.h')
+    ingest.add_argument('--first-app-event', type=int,
+                        help='the value of the first application event, for raw log files')
+    ingest.set_defaults(function=command_ingest)
+
+    find = commands.add_parser('find', help='list the entries with the given events')
+    find.add_argument('events', nargs='+', help='event names')
+    find.set_defaults(function=command_find)
+
+    near = commands.add_parser('near', help='list the entries with an event that are within'
+                                            ' a time of an entry with another event')
+    near.add_argument('event', help='the event to list')
+    near.add_argument('other_event', help='the event it must be near')
+    near.add_argument('--within', type=float, default=5.0,
+                      help='how near, in seconds (default %(default)s)')
+    near.set_defaults(function=command_near)
+
+    count = commands.add_parser('count', help='count the entries of each event on each device')
+    count.set_defaults(function=command_count)
+
+    export = commands.add_parser('export', help='write out all of the entries')
+    export.set_defaults(function=command_export)
+
+    for command in (find, near, count, export):
+        command.add_argument('--device', help='only this device')
+        command.add_argument('--output', help='write CSV to this file rather than stdout')
+
+    args = parser.parse_args()
+    index = LogIndex(args.database or os.path.join(args.directory, DEFAULT_DATABASE_NAME))
+    try:
+        args.function(index, args)
+    except KeyError as error:
+        print(error.args[0], file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
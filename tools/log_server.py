@@ -0,0 +1,257 @@
+#!/usr/bin/env python
+
+'''
+A stand-in for the logging server, implementing the log upload protocol
+of source/ioc_log_upload.h.  Log files are stored as
+
+    <directory>/<device ID>/<file name>
+
+and the offset reported to the client for a file is simply how much of
+it is stored, so an upload resumes where it stopped, even across
+restarts of this server.  Since the client reuses file names, the
+identity a version 2 client gives each file is kept alongside it, in
+<file name>.id, and a file whose identity has changed is started
+again from nothing.  Use tools/log_decode.py to read the stored
+files and tools/log_query.py to index and query them across devices.
+Clients of protocol version 2 may ask for their log data to be LZSS
+compressed (see source/ioc_lzss.h); --no-compression refuses.
+--drop-after makes the server drop each connection after that
+many bytes of log data, to exercise resumption.
+'''
+
+import argparse
+import os
+import re
+import socketserver
+import sys
+
+PROTOCOL_VERSIONS = ('1', '2')
+CAPABILITY_LZSS = 'LZSS'
+MAX_LEN_LINE = 80
+MAX_CHUNK_SIZE = 65536
+LZSS_OFFSET_BITS = 11
+LZSS_LENGTH_BITS = 5
+LZSS_MIN_MATCH = 3
+NAME_PATTERN = re.compile(r'^[A-Za-z0-9_.-]+$')
+IDENTITY_PATTERN = re.compile(r'^[0-9a-f]{8}$')
+IDENTITY_SUFFIX = '.id'
+
+
+class ProtocolError(Exception):
+    pass
+
+
+class LzssDecompressor(object):
+    '''Decompress the LZSS stream of source/ioc_lzss.h a block at a time,
+    keeping the window that later blocks may refer back to.'''
+
+    def __init__(self):
+        self.window = bytearray()
+
+    def add(self, data):
+        '''Add bytes that were sent uncompressed to the window.'''
+        self.window += data
+        del self.window[:-(1 << LZSS_OFFSET_BITS)]
+
+    def decompress(self, data, length):
+        out = bytearray()
+        history = self.window
+        offset = 0
+        while offset < len(data) and len(out) < length:
+            flags = data[offset]
+            offset += 1
+            for bit in range(8):
+                if offset >= len(data) or len(out) >= length:
+                    break
+                if flags & (1 << bit):
+                    if offset + 2 > len(data):
+                        raise ProtocolError('truncated match')
+                    item = (data[offset] << 8) | data[offset + 1]
+                    offset += 2
+                    distance = (item >> LZSS_LENGTH_BITS) + 1
+                    match_length = (item & ((1 << LZSS_LENGTH_BITS) - 1)) + LZSS_MIN_MATCH
+                    start = len(history) + len(out) - distance
+                    if start < 0:
+                        raise ProtocolError('match before start of stream')
+                    for index in range(start, start + match_length):
+                        out.append(history[index] if index < len(history)
+                                   else out[index - len(history)])
+                else:
+                    out.append(data[offset])
+                    offset += 1
+        if offset != len(data) or len(out) != length:
+            raise ProtocolError('bad compressed data')
+        self.add(out)
+        return bytes(out)
+
+
+class LogUploadHandler(socketserver.StreamRequestHandler):
+
+    def read_line(self):
+        line = self.rfile.readline(MAX_LEN_LINE)
+        if not line:
+            raise EOFError()
+        if not line.endswith(b'\n'):
+            raise ProtocolError('line too long')
+        return line.decode('ascii', 'replace').strip()
+
+    def write_line(self, line):
+        self.wfile.write((line + '\n').encode('ascii'))
+        self.wfile.flush()
+
+    def log(self, message):
+        print('{}:{} {}'.format(self.client_address[0], self.client_address[1], message))
+        sys.stdout.flush()
+
+    def handle(self):
+        self.bytes_received = 0
+        try:
+            self.serve()
+        except EOFError:
+            self.log('disconnected')
+        except ProtocolError as error:
+            self.log('error: {}'.format(error))
+            self.write_line('ERROR {}'.format(error))
+        except (ConnectionError, OSError) as error:
+            self.log('dropped: {}'.format(error))
+
+    def serve(self):
+        words = self.read_line().split()
+        if len(words) < 3 or words[0] != 'IOCU':
+            raise ProtocolError('expected IOCU')
+        if words[1] not in PROTOCOL_VERSIONS:
+            raise ProtocolError('unsupported version {}'.format(words[1]))
+        if words[1] == '1' and len(words) != 3:
+            raise ProtocolError('expected IOCU')
+        if not NAME_PATTERN.match(words[2]):
+            raise ProtocolError('bad device ID')
+        version = words[1]
+        capabilities = []
+        if CAPABILITY_LZSS in words[3:] and self.server.compression:
+            capabilities.append(CAPABILITY_LZSS)
+        device_dir = os.path.join(self.server.directory, words[2])
+        os.makedirs(device_dir, exist_ok=True)
+        self.log('device {}, version {}{}'.format(words[2], words[1],
+                                                 ', ' + ' '.join(capabilities) if capabilities else ''))
+        self.write_line(' '.join(['OK'] + capabilities))
+
+        log_file = None
+        name = None
+        size = 0
+        decompressor = None
+        bytes_sent = 0
+        while True:
+            words = self.read_line().split()
+            if not words:
+                raise ProtocolError('empty line')
+            if words[0] == 'BYE':
+                self.log('done')
+                return
+            if words[0] == 'FILE' and len(words) == (4 if version == '1' else 5):
+                name, size, client_offset = words[1], int(words[2]), int(words[3])
+                identity = words[4] if len(words) > 4 else None
+                if (not NAME_PATTERN.match(name) or name.endswith(IDENTITY_SUFFIX) or size < 0 or
+                        (identity is not None and not IDENTITY_PATTERN.match(identity))):
+                    raise ProtocolError('bad file')
+                if log_file:
+                    log_file.close()
+                if capabilities:
+                    decompressor = LzssDecompressor()
+                bytes_sent = 0
+                path = os.path.join(device_dir, name)
+                log_file = open(path, 'ab+')
+                held = log_file.tell()
+                if held > size or (identity is not None and
+                                   read_identity(path) != identity):
+                    # Not the same file as the one we have
+                    if held:
+                        self.log('{}: not the file held, starting again'.format(name))
+                    log_file.truncate(0)
+                    held = 0
+                    if identity is not None:
+                        write_identity(path, identity)
+                self.log('{}: {} byte(s), client has {} saved, server holds {}'.format(
+                    name, size, client_offset, held))
+                self.write_line('OFFSET {}'.format(held))
+            elif ((words[0] == 'DATA' and len(words) == 3) or
+                  (words[0] == 'ZDATA' and len(words) == 4 and decompressor)) and log_file:
+                offset, length = int(words[1]), int(words[2])
+                sent = int(words[3]) if words[0] == 'ZDATA' else length
+                if length < 0 or length > MAX_CHUNK_SIZE or sent < 0 or sent > MAX_CHUNK_SIZE:
+                    raise ProtocolError('bad length')
+                data = self.rfile.read(sent)
+                if len(data) != sent:
+                    raise EOFError()
+                # Every chunk goes through the decompressor, kept
+                # or not, so that its window matches the client's
+                if words[0] == 'ZDATA':
+                    data = decompressor.decompress(bytearray(data), length)
+                elif decompressor:
+                    decompressor.add(data)
+                self.bytes_received += sent
+                bytes_sent += sent
+                if (self.server.drop_after and
+                        self.bytes_received > self.server.drop_after):
+                    self.log('{}: dropping connection at {}'.format(name, offset))
+                    return
+                log_file.seek(0, os.SEEK_END)
+                held = log_file.tell()
+                if offset == held and held + length <= size:
+                    log_file.write(data)
+                    log_file.flush()
+                    os.fsync(log_file.fileno())
+                    held += length
+                # Otherwise the chunk is not the next one: the
+                # client carries on from what we actually hold
+                if held == size:
+                    self.log('{}: complete, {} byte(s) sent'.format(name, bytes_sent))
+                self.write_line('ACK {}'.format(held))
+            else:
+                raise ProtocolError('unexpected "{}"'.format(words[0]))
+
+
+def read_identity(path):
+    '''Return the identity of the stored file at path, None if not known.'''
+    try:
+        with open(path + IDENTITY_SUFFIX) as identity_file:
+            return identity_file.read().strip()
+    except OSError:
+        return None
+
+
+def write_identity(path, identity):
+    with open(path + IDENTITY_SUFFIX, 'w') as identity_file:
+        identity_file.write(identity + '\n')
+
+
+class LogServer(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Stand-in for the IOC logging server.')
+    parser.add_argument('--port', type=int, default=5060, help='TCP port (default %(default)s)')
+    parser.add_argument('--directory', default='logs',
+                        help='where to store the log files (default %(default)s)')
+    parser.add_argument('--drop-after', type=int, default=0,
+                        help='drop each connection after this many bytes of log data')
+    parser.add_argument('--no-compression', action='store_true',
+                        help='refuse to have log data compressed')
+    args = parser.parse_args()
+
+    server = LogServer(('', args.port), LogUploadHandler)
+    server.directory = args.directory
+    server.drop_after = args.drop_after
+    server.compression = not args.no_compression
+    print('Logging server listening on port {}, storing log files in "{}".'.format(
+        args.port, args.directory))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    server.server_close()
+
+
+if __name__ == '__main__':
+    sys.exit(main())